@@ -0,0 +1,276 @@
+/*
+microbenchmarks of the hot paths of the game: parse_line() and parser() on synthetic banks (or on a bank given with -d),
+compare() on answers of realistic length and get_command() on scripted input through a pipe.
+the game itself is compiled into this file, its main() renamed so it does not clash with ours,
+and every malloc() is counted through the linker (-Wl,--wrap=malloc)
+*/
+#define main quizia_main
+#include "../main.c"
+#undef main
+
+#include <time.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define COMPARE_ROUNDS 2000000 /* calls of compare() per pair of answers */
+#define COMMAND_SCRIPTS 5000 /* times the command script is written to the pipe */
+#define PARSE_QUESTIONS 200000 /* questions parsed per bank size, small banks are parsed several times */
+
+
+unsigned long allocations = 0; /* number of calls of malloc() since the last reset */
+volatile int sink; /* results are stored here so the compiler cannot drop the calls being measured */
+
+void *__real_malloc(size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+
+/*
+current time of the monotonic clock
+@return time in nanoseconds
+*/
+double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/*
+prints a row of the report
+@param name name of the benchmark
+@param ops operations measured
+@param ns total time in nanoseconds
+@param allocs allocations made during the measure
+*/
+void report(char *name, double ops, double ns, unsigned long allocs) {
+    printf("%-28s %12.0f %12.2f %12.2f\n", name, ops, ns / ops, allocs / ops);
+}
+
+
+/*
+memory resident in the process
+@return resident memory in KiB, 0 if unknown
+*/
+long resident_kib() {
+    long pages = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+
+    if (file == NULL) { return 0; }
+    if (fscanf(file, "%*s %ld", &pages) != 1) { pages = 0; }
+    fclose(file);
+
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+/*
+writes a random string of words
+@param str stores the string
+@param min minimum length
+@param max maximum length, must be below BUF_PRS_SIZE
+*/
+void random_text(char *str, int min, int max) {
+    static char *words[] = { "the", "which", "element", "capital", "largest", "of", "is", "what", "known",
+                             "body", "human", "planet", "ocean", "river", "atomic", "number", "world", "a" };
+    int len = min + rand() % (max - min + 1), i = 0, j;
+    char *word;
+
+    while (i < len) {
+        word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+        for (j = 0; word[j] && i < len; j++) { str[i++] = word[j]; }
+        if (i < len) { str[i++] = ' '; }
+    }
+    if (str[len - 1] == ' ') { str[len - 1] = 'x'; }
+    str[len] = '\0';
+}
+
+
+/*
+writes a synthetic bank of questions in the format of the database
+@param path path of the bank
+@param questions number of questions
+@return 0 on success, 1 otherwise
+*/
+int write_bank(char *path, int questions) {
+    char str[BUF_PRS_SIZE];
+    FILE *file;
+    int i;
+
+    if ((file = fopen(path, "w")) == NULL) { return 1; }
+    for (i = 0; i < questions; i++) {
+        random_text(str, 20, 70); /* question */
+        fprintf(file, "%d%s\n", (int)strlen(str), str);
+        random_text(str, 3, 20); /* answer */
+        fprintf(file, "%d%s\n", (int)strlen(str), str);
+        random_text(str, 10, 60); /* clue */
+        fprintf(file, "%d%s\n", (int)strlen(str), str);
+    }
+    return fclose(file) != 0;
+}
+
+
+/*
+measures parse_line() and parser() on a bank, and the memory the parsed bank takes
+@param questions number of questions of the synthetic bank to write, ignored if bank is given
+@param bank path of an existing bank, NULL to write a synthetic one
+*/
+void bench_parser(int questions, char *bank) {
+    char name[64], buf[BUF_PRS_SIZE];
+    int fd, round, rounds = 1, lines = 0, parsed = 0;
+    long resident = 0, grown;
+    double start, ns;
+    QuestionNode *head = NULL, *node;
+
+    unlink(DATABASE_PATH);
+    if (bank != NULL) { /* parsed once, large banks are what it is for */
+        if (symlink(bank, DATABASE_PATH) == -1) {
+            printf("failed to link the bank %s\n", bank);
+            return;
+        }
+    }
+    else {
+        rounds = PARSE_QUESTIONS / questions;
+        if (rounds < 1) { rounds = 1; }
+        srand(questions);
+        if (write_bank(DATABASE_PATH, questions)) {
+            printf("failed to write the bank of %d questions\n", questions);
+            return;
+        }
+    }
+
+    allocations = 0;
+    start = now();
+    for (round = 0; round < rounds; round++) {
+        if ((fd = open(DATABASE_PATH, O_RDONLY)) == -1) {
+            printf("failed to open the bank\n");
+            return;
+        }
+        while (!parse_line(fd, buf)) { lines++; } /* parse_line() closes the file at EOF */
+    }
+    ns = now() - start;
+    questions = lines / 3 / rounds;
+    sprintf(name, "parse_line/%d", questions);
+    report(name, lines, ns, allocations);
+
+    allocations = 0;
+    ns = 0;
+    for (round = 0; round < rounds; round++) {
+        grown = resident_kib();
+        start = now();
+        if (parser(&head)) { return; }
+        ns += now() - start;
+        /* the rounds after the first reuse the heap clear() freed, so the footprint is the most a round grew by */
+        if ((grown = resident_kib() - grown) > resident) { resident = grown; }
+
+        for (node = head; node != NULL; node = (*node).next) { parsed++; }
+        clear(&head);
+    }
+    sprintf(name, "parser/%d", questions);
+    report(name, parsed, ns, allocations);
+    if (questions > 0) {
+        printf("%-28s %12ld KiB resident, %.1f bytes/question\n", "", resident, resident * 1024.0 / questions);
+    }
+}
+
+
+/*
+measures compare() on pairs of answers of realistic length
+*/
+void bench_compare() {
+    char *pairs[][2] = {
+        { "Canberra", "canberra" }, /* same answer, different case */
+        { "Hydrogen", "Hydrogem" }, /* a single mistake is let pass */
+        { "Euclid of Alexandria", "Euclid of Alexandrai" }, /* two mistakes at the end of a long answer */
+        { "Pacific Ocean", "Atlantic Ocean" }, /* differs right away */
+        { "Femur", "Femurs" } /* different lengths */
+    };
+    int i, j, n = sizeof(pairs) / sizeof(pairs[0]);
+    double start;
+
+    allocations = 0;
+    start = now();
+    for (i = 0; i < COMPARE_ROUNDS; i++) {
+        for (j = 0; j < n; j++) { sink = compare(pairs[j][0], pairs[j][1]); }
+    }
+    report("compare", (double)COMPARE_ROUNDS * n, now() - start, allocations);
+}
+
+
+/*
+measures get_command() reading a script of commands and answers from a pipe, as typed by a player
+*/
+void bench_get_command() {
+    char *script = "/start\n/help\nCarbon\n/clue\nEuclid of Alexandria\n/points\n/bogus\n"
+                   "an answer longer than the answer buffer of the game\n/exit\n";
+    char answer[BUF_ANS_SIZE];
+    int i, fds[2], commands = 0, len = strlen(script);
+    double start;
+    pid_t pid;
+
+    if (pipe(fds) == -1) { return; }
+    fflush(stdout); /* otherwise the child inherits and prints again whatever is still buffered */
+
+    if ((pid = fork()) == 0) {
+        close(fds[0]);
+        for (i = 0; i < COMMAND_SCRIPTS; i++) {
+            if (write(fds[1], script, len) != len) { break; }
+        }
+        close(fds[1]);
+        exit(0);
+    }
+    close(fds[1]);
+
+    allocations = 0;
+    start = now();
+    while (get_command(fds[0], BUF_ANS_SIZE, answer) != CMD_EOC) { commands++; }
+    report("get_command", commands, now() - start, allocations);
+
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+}
+
+
+int main(int argc, char **argv) {
+    char dir[] = "/tmp/quizia-bench-XXXXXX", cwd[4096], *bank = NULL;
+    int sizes[] = { 12, 1000, 100000 }, i;
+
+    if (argc == 3 && strcmp(argv[1], "-d") == 0) {
+        /* the bank is linked from the temporary directory, so a relative path has to be made absolute first */
+        if (argv[2][0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL) { cwd[0] = '\0'; }
+        if ((bank = malloc(strlen(cwd) + strlen(argv[2]) + 2)) == NULL) {
+            printf("memory error\n");
+            return 1;
+        }
+        sprintf(bank, "%s%s%s", cwd, cwd[0] ? "/" : "", argv[2]);
+    }
+    else if (argc != 1) {
+        printf("usage: %s [-d bank]\n", argv[0]);
+        return 1;
+    }
+
+    /* the game opens its database relative to the working directory, so the banks are written in a directory of their own */
+    if (mkdtemp(dir) == NULL || chdir(dir) == -1) {
+        printf("failed to create a temporary directory\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%-28s %12s %12s %12s\n", "benchmark", "ops", "ns/op", "allocs/op");
+    if (bank != NULL) { bench_parser(0, bank); }
+    else {
+        for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) { bench_parser(sizes[i], NULL); }
+    }
+    bench_compare();
+    bench_get_command();
+
+    unlink(DATABASE_PATH);
+    rmdir(dir);
+    free(bank);
+    return 0;
+}
@@ -1,9 +1,13 @@
+#define _POSIX_C_SOURCE 200809L /* struct itimerspec under -ansi */
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <signal.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 
 #define DATABASE_PATH "super-secret.db"
 
@@ -34,9 +38,10 @@
                     "If your score becomes negative, the game is over\n\n"\
                     "Try to get as many points as possible!\n\n\n"
 
-#define TO_INT(c) ((c) - '0')
+#define QUESTION_TIME 15 /* seconds to answer each question */
+#define COUNTDOWN 5 /* the last seconds are counted down on the prompt */
 
-volatile int timer = 0;
+#define TO_INT(c) ((c) - '0')
 
 typedef struct {
     char *question;
@@ -50,12 +55,6 @@ typedef struct QuestionNode {
 } QuestionNode;
 
 
-void sig_alarm_handler() {
-    timer = 1; /* change the value, meaning the timer is up */
-    signal(SIGALRM, sig_alarm_handler);
-}
-
-
 /*
 reads until a newline character is found, 
 the newline character is read, 
@@ -221,7 +220,7 @@ char *duplicate(char *src) {
 parses the next line from the database
 @param fd file descriptor of database
 @param *buf buffer to store the information of the line
-@return 0 if parsed successfully, 1 otherwise
+@return 0 if parsed successfully, 1 at EOF, -1 if the line is not formatted
 */
 int parse_line(int fd, char *buf) {
     char c;
@@ -238,7 +237,12 @@ int parse_line(int fd, char *buf) {
     if (!count) {
         printf("database is not formatted: line needs to start with its size\n");
         close(fd);
-        return 1;
+        return -1;
+    }
+    if (bytes >= BUF_PRS_SIZE) { /* the line would not fit in the buffer */
+        printf("database is not formatted: lines can not be longer than %d\n", BUF_PRS_SIZE - 1);
+        close(fd);
+        return -1;
     }
     buf[0] = c;
     read(fd, buf + 1, bytes); /* newline included */
@@ -254,8 +258,8 @@ parses the database
 @return 0 if parsed successfully, 1 otherwise
 */
 int parser(QuestionNode **head) {
-    int fd;
-    char buf[BUF_PRS_SIZE];
+    int fd, status;
+    char buf[3][BUF_PRS_SIZE];
 
     if ((fd = open(DATABASE_PATH, O_RDONLY)) == -1) {
         printf("failed to open database\n");
@@ -267,26 +271,31 @@ int parser(QuestionNode **head) {
 
         if (q == NULL || node == NULL) {
             printf("memory error\n");
+            free(q);
+            free(node);
             clear(head);
             close(fd);
             return 1;
         }
         
         /* parse line (Question) - will return 1 if EOF is reached */
-        if (parse_line(fd, buf)) {
+        if ((status = parse_line(fd, buf[0])) == 1) {
             free(q);
             free(node);
             break;
         }
-        (*q).question = duplicate(buf);
-        
-        /* parse line (Answer) */
-        parse_line(fd, buf);
-        (*q).answer = duplicate(buf);
 
-        /* parse line (Clue) */
-        parse_line(fd, buf);
-        (*q).clue = duplicate(buf);
+        /* parse lines (Answer) and (Clue), a question cut short is not formatted either */
+        if (status == -1 || (status = parse_line(fd, buf[1])) != 0 || (status = parse_line(fd, buf[2])) != 0) {
+            if (status == 1) { printf("database is not formatted: every question needs an answer and a clue\n"); }
+            free(q);
+            free(node);
+            clear(head);
+            return 1;
+        }
+        (*q).question = duplicate(buf[0]);
+        (*q).answer = duplicate(buf[1]);
+        (*q).clue = duplicate(buf[2]);
 
         (*node).question = q;
 
@@ -335,33 +344,71 @@ int compare(char *correct_answer, char *answer) {
 
 
 /*
-starts the game
+arms the timer of a question so it ticks once per second, or disarms it
+@param timer_fd file descriptor of the timer
+@param seconds 1 to arm the timer, 0 to disarm it
+*/
+void set_timer(int timer_fd, int seconds) {
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = seconds;
+    spec.it_interval.tv_sec = seconds;
+    timerfd_settime(timer_fd, 0, &spec, NULL);
+}
+
+
+/*
+starts the game,
+the input loop waits on stdin and on a timer at the same time, so the time of a question is up exactly when it is up
 @param total_points total points for user to start with
 @param head head of linked list
 */
 void start(int total_points, QuestionNode **head) {
     char buf[BUF_ANS_SIZE];
-    int answered;
+    int answered, remaining, timer_fd;
+    uint64_t ticks;
+    struct pollfd fds[2];
     QuestionNode *node = *head;
 
-    signal(SIGALRM, sig_alarm_handler);    
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, 0)) == -1) {
+        printf("failed to create the timer\n");
+        return;
+    }
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = timer_fd;
+    fds[1].events = POLLIN;
 
     while (node != NULL) {
         printf("\n%s\n", (*(*node).question).question);
         
-        alarm(15); /* each question has a timer of 15 seconds */
+        remaining = QUESTION_TIME; /* each question has a timer of 15 seconds */
+        set_timer(timer_fd, 1);
 
         answered = 0;
+        printf("> ");
+        fflush(stdout);
 
         while (!answered) {
-            if (timer) {
-                printf(TIMES_UP);
-                timer = 0;
-                total_points--;
-                break;
+            if (poll(fds, 2, -1) == -1) { continue; }
+
+            if (fds[1].revents & POLLIN) { /* one second (or more, if we were late) went by */
+                if (read(timer_fd, &ticks, sizeof(ticks)) == sizeof(ticks)) { remaining -= ticks; }
+
+                if (remaining <= 0) {
+                    printf("\n" TIMES_UP);
+                    total_points--;
+                    if (total_points == -1) { printf(LOSE); }
+                    break;
+                }
+                if (remaining <= COUNTDOWN) {
+                    printf("\r[%d] > ", remaining);
+                    fflush(stdout);
+                }
             }
-            printf("> ");
-            fflush(stdout);
+            if (!(fds[0].revents & (POLLIN | POLLHUP))) { continue; }
+
             switch (get_command(STDIN_FILENO, BUF_ANS_SIZE, buf)) {
                 case CMD_START:
                     printf("the game has already started!\n");
@@ -370,6 +417,7 @@ void start(int total_points, QuestionNode **head) {
                     printf("leaving the game...\n");
                     sleep(2);
                     printf("done!\n\n");
+                    close(timer_fd);
                     return;
                 case CMD_HELP:
                     printf(HELP);
@@ -384,7 +432,7 @@ void start(int total_points, QuestionNode **head) {
                     printf("invalid command!\n");
                     break;
                 case CMD_EOC:
-                    /* do nothing */
+                    fds[0].fd = -1; /* stdin is closed, only the timer is left to wait for */
                     break;
                 case CMD_NOT:
                     answered = 1;
@@ -399,10 +447,16 @@ void start(int total_points, QuestionNode **head) {
                     }
                     break;
             }
+            if (!answered) {
+                printf("> ");
+                fflush(stdout);
+            }
         }
+        set_timer(timer_fd, 0);
         if (total_points < 0) { break; }
         node = (*node).next;
     }
+    close(timer_fd);
     printf(GAME_OVER);
 }
 
@@ -4,10 +4,19 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 
 #define BUF_PRS_SIZE 84
 #define BUF_CMD_SIZE 16
 #define BUF_ANS_SIZE 32
+#define BUF_NAME_SIZE 16
+#define BUF_MSG_SIZE 256
+#define BUF_TOKEN_SIZE 17
+
+#define TERMINATE -1 /* registered instead of a slot to terminate the server */
+#define BUSY_TRIES 10 /* times a client the server sheds registers again */
 
 #define CMD_START 2
 #define CMD_EXIT 3
@@ -17,6 +26,7 @@
 #define CMD_INVALID 7
 #define CMD_EOC 8
 #define CMD_NOT 9
+#define CMD_TOP 10
 
 #define QUESTION 'q'
 #define ANSWER 'a'
@@ -26,11 +36,24 @@
 #define LAST_QUESTION 'l'
 #define PROCEED 'p'
 #define DISCARD 'd'
+#define TIMEOUT 't'
+#define PLAYER_NAME 'u'
+#define LEADERBOARD 'b'
+#define JOIN 'j'
+#define WINNER 'w'
+#define RESUME 'r'
+#define BUSY 'x' /* the server did not admit the client, followed by the milliseconds to wait before trying again */
+
+#define WAIT_STATUS 0 /* states of the game: waiting for the status of the next question */
+#define WAIT_QUESTION 1 /* waiting for the question */
+#define PLAYING 2 /* the question is on screen and the user can answer */
+#define WAIT_ANSWER 3 /* the user answered and the client waits for the correct answer */
 
 #define CORRECT "\t\t\t\033[1;32mCorrect Answer!\033[0m\n\n"
 #define INCORRECT "\t\t\t\033[1;31mWrong Answer!\033[0m\n\n"
 #define LOSE "\033[1;31mYou have -1 points! YOU LOST!\033[0m\n"
 #define WIN "\033[1;32mCongratulations! You answered all the questions!\033[0m\n"
+#define TIMES_UP "\t\t\t\033[1;33mTIME IS UP!\033[0m\n\n"
 #define SCREEN_HOME "\n\t\tWelcome to Quizia - a simple, fun and challenging trivia quiz\n\n\n"
 #define HELP    "\t\t\033[1;33mHOW TO PLAY?\033[0m\n"\
                 "\t- You will start with a total of 2 points\n"\
@@ -44,10 +67,19 @@
                 "\t- Answering: Simply type your answer and press enter\n"\
                 "\t- Requesting a clue: Type the /clue command\n"\
                 "\t- Requesting your points: Type the /points command\n"\
+                "\t- Requesting the best scores of every player: Type the /top command\n"\
                 "\t- Exiting: Type the `/exit` command\n\n"
 
 
 
+/* buffered reader of the response fifo, so the server messages are split correctly however read() returns them */
+typedef struct {
+    int fd, start, end;
+    char buf[BUF_MSG_SIZE];
+} Reader;
+
+
+
 /*
 concatenates two strings
 @param src initial string
@@ -123,7 +155,7 @@ int get_command(int fd, int len, char *answer) {
 
     if (read(fd, buf + 1, 1) != 1) { return CMD_INVALID; }
 
-    /* buf[1] is the command identifier such that: s = /start, e = /exit, h = /help, p = /points, c = /clue */
+    /* buf[1] is the command identifier such that: s = /start, e = /exit, h = /help, p = /points, c = /clue, t = /top */
     switch (buf[1]) {
         case 's': 
             if ((n = read(fd, buf + 2, 4)) != 4 || strncmp(buf, "/start", 6) != 0) { /* read the next 4 bytes expecting to form the string "tart", and store them in the buffer and check if it matches the command */
@@ -175,6 +207,16 @@ int get_command(int fd, int len, char *answer) {
                 return CMD_INVALID;
             }
             return CMD_CLUE;
+        case 't':
+            if ((n = read(fd, buf + 2, 2)) != 2 || strncmp(buf, "/top", 4) != 0) {
+                if (n == 2 && buf[3] != '\n') { cleanup(fd); }
+                return CMD_INVALID;
+            }
+            if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+                cleanup(fd);
+                return CMD_INVALID;
+            }
+            return CMD_TOP;
         case '\n':
             return CMD_INVALID;
         default:
@@ -220,39 +262,80 @@ int compare(char *correct_answer, char *answer) {
 }
 
 
+/*
+reads the next byte written by the server
+@param reader reader of the response fifo
+@param c stores the byte read
+@return 0 on success, 1 if the server closed the fifo
+*/
+int read_byte(Reader *reader, char *c) {
+    if ((*reader).start == (*reader).end) {
+        int n = read((*reader).fd, (*reader).buf, BUF_MSG_SIZE);
+
+        if (n <= 0) { return 1; }
+        (*reader).start = 0;
+        (*reader).end = n;
+    }
+    *c = (*reader).buf[(*reader).start++];
+    return 0;
+}
+
+
+/*
+reads the next message written by the server: either a single status byte or a QUESTION, ANSWER, CLUE, LEADERBOARD, WINNER, RESUME or BUSY byte followed by a string
+@param reader reader of the response fifo
+@param text stores the string of the message, if there is one
+@return the type of the message, DISCARD if the server closed the fifo
+*/
+char read_message(Reader *reader, char *text) {
+    char type, c;
+    int i = 0;
+
+    if (read_byte(reader, &type)) { return DISCARD; }
+    if (type != QUESTION && type != ANSWER && type != CLUE && type != LEADERBOARD && type != WINNER && type != RESUME && type != BUSY) { return type; }
+
+    do {
+        if (read_byte(reader, &c)) { return DISCARD; }
+        if (i < BUF_PRS_SIZE - 1) { text[i++] = c; } /* longer strings are cut */
+    } while (c != '\0');
+    text[i] = '\0';
+
+    return type;
+}
+
+
 /*
 evaluates the user's answer
 @param points total of points
 @param request_fifo_fd file descriptor of the request fifo
-@param response_fifo_fd file descriptor of the response fifo
-@param request should be ANSWER
+@param reply reply of the server: ANSWER, or TIMEOUT if the time of the question ran out
 @param question_status status of the question retrieved from the server
 @param user_buf buffer that has the user's answer
 @param server_buf buffer that has the server's answer
 @return 0 if the answer was correct and it wasn't the last question OR if the answer's incorrect and it was not the last question and did not cause the score to be negative
 @return 1 if the answer was incorrect and the score became negative OR it was the last question
 */
-int evaluate_answer(int *points, int request_fifo_fd, int response_fifo_fd, char request, char question_status, char *user_buf, char *server_buf) {
-    
-    write(request_fifo_fd, &request, 1); /* the client requests the answer */
-    read(response_fifo_fd, server_buf, BUF_PRS_SIZE); /* the client reads the answer and stores it */
+int evaluate_answer(int *points, int request_fifo_fd, char reply, char question_status, char *user_buf, char *server_buf) {
+    char request = EXIT;
 
-    if (compare(server_buf, user_buf) == 0) { /* if the user's answer is the same as the server's answer */
+    if (reply == TIMEOUT) { /* the 15 seconds of the question ran out before the answer */
+        printf(TIMES_UP);
+        (*points)--;
+    }
+    else if (compare(server_buf, user_buf) == 0) { /* if the user's answer is the same as the server's answer */
         printf(CORRECT);
         (*points)++;
     }
     else { 
         printf(INCORRECT);
         (*points)--;
-        if ((*points) == -1) { /* if we reach a negative score */
-            printf(LOSE);
-            request = EXIT;
-            write(request_fifo_fd, &request, 1); /* the client "requests" its termination */
-            return 1;
-        }
+    }
+    if ((*points) == -1) { /* if we reach a negative score */
+        printf(LOSE);
+        write(request_fifo_fd, &request, 1); /* the client "requests" its termination */
+        return 1;
     }
     if (question_status == LAST_QUESTION) { /* if this is the last question and the user "survived" */
-        request = EXIT;
         write(request_fifo_fd, &request, 1); /* the client "requests" its termination */
         printf(WIN);
         return 1;
@@ -265,142 +348,315 @@ int evaluate_answer(int *points, int request_fifo_fd, int response_fifo_fd, char
 
 
 /*
-responsible for the entire trivia quiz game
+writes a request followed by a string, such as the answer of the user, in a single write so it is never split
+@param request_fifo_fd file descriptor of the request fifo
+@param request the request
+@param text the string
+*/
+void write_text(int request_fifo_fd, char request, char *text) {
+    char buf[BUF_ANS_SIZE + 1];
+    int len = strlen(text);
+
+    buf[0] = request;
+    memcpy(buf + 1, text, len + 1); /* the null terminator ends the string */
+    write(request_fifo_fd, buf, len + 2);
+}
+
+
+/*
+prints the prompt, if the user can answer
+@param state state of the game
+*/
+void prompt(int state) {
+    if (state == PLAYING) {
+        printf("> ");
+        fflush(stdout);
+    }
+}
+
+
+/*
+responsible for the entire trivia quiz game, a single loop waits on the user and on the server at the same time,
+so whatever the server pushes (timeouts, termination) is handled at once, even while the user is typing.
+a game played alone gets a resume token, printed so the game can go on with -k if the client or the server stops
 @param request_fifo_fd file descriptor of the request fifo
 @param response_fifo_fd file descriptor of the response fifo
+@param room room to play in with other players, NULL to play alone
+@param resume resume token of a game to go on with, NULL to start a new one
+@return 0 once the game is over, the milliseconds to wait before registering again if the server was too busy to admit the client
 */
-void game(int request_fifo_fd, int response_fifo_fd) {
-    char request, question_status, user_buf[BUF_ANS_SIZE], server_buf[BUF_PRS_SIZE];
-    int answered, points = 2;
+int game(int request_fifo_fd, int response_fifo_fd, char *room, char *resume) {
+    char request, type, question_status = PROCEED, user_buf[BUF_ANS_SIZE], server_buf[BUF_PRS_SIZE], name[BUF_NAME_SIZE], token[BUF_TOKEN_SIZE] = "";
+    int buffered, state = WAIT_STATUS, points = 2, resuming = 0;
+    struct pollfd fds[2];
+    Reader reader;
+
+    reader.fd = response_fifo_fd;
+    reader.start = reader.end = 0;
+
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = response_fifo_fd;
+    fds[1].events = POLLIN;
 
     memset(server_buf, '\0', BUF_PRS_SIZE);
+    memset(user_buf, '\0', BUF_ANS_SIZE);
     printf("\n\n");
 
+    /* the server keeps the score of the game under this name in its leaderboard */
+    snprintf(name, BUF_NAME_SIZE, "%s", getenv("USER") != NULL ? getenv("USER") : "player");
+    write_text(request_fifo_fd, PLAYER_NAME, name);
+    if (room != NULL) {
+        /* the questions of a room are sent once every player asked for them, the first one waits for the room to be full */
+        write_text(request_fifo_fd, JOIN, room);
+        printf("waiting for the other players of room %s...\n", room);
+    }
+    else {
+        /* the status of the new game is set aside until the server answers whether the game of the token goes on instead */
+        if (resume != NULL) { snprintf(token, BUF_TOKEN_SIZE, "%s", resume); }
+        resuming = token[0] != '\0';
+        write_text(request_fifo_fd, RESUME, token);
+    }
+
     while (1) {
-        answered = 0; /* variable that tells if the user has answered to the question */
-        
-        /* 1. the client starts by reading the status of the question, i.e.,
-                if we are not in the last question (PROCEED), or
-                if we are in the last question (LAST_QUESTION), or exceptionally,
-                if the server has to terminate because of SIGINT (DISCARD)
-        */
-        read(response_fifo_fd, &question_status, 1);
-
-        if (question_status == DISCARD) { return; } /* if the server has to terminate, we also terminate the client  */
-
-        request = QUESTION;
-        write(request_fifo_fd, &request, 1); /* 2. if status of question is ok, the client requests the question */
-        read(response_fifo_fd, server_buf, BUF_PRS_SIZE); /* 3. the client reads the question and stores it */
-        printf("%s\n", server_buf); /* print the question */
-
-        while (!answered) { /* while the use has not yet answered to the question */
-            printf("> ");
-            fflush(stdout);
-            switch (get_command(STDIN_FILENO, BUF_ANS_SIZE, user_buf)) { /* get user's command from stdin */
-                case CMD_EXIT:
-                    request = EXIT;
-                    write(request_fifo_fd, &request, 1); /* the client "requests" its termination */
-                    return; /* the client terminates */
-                case CMD_HELP:
-                    printf(HELP);
+        /* messages that arrived together with the previous one are already in the reader, poll() would not report them */
+        buffered = reader.start != reader.end;
+        if (!buffered && poll(fds, 2, -1) == -1) { continue; }
+
+        if (buffered || fds[1].revents) {
+            switch ((type = read_message(&reader, server_buf))) {
+                case PROCEED:
+                case LAST_QUESTION:
+                    /* 1. the server sends the status of the question, i.e.,
+                            if we are not in the last question (PROCEED), or
+                            if we are in the last question (LAST_QUESTION)
+                    */
+                    question_status = type;
+                    if (resuming) { break; }
+                    state = WAIT_QUESTION;
+                    request = QUESTION;
+                    write(request_fifo_fd, &request, 1); /* 2. if status of question is ok, the client requests the question */
                     break;
-                case CMD_POINTS:
-                    printf("you have a total of %d points\n", points);
+                case QUESTION:
+                    printf("%s\n", server_buf); /* 3. print the question */
+                    state = PLAYING;
+                    prompt(state);
                     break;
-                case CMD_CLUE:
-                    request = CLUE;
-                    write(request_fifo_fd, &request, 1); /* the client requests a clue */
-                    read(response_fifo_fd, server_buf, BUF_PRS_SIZE); /* the client reads the clue and stores it */
+                case CLUE:
                     printf("%s\n", server_buf); /* print the clue */
+                    prompt(state);
+                    break;
+                case WINNER:
+                    printf("\t\t\t%s answered first!\n", server_buf);
+                    prompt(state);
                     break;
-                case CMD_INVALID:
-                    printf("invalid command!\n");
+                case LEADERBOARD:
+                    /* one score per message, an empty message after the last one */
+                    if (server_buf[0] != '\0') { printf("\t%s\n", server_buf); }
+                    else { prompt(state); }
                     break;
-                case CMD_NOT:
-                    answered = 1;
+                case RESUME:
+                    /* the token of the game and its points, empty if there is no game to go on with */
+                    if (sscanf(server_buf, "%16s %d", token, &points) == 2) {
+                        if (resuming) { printf("the game goes on with %d points\n", points); }
+                        else { printf("resume token of this game: %s\n", token); }
+                        resuming = 0;
+                        break;
+                    }
+                    if (!resuming) { break; }
+                    printf("the game of token %s cannot be resumed, a new game starts\n", token);
+                    token[0] = '\0';
+                    resuming = 0;
+                    state = WAIT_QUESTION; /* the status set aside was the one of the new game */
+                    request = QUESTION;
+                    write(request_fifo_fd, &request, 1);
+                    break;
+                case ANSWER:
+                case TIMEOUT:
+                    /* the reply to the answer of the user or, at any moment of the question, the end of its 15 seconds */
+                    if (state != PLAYING && state != WAIT_ANSWER) { break; }
+                    if (type == TIMEOUT) { printf("\n"); }
 
                     /* if the answer was incorrect and the score became negative OR it was the last question */
-                    if (evaluate_answer(&points, request_fifo_fd, response_fifo_fd, ANSWER, question_status, user_buf, server_buf)) { return; }
-                    break;
-                default:
+                    if (evaluate_answer(&points, request_fifo_fd, type, question_status, user_buf, server_buf)) { return 0; }
+
+                    state = WAIT_STATUS;
+                    request = NEXT_QUESTION;
+                    write(request_fifo_fd, &request, 1);
                     break;
+                case DISCARD: /* the server has to terminate (SIGINT) or dropped us for being idle, or it is gone */
+                    printf("\nserver terminated\n");
+                    if (token[0]) { printf("resume the game with -k %s\n", token); }
+                    return 0;
+                case BUSY: /* the server is overloaded and gave the fifos back, the game starts over once it is time */
+                    printf("server busy, trying again in %d ms...\n", atoi(server_buf));
+                    return atoi(server_buf) > 0 ? atoi(server_buf) : 1;
             }
+            continue;
         }
 
-        request = NEXT_QUESTION;
-        write(request_fifo_fd, &request, 1);
+        if (!fds[0].revents) { continue; }
+
+        switch (get_command(STDIN_FILENO, BUF_ANS_SIZE, user_buf)) { /* get user's command from stdin */
+            case CMD_EXIT:
+                request = EXIT;
+                write(request_fifo_fd, &request, 1); /* the client "requests" its termination */
+                return 0; /* the client terminates */
+            case CMD_HELP:
+                printf(HELP);
+                break;
+            case CMD_POINTS:
+                printf("you have a total of %d points\n", points);
+                break;
+            case CMD_CLUE:
+                if (state != PLAYING) { break; }
+                request = CLUE;
+                write(request_fifo_fd, &request, 1); /* the client requests a clue, printed when it arrives */
+                continue;
+            case CMD_TOP:
+                printf("best scores:\n");
+                request = LEADERBOARD;
+                write(request_fifo_fd, &request, 1); /* printed when it arrives */
+                continue;
+            case CMD_INVALID:
+                printf("invalid command!\n");
+                break;
+            case CMD_EOC:
+                fds[0].fd = -1; /* stdin is closed, only the server is left to wait for */
+                break;
+            case CMD_NOT:
+                if (state != PLAYING) {
+                    printf("wait for the next question!\n");
+                    break;
+                }
+                state = WAIT_ANSWER;
+                /* the server grades the answer for the leaderboard, the user's answer is also evaluated here when the correct one arrives */
+                write_text(request_fifo_fd, ANSWER, user_buf);
+                break;
+            default:
+                break;
+        }
+        prompt(state);
     }
 }
 
 
 /*
-@param register_fifo_fd file descriptor of the register fifo
-@param request_fifo_fd file descriptor of the request fifo
-@param response_fifo_fd file descriptor of the response fifo
-@param request_fifo_path path of the request fifo
-@param response_fifo_path path of the response fifo
+builds the path of a fifo of the server's pool, e.g. <register-fifo>.request.3
+@param register_fifo_path path of the register fifo
+@param suffix kind of fifo
+@param slot slot of the fifo pair
+@return pointer to the path
 */
-void close_files(int register_fifo_fd, int request_fifo_fd, int response_fifo_fd, char *request_fifo_path, char *response_fifo_path) {
-    close(register_fifo_fd);
-    close(request_fifo_fd);
-    close(response_fifo_fd);
-    unlink(request_fifo_path);
-    unlink(response_fifo_path);
+char *pool_path(char *register_fifo_path, char *suffix, int slot) {
+    int len = strlen(register_fifo_path) + strlen(suffix) + 16;
+    char *path = malloc(len);
+
+    if (path != NULL) { snprintf(path, len, "%s.%s.%d", register_fifo_path, suffix, slot); }
+    return path;
 }
 
 
-int main(int argc, char **argv) {
-    char *request_fifo_path, *response_fifo_path;
-    int register_fifo_fd, request_fifo_path_len, response_fifo_path_len, request_fifo_fd, response_fifo_fd, stop = 0;
+/*
+leases a pair of fifos from the server's pool, waiting while every pair is taken
+@param register_fifo_path path of the register fifo
+@return slot of the leased pair, -1 if the server is not running
+*/
+int lease_slot(char *register_fifo_path) {
+    char *lease_fifo_path;
+    int lease_fifo_fd, len, slot = -1;
 
-    if (argc != 4) {
-        printf("usage: %s <register-fifo-path> <request-fifo-path> <response-fifo-path>\n", argv[0]);
-        return 1;
+    lease_fifo_path = concatenate(register_fifo_path, ".lease", &len);
+    lease_fifo_fd = open(lease_fifo_path, O_RDONLY | O_NONBLOCK);
+    free(lease_fifo_path);
+
+    if (lease_fifo_fd == -1) { return -1; }
+
+    if (read(lease_fifo_fd, &slot, sizeof(int)) == -1 && errno == EAGAIN) { /* no slot is free */
+        printf("server is full at the moment, please wait!\n");
+        fcntl(lease_fifo_fd, F_SETFL, 0);
+        if (read(lease_fifo_fd, &slot, sizeof(int)) != sizeof(int)) { slot = -1; }
     }
+    close(lease_fifo_fd);
+
+    return slot;
+}
+
+
+/*
+leases a pair of fifos, registers it with the server and opens it
+@param register_fifo_path path of the register fifo
+@param request_fifo_fd stores the file descriptor of the request fifo
+@param response_fifo_fd stores the file descriptor of the response fifo
+@return 0 on success, 1 otherwise
+*/
+int join_server(char *register_fifo_path, int *request_fifo_fd, int *response_fifo_fd) {
+    char *request_fifo_path, *response_fifo_path;
+    int register_fifo_fd, slot;
 
-    if ((register_fifo_fd = open(argv[1], O_WRONLY)) == -1) {
+    if ((register_fifo_fd = open(register_fifo_path, O_WRONLY)) == -1) {
         printf("failed to open server register fifo\n");
         return 1;
     }
-    
-    if (strlen(argv[2]) == 1 && *argv[2] == 'q') { /* if client is the terminator */
-        write(register_fifo_fd, &request_fifo_path_len, sizeof(int)); /* write size of request-fifo-path */
+
+    if ((slot = lease_slot(register_fifo_path)) == -1) {
+        printf("failed to lease fifos from the server\n");
         close(register_fifo_fd);
-        return 0;
+        return 1;
     }
-    
-    request_fifo_path = concatenate("../client/", argv[2], &request_fifo_path_len);
-    response_fifo_path = concatenate("../client/", argv[3], &response_fifo_path_len);
 
-    write(register_fifo_fd, &request_fifo_path_len, sizeof(int)); /* write size of request-fifo-path */
-    write(register_fifo_fd, request_fifo_path, request_fifo_path_len); /* write request-fifo-path */
+    write(register_fifo_fd, &slot, sizeof(int)); /* register with the leased slot */
+    close(register_fifo_fd);
+
+    request_fifo_path = pool_path(register_fifo_path, "request", slot);
+    response_fifo_path = pool_path(register_fifo_path, "response", slot);
 
-    write(register_fifo_fd, &response_fifo_path_len, sizeof(int)); /* write size of response-fifo-path */
-    write(register_fifo_fd, response_fifo_path, response_fifo_path_len); /* write response-fifo-path */
+    *request_fifo_fd = open(request_fifo_path, O_WRONLY);
+    *response_fifo_fd = open(response_fifo_path, O_RDONLY);
 
     free(request_fifo_path);
     free(response_fifo_path);
 
-    if (mkfifo(argv[2], 0660) != 0) {
-        printf("failed to create request fifo\n");
+    if (*request_fifo_fd == -1 || *response_fifo_fd == -1) {
+        printf("failed to open the leased fifos\n");
         return 1;
     }
+    return 0;
+}
 
-    if (mkfifo(argv[3], 0660) != 0) {
-        printf("failed to create response fifo\n");
-        return 1;
-    }
 
-    if ((request_fifo_fd = open(argv[2], O_WRONLY)) == -1) {
-        printf("failed to open request fifo\n");
+int main(int argc, char **argv) {
+    char *room = NULL, *resume = NULL;
+    int register_fifo_fd, slot, request_fifo_fd, response_fifo_fd, stop = 0, opt, wrong = 0, retry_ms, busy = 0;
+
+    /* -r plays in a room, with the other players who join it, -k goes on with the game of a resume token */
+    while ((opt = getopt(argc, argv, "r:k:")) != -1) {
+        if (opt == 'r') { room = optarg; }
+        else if (opt == 'k') { resume = optarg; }
+        else { wrong = 1; }
+    }
+    if (wrong || (argc - optind != 1 && argc - optind != 2)) {
+        printf("usage: %s [-r room] [-k resume-token] <register-fifo-path> [q]\n", argv[0]);
         return 1;
     }
+    argv += optind - 1; /* the fifo path is argv[1] from here on, and the terminator argv[2] */
+    argc -= optind - 1;
 
-    if ((response_fifo_fd = open(argv[3], O_RDONLY)) == -1) {
-        printf("failed to open request fifo\n");
-        return 1;
+    if (argc == 3 && strlen(argv[2]) == 1 && *argv[2] == 'q') { /* if client is the terminator */
+        if ((register_fifo_fd = open(argv[1], O_WRONLY)) == -1) {
+            printf("failed to open server register fifo\n");
+            return 1;
+        }
+        slot = TERMINATE;
+        write(register_fifo_fd, &slot, sizeof(int));
+        close(register_fifo_fd);
+        return 0;
     }
 
+    signal(SIGPIPE, SIG_IGN); /* a server that sheds the client stops reading its requests, writing them only fails */
+
+    if (join_server(argv[1], &request_fifo_fd, &response_fifo_fd)) { return 1; }
+
     printf(SCREEN_HOME);
     while (1) {
         if (stop) { break; }
@@ -409,7 +665,18 @@ int main(int argc, char **argv) {
         fflush(stdout);
         switch (get_command(STDIN_FILENO, 0, NULL)) { /* get user's command from stdin */
             case CMD_START:
-                game(request_fifo_fd, response_fifo_fd);
+                /* a client the server sheds leaves its fifos and registers again once the server says so */
+                while ((retry_ms = game(request_fifo_fd, response_fifo_fd, room, resume)) > 0) {
+                    close(request_fifo_fd);
+                    close(response_fifo_fd);
+                    request_fifo_fd = response_fifo_fd = -1;
+                    if (busy++ == BUSY_TRIES) {
+                        printf("server busy, try again later\n");
+                        break;
+                    }
+                    usleep(retry_ms * 1000);
+                    if (join_server(argv[1], &request_fifo_fd, &response_fifo_fd)) { break; }
+                }
                 stop = 1;
                 break;
             case CMD_EXIT:
@@ -426,7 +693,9 @@ int main(int argc, char **argv) {
         }
     }
 
-    close_files(register_fifo_fd, request_fifo_fd, response_fifo_fd, argv[2], argv[3]);
+    /* the fifos belong to the server, closing them gives the slot back */
+    if (request_fifo_fd != -1) { close(request_fifo_fd); }
+    if (response_fifo_fd != -1) { close(response_fifo_fd); }
 
     return 0;
-}
\ No newline at end of file
+}
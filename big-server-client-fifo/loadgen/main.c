@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+#define BUF_PRS_SIZE 84
+#define BUF_ANS_SIZE 32
+#define BUF_MSG_SIZE 256
+
+#define QUESTION 'q'
+#define ANSWER 'a'
+#define CLUE 'c'
+#define NEXT_QUESTION 'n'
+#define EXIT 'e'
+#define LAST_QUESTION 'l'
+#define PROCEED 'p'
+#define DISCARD 'd'
+#define TIMEOUT 't'
+#define PLAYER_NAME 'u'
+#define LEADERBOARD 'b'
+#define JOIN 'j'
+#define WINNER 'w'
+#define BUSY 'x'
+
+#define ROOM_SIZE 2 /* players of a room, as the server has it */
+
+#define LEASE 0 /* what is measured: time waiting for a free pair of fifos, i.e., at "server is full" */
+#define REGISTRATION 1 /* from writing the slot to the register fifo until the status of the first question arrives */
+#define KIND_QUESTION 2
+#define KIND_CLUE 3
+#define KIND_ANSWER 4
+#define KIND_NEXT 5
+#define KIND_TOP 6 /* LEADERBOARD, until the empty message after the last score */
+#define KINDS 7
+
+
+
+/* buffered reader of the response fifo, so the server messages are split correctly however read() returns them */
+typedef struct {
+    int fd, start, end;
+    char buf[BUF_MSG_SIZE];
+} Reader;
+
+
+/* measured times, in nanoseconds */
+typedef struct {
+    long long *values;
+    int count, size;
+} Latencies;
+
+
+/* a scripted player, each one runs on its own thread and plays its games one after the other */
+typedef struct {
+    unsigned int seed;
+    int id, games, questions, correct, clues, timeouts, errors, shed;
+    unsigned long *keys; /* hashes of the questions whose answer was learnt, 0 in a free slot */
+    char (*answers)[BUF_ANS_SIZE]; /* answers learnt from the server, in the slot of their question */
+    int known, size; /* questions whose answer was learnt, and slots of the table, a power of two */
+    Latencies latencies[KINDS];
+} Player;
+
+
+
+/* configuration shared by every player, set once by main() before the threads start */
+char *register_fifo_path;
+int register_fifo_fd, games_per_player = 20, think_ms = 0;
+double correct_ratio = 0.7, clue_rate = 0.2;
+int rooms = 0; /* players play in rooms of ROOM_SIZE instead of alone */
+
+
+
+/*
+current time of the monotonic clock
+@return time in nanoseconds
+*/
+long long now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/*
+compares two times, used by qsort
+*/
+int compare_latency(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/*
+records a time, the array grows as needed
+@param latencies where to record it
+@param value time in nanoseconds
+@return 0 on success, 1 on memory error
+*/
+int record(Latencies *latencies, long long value) {
+    if ((*latencies).count == (*latencies).size) {
+        int size = (*latencies).size ? 2 * (*latencies).size : 1024;
+        long long *values = realloc((*latencies).values, size * sizeof(long long));
+
+        if (values == NULL) { return 1; }
+        (*latencies).values = values;
+        (*latencies).size = size;
+    }
+    (*latencies).values[(*latencies).count++] = value;
+    return 0;
+}
+
+
+/*
+reads the next byte sent by the server
+@param reader reader of the response fifo
+@param c stores the byte read
+@return 0 on success, 1 if the server closed the fifo
+*/
+int read_byte(Reader *reader, char *c) {
+    if ((*reader).start == (*reader).end) {
+        int n = read((*reader).fd, (*reader).buf, BUF_MSG_SIZE);
+
+        if (n <= 0) { return 1; }
+        (*reader).start = 0;
+        (*reader).end = n;
+    }
+    *c = (*reader).buf[(*reader).start++];
+    return 0;
+}
+
+
+/*
+reads the next message sent by the server: either a single status byte or a QUESTION, ANSWER, CLUE, LEADERBOARD, WINNER or BUSY byte followed by a string
+@param reader reader of the response fifo
+@param text stores the string of the message, if there is one
+@return the type of the message, DISCARD if the server closed the fifo
+*/
+char read_message(Reader *reader, char *text) {
+    char type, c;
+    int i = 0;
+
+    if (read_byte(reader, &type)) { return DISCARD; }
+    if (type != QUESTION && type != ANSWER && type != CLUE && type != LEADERBOARD && type != WINNER && type != BUSY) { return type; }
+
+    do {
+        if (read_byte(reader, &c)) { return DISCARD; }
+        if (i < BUF_PRS_SIZE - 1) { text[i++] = c; }
+    } while (c != '\0');
+    text[i] = '\0';
+
+    return type;
+}
+
+
+/*
+writes a request, followed by its string if it has one, in a single write
+@param request_fifo_fd file descriptor of the request fifo
+@param request request to send
+@param arg string of the request, NULL if it has none
+@return 0 on success, 1 otherwise
+*/
+int write_request(int request_fifo_fd, char request, char *arg) {
+    char buf[BUF_ANS_SIZE + 1];
+    int len = 1;
+
+    buf[0] = request;
+    if (arg != NULL) {
+        len = strlen(arg) + 2;
+        memcpy(buf + 1, arg, len - 1);
+    }
+    return write(request_fifo_fd, buf, len) != len;
+}
+
+
+/*
+sends a request and waits for its reply, recording how long the round trip took
+@param player the player
+@param request_fifo_fd file descriptor of the request fifo
+@param reader reader of the response fifo
+@param request request to send
+@param arg string of the request, NULL if it has none
+@param kind kind of request, selects where the time is recorded
+@param text stores the string of the reply, if there is one
+@return the type of the reply
+*/
+char round_trip(Player *player, int request_fifo_fd, Reader *reader, char request, char *arg, int kind, char *text) {
+    long long start = now();
+    char reply;
+
+    if (write_request(request_fifo_fd, request, arg)) { return DISCARD; }
+    reply = read_message(reader, text);
+    /* the leaderboard is a message per score, the round trip ends with the empty message after the last one,
+       and the winner of a question of a room is announced whenever someone answers it first */
+    while ((reply == LEADERBOARD && text[0] != '\0') || reply == WINNER) { reply = read_message(reader, text); }
+    if (reply != DISCARD && reply != TIMEOUT && record(&(*player).latencies[kind], now() - start)) { return DISCARD; }
+
+    return reply;
+}
+
+
+/*
+builds the path of a fifo of the server's pool, e.g. <register-fifo>.request.3
+@param suffix kind of fifo
+@param slot slot of the fifo pair, -1 for none
+@return pointer to the path
+*/
+char *pool_path(char *suffix, int slot) {
+    int len = strlen(register_fifo_path) + strlen(suffix) + 16;
+    char *path = malloc(len);
+
+    if (path == NULL) { return NULL; }
+    if (slot == -1) { snprintf(path, len, "%s.%s", register_fifo_path, suffix); }
+    else { snprintf(path, len, "%s.%s.%d", register_fifo_path, suffix, slot); }
+    return path;
+}
+
+
+/*
+leases a pair of fifos from the server's pool, waiting while every pair is taken, and records how long it waited
+@param player the player
+@return slot of the leased pair, -1 on failure
+*/
+int lease_slot(Player *player) {
+    char *lease_fifo_path = pool_path("lease", -1);
+    int lease_fifo_fd, slot = -1;
+    long long start = now();
+
+    if (lease_fifo_path == NULL) { return -1; }
+    lease_fifo_fd = open(lease_fifo_path, O_RDONLY | O_NONBLOCK);
+    free(lease_fifo_path);
+    if (lease_fifo_fd == -1) { return -1; }
+
+    fcntl(lease_fifo_fd, F_SETFL, 0); /* only opened non-blocking so that open() would not wait, the read has to wait */
+    if (read(lease_fifo_fd, &slot, sizeof(int)) != sizeof(int)) { slot = -1; }
+    close(lease_fifo_fd);
+
+    if (slot != -1 && record(&(*player).latencies[LEASE], now() - start)) { slot = -1; }
+    return slot;
+}
+
+
+/*
+hash of the text of a question (FNV-1a), the key its answer is learnt under.
+the server may ask the questions of a game in any order (-a), so the answers cannot be learnt by position
+@param question text of the question
+@return the hash, never 0
+*/
+unsigned long question_key(char *question) {
+    unsigned long key = 14695981039346656037UL;
+
+    for (; *question; question++) { key = (key ^ (unsigned char)*question) * 1099511628211UL; }
+    return key ? key : 1;
+}
+
+
+/*
+finds the slot of a question in the table of learnt answers, open addressing with linear probing
+@param player the player
+@param key hash of the question
+@return the slot of the question, or the free slot where it goes
+*/
+int answer_slot(Player *player, unsigned long key) {
+    int i = key & ((*player).size - 1);
+
+    while ((*player).keys[i] != 0 && (*player).keys[i] != key) { i = (i + 1) & ((*player).size - 1); }
+    return i;
+}
+
+
+/*
+answer learnt for a question
+@param player the player
+@param key hash of the question
+@return the answer, NULL if it was not learnt yet
+*/
+char *recall(Player *player, unsigned long key) {
+    int i;
+
+    if ((*player).size == 0) { return NULL; }
+    i = answer_slot(player, key);
+    return (*player).keys[i] == key ? (*player).answers[i] : NULL;
+}
+
+
+/*
+learns the answer of a question, the table doubles when it is half full
+@param player the player
+@param key hash of the question
+@param answer answer sent by the server
+@return 0 on success, 1 on memory error
+*/
+int learn(Player *player, unsigned long key, char *answer) {
+    int i, j, size, old = (*player).size;
+    unsigned long *keys = (*player).keys;
+    char (*answers)[BUF_ANS_SIZE] = (*player).answers;
+
+    if (recall(player, key) != NULL) { return 0; }
+    if (2 * ((*player).known + 1) > old) {
+        size = old ? 2 * old : 64;
+        (*player).keys = calloc(size, sizeof(unsigned long));
+        (*player).answers = malloc(size * BUF_ANS_SIZE);
+        if ((*player).keys == NULL || (*player).answers == NULL) {
+            free((*player).keys);
+            free((*player).answers);
+            (*player).keys = keys;
+            (*player).answers = answers;
+            return 1;
+        }
+        (*player).size = size;
+        for (i = 0; i < old; i++) {
+            if (keys[i] == 0) { continue; }
+            j = answer_slot(player, keys[i]);
+            (*player).keys[j] = keys[i];
+            memcpy((*player).answers[j], answers[i], BUF_ANS_SIZE);
+        }
+        free(keys);
+        free(answers);
+    }
+    i = answer_slot(player, key);
+    (*player).keys[i] = key;
+    snprintf((*player).answers[i], BUF_ANS_SIZE, "%s", answer);
+    (*player).known++;
+    return 0;
+}
+
+
+/*
+plays one game the way the client does. the server grades the answers, so the player sends the answers
+it learnt from the server in earlier games, the right one with probability correct_ratio once it is known
+@param player the player
+@return 0 if the game was played to its end, 1 if it failed or the server dropped the player
+*/
+int play(Player *player) {
+    char *request_fifo_path, *response_fifo_path, status, reply, name[BUF_ANS_SIZE], *answer, *learnt, text[BUF_PRS_SIZE];
+    int slot, request_fifo_fd, points = 2, over = 0, right;
+    unsigned long key;
+    long long start;
+    Reader reader;
+    struct timespec think, retry;
+
+    think.tv_sec = think_ms / 1000;
+    think.tv_nsec = (think_ms % 1000) * 1000000L;
+
+    /* a player the server sheds gives the pair back and registers again after the time the server asks for */
+    for (status = BUSY; status == BUSY; ) {
+        if ((slot = lease_slot(player)) == -1) { return 1; }
+
+        start = now();
+        write(register_fifo_fd, &slot, sizeof(int)); /* register with the leased slot */
+
+        request_fifo_path = pool_path("request", slot);
+        response_fifo_path = pool_path("response", slot);
+        if (request_fifo_path == NULL || response_fifo_path == NULL) {
+            free(request_fifo_path);
+            free(response_fifo_path);
+            return 1;
+        }
+
+        request_fifo_fd = open(request_fifo_path, O_WRONLY); /* same order as the worker, which opens the request fifo first */
+        reader.fd = open(response_fifo_path, O_RDONLY);
+        reader.start = reader.end = 0;
+        free(request_fifo_path);
+        free(response_fifo_path);
+
+        if (request_fifo_fd == -1 || reader.fd == -1) { return 1; }
+
+        sprintf(name, "load%d", (*player).id);
+        write_request(request_fifo_fd, PLAYER_NAME, name);
+        sprintf(name, "room%d", (*player).id / ROOM_SIZE); /* the same players meet in the same room every game */
+        if (rooms) { write_request(request_fifo_fd, JOIN, name); }
+        status = read_message(&reader, text); /* the status of the first question ends the registration */
+        if (status == BUSY) {
+            (*player).shed++;
+            close(request_fifo_fd);
+            close(reader.fd);
+            retry.tv_sec = atoi(text) / 1000;
+            retry.tv_nsec = (atoi(text) % 1000) * 1000000L;
+            nanosleep(&retry, NULL);
+        }
+        else if (status != DISCARD && record(&(*player).latencies[REGISTRATION], now() - start)) { status = DISCARD; }
+    }
+
+    while (status == PROCEED || status == LAST_QUESTION) {
+        (*player).questions++;
+        if (round_trip(player, request_fifo_fd, &reader, QUESTION, NULL, KIND_QUESTION, text) != QUESTION) { break; }
+        key = question_key(text);
+
+        reply = 0;
+        if (rand_r(&(*player).seed) < clue_rate * RAND_MAX) {
+            (*player).clues++;
+            if ((reply = round_trip(player, request_fifo_fd, &reader, CLUE, NULL, KIND_CLUE, text)) == CLUE) { reply = 0; }
+        }
+        if (!reply && think_ms) { nanosleep(&think, NULL); }
+
+        learnt = recall(player, key);
+        right = learnt != NULL && rand_r(&(*player).seed) < correct_ratio * RAND_MAX;
+        answer = right ? learnt : "-"; /* no answer is a dash */
+        if (!reply) { reply = round_trip(player, request_fifo_fd, &reader, ANSWER, answer, KIND_ANSWER, text); }
+
+        if (reply == TIMEOUT) {
+            (*player).timeouts++;
+            points--;
+        }
+        else if (reply != ANSWER || learn(player, key, text)) { break; }
+        else if (!right) { points--; }
+        else {
+            (*player).correct++;
+            points++;
+        }
+
+        if (points < 0 || status == LAST_QUESTION) {
+            /* the leaderboard is asked for at the end of every game, as a player would */
+            if (round_trip(player, request_fifo_fd, &reader, LEADERBOARD, NULL, KIND_TOP, text) != LEADERBOARD) { break; }
+            write_request(request_fifo_fd, EXIT, NULL); /* the player "requests" its termination */
+            over = 1;
+            break;
+        }
+        status = round_trip(player, request_fifo_fd, &reader, NEXT_QUESTION, NULL, KIND_NEXT, text);
+    }
+
+    close(request_fifo_fd);
+    close(reader.fd);
+    if (over) { (*player).games++; }
+    return !over;
+}
+
+
+/*
+thread of a player
+@param arg the player
+*/
+void *run_player(void *arg) {
+    Player *player = (Player *)arg;
+    int i;
+
+    for (i = 0; i < games_per_player; i++) {
+        if (play(player)) { (*player).errors++; }
+    }
+    free((*player).keys);
+    free((*player).answers);
+    return NULL;
+}
+
+
+/*
+prints the percentiles of a set of times
+@param name name of the row
+@param latencies the times
+*/
+void report(char *name, Latencies *latencies) {
+    int n = (*latencies).count;
+
+    if (n == 0) {
+        printf("%-13s %10d\n", name, 0);
+        return;
+    }
+    qsort((*latencies).values, n, sizeof(long long), compare_latency);
+    printf("%-13s %10d %10.2f %10.2f %10.2f %10.2f\n", name, n,
+           (*latencies).values[n / 2] / 1000.0, (*latencies).values[(long long)n * 99 / 100] / 1000.0,
+           (*latencies).values[(long long)n * 999 / 1000] / 1000.0, (*latencies).values[n - 1] / 1000.0);
+}
+
+
+int main(int argc, char **argv) {
+    char *names[] = { "lease wait", "registration", "question", "clue", "answer", "next", "top" };
+    int i, j, k, opt, players = 8, questions;
+    long long elapsed;
+    pthread_t *threads;
+    Player *all;
+
+    while ((opt = getopt(argc, argv, "n:g:t:r:c:m")) != -1) {
+        switch (opt) {
+            case 'n': players = atoi(optarg); break;
+            case 'g': games_per_player = atoi(optarg); break;
+            case 't': think_ms = atoi(optarg); break;
+            case 'r': correct_ratio = atof(optarg); break;
+            case 'c': clue_rate = atof(optarg); break;
+            case 'm': rooms = 1; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc - 1 || players < 1 || games_per_player < 1 || think_ms < 0) {
+        printf("usage: %s [-n players] [-g games-per-player] [-t think-ms] [-r correct-ratio] [-c clue-rate] [-m] <register-fifo-path>\n", argv[0]);
+        return 1;
+    }
+    if (rooms && players % ROOM_SIZE) { /* a room that is not full waits for players before it starts */
+        printf("players must be a multiple of %d to play in rooms\n", ROOM_SIZE);
+        return 1;
+    }
+    register_fifo_path = argv[optind];
+
+    if ((register_fifo_fd = open(register_fifo_path, O_WRONLY)) == -1) {
+        printf("failed to open server register fifo\n");
+        return 1;
+    }
+
+    threads = malloc(players * sizeof(pthread_t));
+    all = calloc(players, sizeof(Player));
+    if (threads == NULL || all == NULL) {
+        printf("memory error\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%d players x %d games on %s, think %d ms, correct %.2f, clues %.2f\n\n", players, games_per_player,
+           register_fifo_path, think_ms, correct_ratio, clue_rate);
+
+    elapsed = now();
+    for (i = 0; i < players; i++) {
+        all[i].seed = (unsigned int)time(NULL) ^ (i * 2654435761u);
+        all[i].id = i;
+        if (pthread_create(&threads[i], NULL, run_player, &all[i]) != 0) {
+            printf("failed to create player %d\n", i);
+            players = i;
+            break;
+        }
+    }
+    for (i = 0; i < players; i++) { pthread_join(threads[i], NULL); }
+    elapsed = now() - elapsed;
+    close(register_fifo_fd);
+
+    /* the times of every player are merged into the first one */
+    for (i = 1; i < players; i++) {
+        all[0].games += all[i].games;
+        all[0].questions += all[i].questions;
+        all[0].correct += all[i].correct;
+        all[0].clues += all[i].clues;
+        all[0].timeouts += all[i].timeouts;
+        all[0].errors += all[i].errors;
+        all[0].shed += all[i].shed;
+        for (k = 0; k < KINDS; k++) {
+            for (j = 0; j < all[i].latencies[k].count; j++) {
+                if (record(&all[0].latencies[k], all[i].latencies[k].values[j])) {
+                    printf("memory error\n");
+                    return 1;
+                }
+            }
+            free(all[i].latencies[k].values);
+        }
+    }
+    questions = all[0].latencies[KIND_QUESTION].count;
+
+    printf("games %d, questions %d, correct %d, clues %d, timeouts %d, failed %d, shed %d\n", all[0].games, all[0].questions,
+           all[0].correct, all[0].clues, all[0].timeouts, all[0].errors, all[0].shed);
+    printf("%.2f s: %.0f games/s, %.0f questions/s\n\n", elapsed / 1e9, all[0].games / (elapsed / 1e9), questions / (elapsed / 1e9));
+
+    printf("%-13s %10s %10s %10s %10s %10s\n", "", "count", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+    for (k = 0; k < KINDS; k++) {
+        report(names[k], &all[0].latencies[k]);
+        free(all[0].latencies[k].values);
+    }
+
+    free(threads);
+    free(all);
+    return 0;
+}
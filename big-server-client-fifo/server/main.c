@@ -1,218 +1,3321 @@
 #include <stdio.h>
-#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+#include <stddef.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/ioctl.h>
+#include <poll.h>
 #include <pthread.h>
 
-#define DATABASE_PATH "../database/super-secret.db"
+#define DATABASE_PATH "../database/super-secret.db"
+
+#define MAX_CLIENTS 2
+#define POOL_SIZE (2 * MAX_CLIENTS) /* fifo pairs: one per client being served plus one per client waiting in the buffer */
+
+#define TERMINATE -1 /* registered instead of a slot by the client that terminates the server */
+
+#define TICK_MS 100 /* resolution of the timer wheel */
+#define ADMISSION_RETRY_MS 1000 /* a shed client is told to try again after this long, plus as much again at random so the retries spread */
+#define QUESTION_TIMEOUT_MS 15000 /* each question has a timer of 15 seconds */
+#define IDLE_TIMEOUT_MS 120000 /* a client that sends nothing for this long is disconnected */
+#define HOLD_TIMEOUT_MS 10000 /* a slot whose client has not hung up after this long gets new fifos, the client was killed or is stuck */
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4 /* 64^4 ticks of 100ms, about 19 days */
+
+#define BUF_PRS_SIZE 72
+#define BUF_ANS_SIZE 32
+#define BUF_NAME_SIZE 16
+#define BUF_REQ_SIZE 64
+#define BUF_STATS_SIZE 4096
+#define BUF_JOURNAL_SIZE 65536 /* initial size of the journal buffers, they grow while the disk falls behind */
+#define BUF_RECORD_SIZE 96
+
+#define LAST_QUESTION 'l'
+#define NEXT_QUESTION 'n'
+#define QUESTION 'q'
+#define PROCEED 'p'
+#define DISCARD 'd'
+#define ANSWER 'a'
+#define CLUE 'c'
+#define EXIT 'e'
+#define TIMEOUT 't'
+#define PLAYER_NAME 'u' /* followed by the name of the player, as the answer is followed by the answer of the player */
+#define LEADERBOARD 'b' /* answered with one frame per score of the leaderboard, and an empty frame after the last one */
+#define JOIN 'j' /* followed by the name of a room, the player plays its questions with the other members */
+#define WINNER 'w' /* followed by the name of the member of the room who answered the question right first */
+#define RESUME 'r' /* followed by a resume token to take up its game, or by an empty string to get a token for this one. answered with a RESUME frame
+                      of the token and the points, empty if there is no game to resume, then the status of the resumed question */
+#define BUSY 'x' /* sent instead of the first status when the server sheds the client, followed by the milliseconds to wait before trying again */
+
+#define TIMER_DEADLINE 0
+#define TIMER_IDLE 1
+
+#define STATUS_RUNNING 0
+#define STATUS_DRAINING 1 /* terminating: the client threads discard the clients they have left and return */
+#define STATUS_STOPPED 2 /* every client thread returned */
+
+#define LATENCY_BUCKETS 24 /* bucket i counts requests served in at most 2^i microseconds (and more than 2^(i-1)), the last one counts the rest */
+#define METRIC_SLOTS (MAX_CLIENTS + 2) /* one per client thread, plus one for the registration thread and one for the timer thread */
+#define SLOT_REGISTRATION MAX_CLIENTS
+#define SLOT_TIMERS (MAX_CLIENTS + 1)
+
+#define LOG_RING_SIZE 256 /* messages a thread can have waiting for the log writer, a power of 2 */
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_MSG_SIZE 112
+#define LOG_RATE 200 /* messages a thread may log per second, the rest are counted and dropped, errors are never dropped */
+#define LOG_FLUSH_MS 10 /* the writer sleeps this long when every ring is empty */
+#define BUF_LOG_SIZE 16384
+
+#define HDR_SUB_BITS 4 /* a bucket per value below HDR_SUB, then HDR_SUB / 2 = 8 per power of 2: a value is kept within 1/8 of itself */
+#define HDR_SUB (1 << HDR_SUB_BITS)
+#define HDR_BUCKETS 256 /* up to 2^34 microseconds, about 4 hours, larger values are counted in the last bucket */
+#define BUF_DUMP_SIZE 16384
+
+#define REQUEST_KINDS 9 /* QUESTION, ANSWER, CLUE, NEXT_QUESTION, EXIT, PLAYER_NAME, LEADERBOARD, JOIN and RESUME, in this order */
+
+#define START_POINTS 2 /* points of a player when the game starts */
+#define TOP_K 10 /* scores kept in a leaderboard */
+#define BUF_TOP_SIZE (TOP_K * (BUF_NAME_SIZE + 24) + 2)
+
+#define ROOM_SIZE MAX_CLIENTS /* players of a room, every member holds a thread while it plays */
+#define ROOM_WAIT_MS 10000 /* a room that is not full starts this long after it was created, with the players it has */
+
+#define ROOM_IDLE 0 /* the member has not asked for a question yet */
+#define ROOM_WAITING 1 /* the member asked for the current question and waits for the others */
+#define ROOM_PLAYING 2 /* the question was released to the member, until it asks for the next one */
+
+#define DIFFICULTY_BUCKETS 32 /* with -a, questions are drawn by bucket of difficulty, then uniformly within their bucket */
+#define LEVELS 4 /* levels of the players, each level draws questions around a difficulty of its own */
+#define START_LEVEL 1
+#define GAME_QUESTIONS 10 /* questions of a game whose questions are drawn by difficulty */
+#define DRAW_TRIES 8 /* draws of a question the game already had before looking for one it did not */
+#define EXPLORE 0.05 /* weight of a bucket at any level, so no question stops being drawn and its difficulty stays current */
+
+#define REVIEWS_MAGIC "QZREV001" /* first bytes of the review store, followed by its records */
+#define REVIEW_PLAYERS 1024 /* initial buckets of the table of players of the review store, it doubles with the players */
+#define REVIEW_ITEMS 16 /* initial items of a player, they double */
+#define REVIEW_RETRY_S 60 /* a question failed is due again a minute later */
+#define REVIEW_FIRST_S 600 /* a question answered right is due again 10 minutes later, then an hour later, then ease times later */
+#define REVIEW_SECOND_S 3600
+#define REVIEW_MAX_S 31536000 /* intervals stop growing at a year */
+#define EASE_START 250 /* ease of a new item, in hundredths: its interval grows 2.5 times with every right answer */
+#define EASE_MIN 130
+#define EASE_MAX 350
+#define EASE_RIGHT 10 /* a right answer makes a question easier to the player by this much, a failed one harder by EASE_WRONG */
+#define EASE_WRONG 20
+
+#define SNAPSHOTS_MAGIC "QZSNAP01" /* first bytes of the file of the snapshots, with -s */
+#define SNAPSHOT_SLOTS 65536 /* games that can be put aside at once, a power of two */
+#define SNAPSHOT_PROBES 16 /* slots a token can be kept in, from the slot its low bits select on */
+#define SNAPSHOT_TTL_S 3600 /* a game not resumed within an hour of its last save gives its slot away */
+#define BUF_TOKEN_SIZE 48
+
+#define TRACE_EVENTS 262144 /* spans a thread keeps when tracing, later ones are counted and dropped */
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+
+/* each thread only adds to its own slot, the stats thread sums the slots when asked: no lock, no shared cache line */
+#define METRIC_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#define METRIC_GET(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+#define TO_INT(c) ((c) - '0')
+
+int quit = 0;
+
+
+/*
+HDR-style histogram of times in microseconds: buckets are linear up to HDR_SUB and then 8 per power of 2,
+so the relative error is the same for every value, and two histograms merge by adding their counts
+*/
+typedef struct {
+    unsigned long counts[HDR_BUCKETS];
+    unsigned long count, sum_us;
+} Histogram;
+
+/* what the players did with a question, its difficulty is computed from it. counted with atomics by every thread */
+typedef struct {
+    unsigned int served, answered, correct, clues; /* sessions it was sent to, answers and timeouts, right answers, clue requests */
+    unsigned long latency_ms; /* sum of the time taken to answer, a timeout counts as the whole time */
+} QuestionStats;
+
+/* the question, answer and clue as the frames sent to the clients: the type byte, then the string and its null terminator, all of them back to back in the bank */
+typedef struct {
+    char *question, *answer, *clue;
+    int question_length, answer_length, clue_length; /* lengths of the frames */
+    Histogram *answer_time; /* time players took to answer it, allocated on its first answer and shared by every thread */
+    QuestionStats stats;
+    double difficulty; /* from 0, always answered right at once, to 1, under the lock of the selector */
+    int bucket, slot; /* bucket of its difficulty, and its index in the questions of the selector, under the lock of the selector */
+    int index; /* index in the list of the bank, the review state of the players refers to it */
+} Question;
+
+typedef struct QuestionNode {
+    Question *question;
+    struct QuestionNode *next;
+} QuestionNode;
+
+/* a registration waiting in the buffer, kept in the buffer itself so registering allocates nothing */
+typedef struct {
+    int id, slot;
+    long registered; /* when the client entered the buffer, for the trace and the admission control */
+} Client;
+
+/* a timer linked into one slot of the timer wheel, embedded in the structure it belongs to */
+typedef struct Timer {
+    struct Timer *next, *prev;
+    unsigned long expires; /* tick at which the timer fires */
+    int kind; /* TIMER_DEADLINE or TIMER_IDLE */
+} Timer;
+
+/*
+hierarchical timer wheel: level 0 has one slot per tick, every level above has slots 64 times coarser,
+timers are re-inserted into a finer level when the wheel reaches their coarse slot, so arming and cancelling are O(1)
+*/
+typedef struct {
+    unsigned long now; /* current tick */
+    Timer slots[WHEEL_LEVELS][WHEEL_SLOTS]; /* heads of circular lists */
+} TimerWheel;
+
+/* counters of one thread, aligned to a cache line so the threads never write to the same line */
+typedef struct {
+    unsigned long questions, answers, clues, timeouts; /* requests served and verdicts sent */
+    unsigned long sessions_opened, sessions_closed, registrations;
+    unsigned long shed_full, shed_lag; /* registrations shed because the buffer was as deep as allowed, or its first client had waited too long */
+    unsigned long bytes_in, bytes_out;
+    unsigned long latency[LATENCY_BUCKETS], latency_sum_us; /* time from reading a request to having responded to it */
+    Histogram service[REQUEST_KINDS]; /* the same time per kind of request */
+} __attribute__((aligned(64))) Metrics;
+
+/* a message waiting in a log ring, formatted by the thread that logged it */
+typedef struct {
+    long time; /* nanoseconds of the realtime clock */
+    int level;
+    char text[LOG_MSG_SIZE];
+} LogEntry;
+
+/*
+single-producer single-consumer ring of one thread: only the thread moves head and only the log writer moves tail,
+so neither ever waits for the other, a full ring drops the message
+*/
+typedef struct {
+    unsigned long head __attribute__((aligned(64))); /* next entry the thread writes */
+    unsigned long tail __attribute__((aligned(64))); /* next entry the writer reads */
+    unsigned long dropped, limited; /* messages lost to a full ring or to the rate limit, read by the writer */
+    unsigned long reported_dropped, reported_limited; /* owned by the writer */
+    long window; /* second of the rate limit window, owned by the thread */
+    int window_count;
+    LogEntry entries[LOG_RING_SIZE];
+} LogRing;
+
+/* a span of time spent on a client, one complete event of the Chrome trace format */
+typedef struct {
+    char *name; /* a string literal */
+    long start, end; /* monotonic clock, in nanoseconds */
+    int slot; /* fifo slot of the client, spans are grouped by it */
+} TraceEvent;
+
+/* spans recorded by one thread, only that thread writes them and count is published with release so they can be dumped while it runs */
+typedef struct {
+    TraceEvent *events;
+    long count, dropped;
+} __attribute__((aligned(64))) TraceBuffer;
+
+/* spans of every thread, recorded only when QUIZIA_TRACE names a file, they are written there as Chrome trace-event JSON on shutdown */
+typedef struct {
+    char *path;
+    TraceBuffer *buffers; /* METRIC_SLOTS buffers, indexed like the slots of the metrics */
+} Tracer;
+
+/* a score of a leaderboard: the best score a game reached */
+typedef struct {
+    char name[BUF_NAME_SIZE];
+    int score;
+    unsigned long game; /* number of the session, unique across the threads, a game is in a leaderboard once */
+} Score;
+
+/*
+the TOP_K best scores of the games a thread served, best first, aligned to a cache line like the metrics:
+only that thread writes it, under a seqlock, so the other threads copy it without a lock and never make it wait
+*/
+typedef struct {
+    unsigned long seq; /* odd while the thread is writing */
+    int count;
+    Score scores[TOP_K];
+} __attribute__((aligned(64))) Leaderboard;
+
+/* rings of every thread and the thread that writes them out */
+typedef struct {
+    LogRing *rings; /* METRIC_SLOTS rings, indexed like the slots of the metrics */
+    int level; /* messages below this level are not logged */
+    int stop;
+    pthread_t writer;
+} Logger;
+
+/*
+append-only journal of the games played: the client threads append their records to a buffer in memory,
+a writer thread takes the whole buffer at once, writes it and makes it durable with a single fdatasync() (group commit)
+*/
+typedef struct {
+    char *path;
+    int fd, stop;
+    char *pending, *committing; /* the client threads append to pending while the writer writes committing, they are swapped under mtx */
+    long pending_len, pending_size, committing_size;
+    unsigned long pending_records;
+    unsigned long records, commits, failed; /* records made durable, fdatasync() calls, and records lost to a failed write */
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    pthread_t writer;
+} Journal;
+
+/*
+state of the client a thread is serving, shared with the timer thread:
+responses are written holding write_mtx so a TIMEOUT verdict never lands in the middle of them
+*/
+typedef struct Session {
+    int request_fifo_fd, response_fifo_fd;
+    char *request_fifo_path;
+    int timed_out; /* the deadline of the current question has passed, requests for it are ignored */
+    pthread_mutex_t write_mtx;
+    Timer deadline, idle;
+    Metrics *metrics; /* slot of the thread serving the session */
+    Leaderboard *board; /* leaderboard of the thread serving the session */
+    int slot; /* fifo slot of the client */
+    long question_sent; /* when the current question was first sent, 0 until then and once it is answered */
+    char name[BUF_NAME_SIZE];
+    int points, best; /* the server grades the answers, so the score of a game is kept here and not only by the client */
+    unsigned long game;
+    long opened; /* when the session was opened, for the journal */
+    int answered; /* questions graded */
+    char requests[BUF_REQ_SIZE]; /* requests read from the fifo and not handled yet */
+    int requests_start, requests_end;
+    struct Room *room; /* room the player joined, NULL when playing alone */
+    int room_state; /* ROOM_IDLE, ROOM_WAITING or ROOM_PLAYING, under the lock of the room */
+    int adaptive; /* the questions are drawn by difficulty, see Selector */
+    int position; /* index of the current question in the game */
+    int level; /* level of the player, from 0 to LEVELS - 1, up with every right answer and down with every failed one */
+    unsigned long seed; /* random state of the draws */
+    struct QuestionNode *played[GAME_QUESTIONS]; /* questions of the game so far, it has each question once */
+    struct ReviewPlayer *reviews; /* review state of the player, once it sent its name in a game drawn by difficulty */
+    int clues; /* clues asked in the game */
+    int snapshot; /* slot of the game in the snapshots, -1 when it has no resume token */
+    unsigned long token;
+    int finished; /* the game ended, its snapshot is dropped with the session */
+} Session;
+
+/*
+players who play the same questions at the same time: each member is served by its own thread, which waits on cond
+until every member asked for the question, and the first right answer wins the question, announced to all of them.
+every room has a member holding a thread, so there are never more than MAX_CLIENTS and they are taken from room_pool
+*/
+typedef struct Room {
+    char name[BUF_NAME_SIZE];
+    Session *members[ROOM_SIZE];
+    int count, ready; /* members, and members waiting for the current question */
+    int round; /* questions released so far, players join only before the first one */
+    long created;
+    Session *winner; /* first member to answer the question right, set with a compare-and-swap so answers never take the lock */
+    pthread_mutex_t mtx; /* mtx and cond are initialized once, a room taken from the pool is reset up to them */
+    pthread_cond_t cond;
+    struct Room *next; /* next open room, or next free room of the pool */
+} Room;
+
+/*
+draws the questions of a game by difficulty in O(1): the questions are kept in an array grouped by bucket of difficulty,
+the alias table of the level of the player picks a bucket, weighted by its questions and how close it is to the level,
+then a question of the bucket is picked uniformly. a question whose difficulty drifts into another bucket moves there
+by a swap at each bucket boundary it crosses, and only the alias tables, one entry per bucket, are rebuilt.
+shared by the threads under selector_mtx, held for a draw or a move, never for a write to a client
+*/
+typedef struct {
+    QuestionNode **order; /* bucket b is order[start[b]] to order[start[b + 1] - 1], NULL when questions are sent in the order of the bank */
+    int count; /* questions */
+    int start[DIFFICULTY_BUCKETS + 1];
+    double prob[LEVELS][DIFFICULTY_BUCKETS]; /* chance of keeping the column drawn rather than taking its alias */
+    int alias[LEVELS][DIFFICULTY_BUCKETS];
+    int dirty; /* buckets changed since the alias tables were built */
+    unsigned long moves, rebuilds;
+} Selector;
+
+/*
+review state of a question for a player (SM-2): answered right, it is due again after an interval that grows by its ease,
+failed, it is due again soon and its ease drops
+*/
+typedef struct {
+    int question; /* index of the question in the bank */
+    unsigned int due; /* seconds since the epoch */
+    unsigned int interval; /* seconds */
+    unsigned short ease; /* hundredths */
+    unsigned short streak; /* right answers in a row */
+} Review;
+
+/* an entry of the index of the items of a player */
+typedef struct {
+    int question, place; /* question -1 when the entry is free */
+} ReviewPlace;
+
+/*
+review state of one player: a binary min-heap of its items by due time, so the first question due is at the top,
+and an open-addressing index from question to place in the heap, so the item of any question is found and rescheduled in O(log n)
+*/
+typedef struct ReviewPlayer {
+    char name[BUF_NAME_SIZE];
+    Review *heap;
+    ReviewPlace *index; /* 2 * size entries, a power of two */
+    int count, size;
+    struct ReviewPlayer *next; /* next player of the same bucket */
+} ReviewPlayer;
+
+/*
+a record of the review store, the state of one item of a player. the file is the records appended as items change after
+REVIEWS_MAGIC, replayed in order when the server starts and rewritten with one record per item when it terminates
+*/
+typedef struct {
+    char name[BUF_NAME_SIZE];
+    unsigned long key; /* hash of the text of the question, so the store outlives changes to the order or the size of the bank */
+    unsigned int due, interval;
+    unsigned short ease, streak;
+} ReviewRecord;
+
+/*
+every player's review state, with -a: a game serves the questions its player has due before drawing any.
+shared by the threads under reviews_mtx, every operation on it is O(log n) in the items of the player
+*/
+typedef struct {
+    char *path;
+    FILE *file; /* records are appended through its buffer, flushed when a session closes */
+    ReviewPlayer **buckets; /* NULL when there is no store, or once it is written */
+    int buckets_count, players; /* buckets is a power of two */
+    unsigned long items, served, appended; /* items of every player, reviews served, records appended since the store was written */
+} ReviewStore;
+
+/* what a game needs to go on after its client left or the server restarted, a fixed-size record per game that has a resume token */
+typedef struct {
+    unsigned long token; /* 0 when the slot is free */
+    unsigned long game; /* number of the game, it keeps it in every session so it is in a leaderboard once */
+    unsigned long owner; /* session that saves the game, a resume hands it to the new one */
+    long saved; /* seconds since the epoch */
+    char name[BUF_NAME_SIZE];
+    int question; /* index of the current question in the bank */
+    int graded; /* the current question was answered, the game goes on from the next one */
+    int position, points, best, answered, clues;
+    int adaptive, level;
+    unsigned long seed;
+    int played[GAME_QUESTIONS]; /* indices of the questions of the game so far, when drawn by difficulty */
+} Snapshot;
+
+/* first bytes of the table of snapshots */
+typedef struct {
+    char magic[sizeof(SNAPSHOTS_MAGIC) - 1];
+    int slots, questions;
+    unsigned long bank; /* hash of the texts of the questions, the snapshots of another bank are dropped */
+} SnapshotHeader;
+
+/*
+the snapshots of the games that have a resume token, SNAPSHOT_SLOTS records behind a header, open addressing on the token, shared by the threads under snapshots_mtx.
+with -s it is a file mapped into the server, so a save is a few stores to memory and the games outlive the server
+*/
+typedef struct {
+    char *path; /* NULL when the table is anonymous memory */
+    SnapshotHeader *header; /* NULL once the server terminates */
+    Snapshot *slots;
+    long size; /* bytes mapped */
+    int count; /* slots taken */
+    unsigned long issued, resumed;
+} Snapshots;
+
+/*
+fifo pairs created once by the server and leased to clients,
+the free slots are kept as ints inside the lease fifo: a client takes one by reading it and the server gives it back by writing it
+*/
+typedef struct {
+    int lease_fifo_fd;
+    char *lease_fifo_path;
+    char *request_fifo_paths[POOL_SIZE], *response_fifo_paths[POOL_SIZE];
+    int held_fds[POOL_SIZE][3]; /* fifos of a slot kept until its client hangs up: request, response read-write while a frame is unread, response write-only; -1 otherwise */
+    unsigned long held_until[POOL_SIZE]; /* tick after which a held slot is recreated instead of waited for */
+} FifoPool;
+
+/*
+admission control of the registration thread: with limits, a client that would wait too long for a thread is sent BUSY with a retry hint
+and its slot is given back instead of it waiting in the buffer, so the clients already admitted keep their latency during a spike
+*/
+typedef struct {
+    int depth; /* clients the buffer holds before registrations are shed, 0 to wait for a free place as without limits */
+    long target_ns; /* registrations are shed while the first client of the buffer has waited longer than this, 0 for no target */
+    unsigned long seed; /* random state of the retry hints, seeded per run so restarted servers spread their clients differently */
+} Admission;
+
+typedef struct {
+    int *producer_ptr, *consumer_ptr, *count, *status; /* STATUS_RUNNING, then STATUS_DRAINING and STATUS_STOPPED as the server terminates */
+    pthread_mutex_t *mtx;
+    pthread_cond_t *producer_cond;
+    pthread_cond_t *consumer_cond;
+    Client *client;
+    QuestionNode **head;
+    FifoPool *pool;
+    TimerWheel *wheel;
+    pthread_mutex_t *wheel_mtx;
+    Metrics *metrics; /* METRIC_SLOTS slots */
+    Leaderboard *boards; /* METRIC_SLOTS leaderboards, indexed like the slots of the metrics */
+    int *workers; /* client threads started so far, each one takes the next slot of metrics */
+    Session **live; /* MAX_CLIENTS sessions, the one each client thread is serving or NULL, under wheel_mtx */
+    int stats_fd;
+} ServerClient; 
+
+
+char *bank = NULL; /* the database as read, turned in place into the frames of its questions */
+QuestionNode **bank_nodes = NULL; /* questions by index, Question.index is their place, the reviews and the snapshots refer to them by it */
+int bank_count = 0;
+Logger logger;
+__thread LogRing *log_ring = NULL; /* ring of the calling thread, NULL until log_attach() */
+Tracer tracer;
+Journal journal = { NULL, -1, 0, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+__thread TraceBuffer *trace_buffer = NULL; /* buffer of the calling thread, NULL when tracing is off */
+Admission admission;
+Room *rooms = NULL;
+Room room_pool[MAX_CLIENTS];
+Room *free_rooms = NULL; /* rooms of room_pool nobody is in */
+pthread_mutex_t rooms_mtx = PTHREAD_MUTEX_INITIALIZER; /* taken to join and leave rooms and to take them from the pool, before the lock of a room */
+Selector selector;
+pthread_mutex_t selector_mtx = PTHREAD_MUTEX_INITIALIZER;
+ReviewStore reviews;
+pthread_mutex_t reviews_mtx = PTHREAD_MUTEX_INITIALIZER;
+Snapshots snapshots;
+pthread_mutex_t snapshots_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+
+void sigint_handler() { quit = 1; }
+
+void sigpipe_handler() { signal(SIGPIPE, sigpipe_handler); }
+
+
+
+/*
+frees all the memory allocated
+@param **head head of linked list
+*/
+void clear(QuestionNode **head) {
+    QuestionNode *node;
+
+    while (*head != NULL) {
+        node = *head;
+        *head = (**head).next;
+        free((*(*node).question).answer_time);
+        free((*node).question);
+        free(node);
+    }
+    free(selector.order);
+    selector.order = NULL;
+    free(bank_nodes);
+    bank_nodes = NULL;
+    free(bank);
+    bank = NULL;
+}
+
+
+/*
+parses the next line of the bank and turns it, in place, into the frame sent to the clients: its type byte, then the string and its null terminator,
+a frame is never longer than its line, so it never overwrites lines still to parse
+@param line next line of the bank, moved past it
+@param end end of the bank
+@param frame where the frame is written, moved past it
+@param type QUESTION, ANSWER or CLUE
+@param len length of the frame
+@return 0 and frame length if parsed successfully, 1 at EOF, -1 if the line is not formatted
+*/
+int parse_line(char **line, char *end, char **frame, char type, int *len) {
+    char *c = *line, *next;
+    int count = 0, bytes = 0;
+
+    for (; c < end && *c >= '0' && *c <= '9'; c++, count++) { bytes = (bytes * 10) + TO_INT(*c); }
+    if (c == end) { return 1; } /* EOF */
+    if (!count) {
+        printf("database is not formatted: line needs to start with its size\n");
+        return -1;
+    }
+    if (bytes >= BUF_PRS_SIZE) { /* the clients could not take the frame */
+        printf("database is not formatted: lines can not be longer than %d\n", BUF_PRS_SIZE - 1);
+        return -1;
+    }
+    if (end - c < bytes) {
+        printf("database is not formatted: line is shorter than its size\n");
+        return -1;
+    }
+    next = c + bytes;
+    if (next < end && *next == '\n') { next++; } /* checked before the null terminator is written over it */
+
+    (*frame)[0] = type;
+    memmove(*frame + 1, c, bytes);
+    (*frame)[bytes + 1] = '\0';
+
+    *len = bytes + 2;
+    *frame += bytes + 2;
+    *line = next;
+    return 0;
+}
+
+
+/*
+reads the whole database at once and parses it into a linked list, the frames of every question end up back to back in the bank
+@param **head head of linked list to store the questions
+@param database_path path of the database
+@return 0 if parsed successfully, 1 otherwise
+*/
+int parser(QuestionNode **head, char *database_path) {
+    int fd, status, len[3];
+    long size = 0, n = 0;
+    char *line, *end, *frame, *frames[3];
+    struct stat st;
+
+    if ((fd = open(database_path, O_RDONLY)) == -1) {
+        printf("failed to open database\n");
+        return 1;
+    }
+    if (fstat(fd, &st) == -1 || (bank = malloc(st.st_size + 1)) == NULL) {
+        printf("memory error\n");
+        close(fd);
+        return 1;
+    }
+    while (size < st.st_size && (n = read(fd, bank + size, st.st_size - size)) > 0) { size += n; }
+    close(fd);
+    if (n == -1) {
+        printf("failed to read database\n");
+        clear(head);
+        return 1;
+    }
+
+    line = frame = bank;
+    end = bank + size;
+    while (1) {  /* we will parse 3 lines in each iteration, until we reach EOF */
+        Question *q = malloc(sizeof(Question));
+        QuestionNode *node = malloc(sizeof(QuestionNode));
+
+        if (q == NULL || node == NULL) {
+            printf("memory error\n");
+            free(q);
+            free(node);
+            clear(head);
+            return 1;
+        }
+
+        /* parse line (Question) - will return 1 if EOF is reached */
+        frames[0] = frame;
+        if ((status = parse_line(&line, end, &frame, QUESTION, &len[0])) == 1) {
+            free(q);
+            free(node);
+            break;
+        }
+
+        /* parse lines (Answer) and (Clue), a question cut short is not formatted either */
+        frames[1] = frame;
+        if (status == 0) { status = parse_line(&line, end, &frame, ANSWER, &len[1]); }
+        frames[2] = frame;
+        if (status == 0) { status = parse_line(&line, end, &frame, CLUE, &len[2]); }
+        if (status != 0) {
+            if (status == 1) { printf("database is not formatted: every question needs an answer and a clue\n"); }
+            free(q);
+            free(node);
+            clear(head);
+            return 1;
+        }
+        (*q).question = frames[0];
+        (*q).question_length = len[0];
+        (*q).answer = frames[1];
+        (*q).answer_length = len[1];
+        (*q).clue = frames[2];
+        (*q).clue_length = len[2];
+        (*q).answer_time = NULL;
+
+        (*node).question = q;
+
+        /* insert node in the beginning of linked list */
+        (*node).next = *head;
+        *head = node;
+    }
+    return 0;
+}
+
+
+/*
+numbers the questions in the order of the list and indexes them by number
+@param head head of linked list
+@param count questions of the bank
+@return 0 on success, 1 otherwise
+*/
+int bank_index(QuestionNode *head, int count) {
+    int i;
+
+    if ((bank_nodes = malloc((count + 1) * sizeof(QuestionNode *))) == NULL) { return 1; }
+    for (i = 0; head != NULL; head = (*head).next, i++) {
+        (*(*head).question).index = i;
+        bank_nodes[i] = head;
+    }
+    bank_count = count;
+    return 0;
+}
+
+
+/*
+memory resident in the process, reported once the database is loaded
+@return resident memory in KiB, 0 if unknown
+*/
+long resident_kib() {
+    long pages = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+
+    if (file == NULL) { return 0; }
+    if (fscanf(file, "%*s %ld", &pages) != 1) { pages = 0; }
+    fclose(file);
+
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+/* makes the calling thread log into the given ring */
+void log_attach(int ring) { log_ring = &logger.rings[ring]; }
+
+
+/*
+logs a message without ever blocking: it is formatted into the ring of the calling thread and written out later by the log writer
+@param level LOG_DEBUG, LOG_INFO, LOG_WARN or LOG_ERROR
+@param format format of the message, as printf()
+*/
+void log_message(int level, char *format, ...) {
+    unsigned long head;
+    struct timespec ts;
+    LogEntry *entry;
+    va_list ap;
+
+    if (level < logger.level) { return; }
+    if (log_ring == NULL) { /* a thread without a ring, before the logger started or after it stopped */
+        va_start(ap, format);
+        vprintf(format, ap);
+        va_end(ap);
+        printf("\n");
+        return;
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    if (level < LOG_ERROR) {
+        if (ts.tv_sec != (*log_ring).window) {
+            (*log_ring).window = ts.tv_sec;
+            (*log_ring).window_count = 0;
+        }
+        if (++(*log_ring).window_count > LOG_RATE) {
+            __atomic_fetch_add(&(*log_ring).limited, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    head = (*log_ring).head;
+    if (head - __atomic_load_n(&(*log_ring).tail, __ATOMIC_ACQUIRE) == LOG_RING_SIZE) { /* the writer is behind */
+        __atomic_fetch_add(&(*log_ring).dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    entry = &(*log_ring).entries[head & LOG_RING_MASK];
+    (*entry).time = ts.tv_sec * 1000000000L + ts.tv_nsec;
+    (*entry).level = level;
+    va_start(ap, format);
+    vsnprintf((*entry).text, LOG_MSG_SIZE, format, ap);
+    va_end(ap);
+
+    __atomic_store_n(&(*log_ring).head, head + 1, __ATOMIC_RELEASE); /* publishes the entry to the writer */
+}
+
+
+/*
+writes out every message waiting in the rings, in one write() per buffer
+@return number of messages written
+*/
+int log_drain() {
+    static char *levels[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+    char buf[BUF_LOG_SIZE], clock[16];
+    int i, len = 0, count = 0;
+    unsigned long tail, head, lost;
+    time_t seconds;
+    struct tm tm;
+    LogRing *ring;
+    LogEntry *entry;
+
+    for (i = 0; i < METRIC_SLOTS; i++) {
+        ring = &logger.rings[i];
+        tail = (*ring).tail;
+        head = __atomic_load_n(&(*ring).head, __ATOMIC_ACQUIRE);
+
+        for (; tail != head; tail++, count++) {
+            if (len > BUF_LOG_SIZE - LOG_MSG_SIZE - 64) {
+                write(STDOUT_FILENO, buf, len);
+                len = 0;
+            }
+            entry = &(*ring).entries[tail & LOG_RING_MASK];
+            seconds = (*entry).time / 1000000000L;
+            localtime_r(&seconds, &tm);
+            strftime(clock, sizeof(clock), "%H:%M:%S", &tm);
+            len += snprintf(buf + len, BUF_LOG_SIZE - len, "%s.%03ld %-5s [%d] %s\n", clock, (*entry).time / 1000000 % 1000,
+                            levels[(*entry).level], i, (*entry).text);
+        }
+        __atomic_store_n(&(*ring).tail, tail, __ATOMIC_RELEASE); /* gives the entries back to the thread */
+
+        if ((lost = __atomic_load_n(&(*ring).dropped, __ATOMIC_RELAXED)) != (*ring).reported_dropped) {
+            len += snprintf(buf + len, BUF_LOG_SIZE - len, "log: [%d] dropped %lu messages, its ring was full\n", i, lost - (*ring).reported_dropped);
+            (*ring).reported_dropped = lost;
+        }
+        if ((lost = __atomic_load_n(&(*ring).limited, __ATOMIC_RELAXED)) != (*ring).reported_limited) {
+            len += snprintf(buf + len, BUF_LOG_SIZE - len, "log: [%d] dropped %lu messages over the rate limit\n", i, lost - (*ring).reported_limited);
+            (*ring).reported_limited = lost;
+        }
+    }
+    if (len) { write(STDOUT_FILENO, buf, len); }
+    return count;
+}
+
+
+/* the log writer: the only thread that writes to stdout while the server runs, a slow terminal only ever stalls this thread */
+void *run_log_writer() {
+    struct timespec pause = { 0, LOG_FLUSH_MS * 1000000L };
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while (1) {
+        if (log_drain() == 0) {
+            if (__atomic_load_n(&logger.stop, __ATOMIC_ACQUIRE)) { break; }
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+
+/*
+starts the log writer, the level is read from the environment variable QUIZIA_LOG (debug, info, warn or error)
+@return 0 on success, 1 otherwise
+*/
+int log_start() {
+    char *level = getenv("QUIZIA_LOG");
+
+    logger.level = LOG_INFO;
+    if (level != NULL && strcmp(level, "debug") == 0) { logger.level = LOG_DEBUG; }
+    if (level != NULL && strcmp(level, "warn") == 0) { logger.level = LOG_WARN; }
+    if (level != NULL && strcmp(level, "error") == 0) { logger.level = LOG_ERROR; }
+
+    if ((logger.rings = aligned_alloc(64, METRIC_SLOTS * sizeof(LogRing))) == NULL) { return 1; }
+    memset(logger.rings, 0, METRIC_SLOTS * sizeof(LogRing));
+
+    fflush(stdout); /* what was printed so far goes out before what the writer writes */
+    return pthread_create(&logger.writer, NULL, run_log_writer, NULL) != 0;
+}
+
+
+/* stops the log writer once every message logged so far is written */
+void log_stop() {
+    log_ring = NULL;
+    __atomic_store_n(&logger.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(logger.writer, NULL);
+}
+
+
+/* current time of the monotonic clock in ticks of the timer wheel */
+unsigned long current_tick() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000UL + ts.tv_nsec / 1000000) / TICK_MS;
+}
+
+
+/*
+builds the path of a pool fifo from the path of the register fifo, e.g. <register-fifo>.request.3
+@param register_fifo_path path of the register fifo
+@param suffix kind of fifo
+@param slot slot of the fifo pair, -1 if the fifo is not part of a pair
+@return pointer to the path
+*/
+char *pool_path(char *register_fifo_path, char *suffix, int slot) {
+    int len = strlen(register_fifo_path) + strlen(suffix) + 16;
+    char *path = malloc(len);
+
+    if (path == NULL) { return NULL; }
+    if (slot == -1) { snprintf(path, len, "%s.%s", register_fifo_path, suffix); }
+    else { snprintf(path, len, "%s.%s.%d", register_fifo_path, suffix, slot); }
+
+    return path;
+}
+
+
+/*
+creates every fifo of the pool and fills the lease fifo with all the slots,
+leftovers of a server that crashed are removed first
+@param pool pool to create
+@param register_fifo_path path of the register fifo
+@return 0 if created successfully, 1 otherwise
+*/
+int create_pool(FifoPool *pool, char *register_fifo_path) {
+    int i;
+
+    (*pool).lease_fifo_path = pool_path(register_fifo_path, "lease", -1);
+    unlink((*pool).lease_fifo_path);
+    if (mkfifo((*pool).lease_fifo_path, 0666) == -1) { return 1; }
+
+    /* opened for reading and writing so the server is never left without a writer (clients would read EOF) nor a reader (open would block) */
+    if (((*pool).lease_fifo_fd = open((*pool).lease_fifo_path, O_RDWR)) == -1) { return 1; }
+
+    for (i = 0; i < POOL_SIZE; i++) {
+        (*pool).request_fifo_paths[i] = pool_path(register_fifo_path, "request", i);
+        (*pool).response_fifo_paths[i] = pool_path(register_fifo_path, "response", i);
+
+        unlink((*pool).request_fifo_paths[i]);
+        unlink((*pool).response_fifo_paths[i]);
+        if (mkfifo((*pool).request_fifo_paths[i], 0666) == -1 || mkfifo((*pool).response_fifo_paths[i], 0666) == -1) { return 1; }
+
+        write((*pool).lease_fifo_fd, &i, sizeof(int)); /* the slot is free */
+        (*pool).held_fds[i][0] = (*pool).held_fds[i][1] = (*pool).held_fds[i][2] = -1;
+    }
+    return 0;
+}
+
+
+/*
+gives a slot back to the pool, the fifos of the slot must already be closed by the server
+@param pool pool of fifos
+@param slot slot to give back
+*/
+void release_slot(FifoPool *pool, int slot) {
+    write((*pool).lease_fifo_fd, &slot, sizeof(int)); /* writes of an int are atomic, no lock is needed */
+}
+
+
+/*
+keeps the fifos of a slot open until its client hangs up, pool_sweep() gives the slot back then, or after HOLD_TIMEOUT_MS at most
+@param pool pool of fifos
+@param slot slot of the client
+@param request_fd request fifo, non-blocking
+@param unread_fd response fifo opened for reading and writing, holding a frame the client has yet to read, -1 for none
+@param response_fd response fifo opened for writing only
+*/
+void hold_slot(FifoPool *pool, int slot, int request_fd, int unread_fd, int response_fd) {
+    __atomic_store_n(&(*pool).held_until[slot], current_tick() + HOLD_TIMEOUT_MS / TICK_MS, __ATOMIC_RELAXED);
+    __atomic_store_n(&(*pool).held_fds[slot][2], response_fd, __ATOMIC_RELAXED);
+    __atomic_store_n(&(*pool).held_fds[slot][1], unread_fd, __ATOMIC_RELAXED);
+    __atomic_store_n(&(*pool).held_fds[slot][0], request_fd, __ATOMIC_RELEASE); /* published last, pool_sweep() looks at it first */
+}
+
+
+/*
+gives the slot of a finished session back once the client closed its fifos. until then the fifos still lead to the client,
+and a worker opening them for the next client would share them with it, or read the end of the file when it closes them
+@param pool pool of fifos
+@param slot slot of the session
+@param request_fd request fifo of the session
+@param response_fd response fifo of the session
+*/
+void retire_slot(FifoPool *pool, int slot, int request_fd, int response_fd) {
+    struct pollfd hangup = { response_fd, 0, 0 };
+
+    /* the client closes its fifos right after its last request, the timer thread waits for the ones that take longer */
+    if (request_fd != -1 && response_fd != -1 && (poll(&hangup, 1, TICK_MS) != 1 || !(hangup.revents & POLLERR))) {
+        fcntl(request_fd, F_SETFL, O_NONBLOCK);
+        hold_slot(pool, slot, request_fd, -1, response_fd);
+        return;
+    }
+    if (request_fd != -1) { close(request_fd); }
+    if (response_fd != -1) { close(response_fd); }
+    release_slot(pool, slot);
+}
+
+
+/*
+tells a registered client the server is too busy to serve it and when to try again. the server holds both fifos of the slot open
+for reading and writing, so the opens of the client complete whenever it gets to them, and the slot is only given back by
+pool_sweep() once the client read the frame and closed its fifos: a client of the slot never ends up sharing it with the next one,
+unless it did not hang up within HOLD_TIMEOUT_MS and the slot got new fifos
+@param pool pool of fifos
+@param slot slot of the client
+@param retry_ms milliseconds the client is told to wait before trying again
+*/
+void shed_client(FifoPool *pool, int slot, int retry_ms) {
+    char frame[16];
+    int len = sprintf(frame, "%c%d", BUSY, retry_ms) + 1, request_fd, response_fd, writer_fd;
+
+    /* opening a fifo for reading and writing never blocks, whether the client opened its end yet or not */
+    request_fd = open((*pool).request_fifo_paths[slot], O_RDWR | O_NONBLOCK);
+    response_fd = open((*pool).response_fifo_paths[slot], O_RDWR | O_NONBLOCK);
+    /* opened while the server still reads the response fifo, so it succeeds, and kept to see the client hang up */
+    writer_fd = response_fd == -1 ? -1 : open((*pool).response_fifo_paths[slot], O_WRONLY | O_NONBLOCK);
+    if (request_fd == -1 || response_fd == -1 || writer_fd == -1) {
+        /* the slot cannot be watched, so it is kept out of the pool rather than risk two clients on it */
+        log_message(LOG_ERROR, "failed to open the fifos of the shed client of slot %d, the slot is lost", slot);
+        if (request_fd != -1) { close(request_fd); }
+        if (response_fd != -1) { close(response_fd); }
+        return;
+    }
+    write(response_fd, frame, len); /* a few bytes into an empty fifo */
+    hold_slot(pool, slot, request_fd, response_fd, writer_fd);
+}
+
+
+/*
+gives a slot held for a client that never hung up back with new fifos, so a client killed before it read its frame does not keep the slot:
+the client, if it is only stuck, is left with the old fifos, which no one else opens
+@param pool pool of fifos
+@param slot slot to recreate
+*/
+void recycle_slot(FifoPool *pool, int slot) {
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if ((*pool).held_fds[slot][i] != -1) { close((*pool).held_fds[slot][i]); }
+        (*pool).held_fds[slot][i] = -1;
+    }
+    unlink((*pool).request_fifo_paths[slot]);
+    unlink((*pool).response_fifo_paths[slot]);
+    if (mkfifo((*pool).request_fifo_paths[slot], 0666) == -1 || mkfifo((*pool).response_fifo_paths[slot], 0666) == -1) {
+        log_message(LOG_ERROR, "failed to recreate the fifos of slot %d, the slot is lost", slot);
+        return;
+    }
+    log_message(LOG_WARN, "the client of slot %d did not hang up in time, the slot got new fifos", slot);
+    release_slot(pool, slot);
+}
+
+
+/*
+gives back the slots held whose client hung up, called by the timer thread every tick.
+a slot with a frame unread waits until the client read it, which means it opened both fifos, then until no one reads the response fifo.
+the client closes the request fifo first, and whatever it wrote there is drained, so the next client of the slot starts clean.
+a slot still held after HOLD_TIMEOUT_MS is recreated, see recycle_slot()
+@param pool pool of fifos
+*/
+void pool_sweep(FifoPool *pool) {
+    char buf[BUF_REQ_SIZE];
+    struct pollfd hangup;
+    int i, unread;
+    unsigned long tick = current_tick();
+
+    for (i = 0; i < POOL_SIZE; i++) {
+        if (__atomic_load_n(&(*pool).held_fds[i][0], __ATOMIC_ACQUIRE) == -1) { continue; }
+        if (tick > (*pool).held_until[i]) {
+            recycle_slot(pool, i);
+            continue;
+        }
+
+        if ((*pool).held_fds[i][1] != -1) {
+            if (ioctl((*pool).held_fds[i][1], FIONREAD, &unread) == -1 || unread > 0) { continue; } /* the frame was not read yet */
+            close((*pool).held_fds[i][1]); /* from now on the client is the only reader of the response fifo */
+            (*pool).held_fds[i][1] = -1;
+        }
+
+        hangup.fd = (*pool).held_fds[i][2];
+        hangup.events = 0;
+        /* the write end of a fifo reports POLLERR once it has no reader left */
+        if (poll(&hangup, 1, 0) != 1 || !(hangup.revents & POLLERR)) { continue; }
+
+        while (read((*pool).held_fds[i][0], buf, BUF_REQ_SIZE) > 0) {} /* what the client sent that was never served */
+        close((*pool).held_fds[i][0]);
+        close((*pool).held_fds[i][2]);
+        (*pool).held_fds[i][0] = (*pool).held_fds[i][2] = -1;
+        release_slot(pool, i);
+    }
+}
+
+
+/*
+removes every fifo of the pool
+@param pool pool to destroy
+*/
+void destroy_pool(FifoPool *pool) {
+    int i;
+
+    for (i = 0; i < POOL_SIZE; i++) {
+        if ((*pool).held_fds[i][0] != -1) { close((*pool).held_fds[i][0]); }
+        if ((*pool).held_fds[i][1] != -1) { close((*pool).held_fds[i][1]); }
+        if ((*pool).held_fds[i][2] != -1) { close((*pool).held_fds[i][2]); }
+        unlink((*pool).request_fifo_paths[i]);
+        unlink((*pool).response_fifo_paths[i]);
+        free((*pool).request_fifo_paths[i]);
+        free((*pool).response_fifo_paths[i]);
+    }
+    close((*pool).lease_fifo_fd);
+    unlink((*pool).lease_fifo_path);
+    free((*pool).lease_fifo_path);
+}
+
+
+/*
+initializes an empty timer wheel
+@param wheel wheel to initialize
+@param now current tick
+*/
+void wheel_init(TimerWheel *wheel, unsigned long now) {
+    int level, slot;
+
+    (*wheel).now = now;
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+            (*wheel).slots[level][slot].next = &(*wheel).slots[level][slot];
+            (*wheel).slots[level][slot].prev = &(*wheel).slots[level][slot];
+        }
+    }
+}
+
+
+/*
+links a timer into the slot matching its expiry
+@param wheel timer wheel
+@param timer timer with expires already set
+*/
+void wheel_place(TimerWheel *wheel, Timer *timer) {
+    int level = 0;
+    unsigned long delta = (*timer).expires - (*wheel).now;
+    Timer *head;
+
+    if ((*timer).expires < (*wheel).now) { delta = 0; }
+    if (delta >= 1UL << (WHEEL_BITS * WHEEL_LEVELS)) { /* beyond the range of the wheel, it fires at the end of the range */
+        delta = (1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+        (*timer).expires = (*wheel).now + delta;
+    }
+    while (level < WHEEL_LEVELS - 1 && delta >= 1UL << (WHEEL_BITS * (level + 1))) { level++; }
+
+    head = &(*wheel).slots[level][((*timer).expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    (*timer).next = head;
+    (*timer).prev = (*head).prev;
+    (*(*head).prev).next = timer;
+    (*head).prev = timer;
+}
+
+
+/*
+arms a timer, a timer that is already armed is moved
+@param wheel timer wheel
+@param timer timer to arm
+@param ms milliseconds until it fires
+*/
+void timer_arm(TimerWheel *wheel, Timer *timer, int ms) {
+    unsigned long ticks = (ms + TICK_MS - 1) / TICK_MS;
+
+    if ((*timer).next != NULL) {
+        (*(*timer).prev).next = (*timer).next;
+        (*(*timer).next).prev = (*timer).prev;
+    }
+    (*timer).expires = (*wheel).now + (ticks ? ticks : 1); /* the slot of the current tick was already processed */
+    wheel_place(wheel, timer);
+}
+
+
+/*
+cancels a timer
+@param timer timer to cancel
+@return 1 if the timer was armed, 0 if it had already fired or was never armed
+*/
+int timer_cancel(Timer *timer) {
+    if ((*timer).next == NULL) { return 0; }
+
+    (*(*timer).prev).next = (*timer).next;
+    (*(*timer).next).prev = (*timer).prev;
+    (*timer).next = NULL;
+    (*timer).prev = NULL;
+    return 1;
+}
+
+
+/*
+moves the wheel forward up to the given tick, collecting every timer that fires on the way
+@param wheel timer wheel
+@param now tick to advance to
+@param expired head of the list that receives the expired timers, they are unlinked from the wheel
+*/
+void wheel_advance(TimerWheel *wheel, unsigned long now, Timer *expired) {
+    int level;
+    Timer *head, *timer;
+
+    while ((*wheel).now < now) {
+        (*wheel).now++;
+
+        /* when a level wraps around, the next slot of the level above is spread over the finer levels */
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            if (((*wheel).now & ((1UL << (WHEEL_BITS * level)) - 1)) != 0) { break; }
+
+            head = &(*wheel).slots[level][((*wheel).now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+            while ((timer = (*head).next) != head) {
+                (*head).next = (*timer).next;
+                (*(*timer).next).prev = head;
+                wheel_place(wheel, timer);
+            }
+        }
+
+        head = &(*wheel).slots[0][(*wheel).now & WHEEL_MASK];
+        while ((timer = (*head).next) != head) {
+            (*head).next = (*timer).next;
+            (*(*timer).next).prev = head;
+            (*timer).next = expired;
+            (*timer).prev = (*expired).prev;
+            (*(*expired).prev).next = timer;
+            (*expired).prev = timer;
+        }
+    }
+}
+
+
+/* current time of the monotonic clock in nanoseconds */
+long now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+/*
+records how long a request took to serve in the latency histogram of the thread
+@param metrics slot of the thread
+@param ns time in nanoseconds
+*/
+void record_latency(Metrics *metrics, long ns) {
+    unsigned long us = ns / 1000, bits;
+    int bucket = 0;
+
+    METRIC_ADD((*metrics).latency_sum_us, us);
+    for (bits = us ? us - 1 : 0; bits && bucket < LATENCY_BUCKETS - 1; bits >>= 1) { bucket++; } /* smallest i such that us <= 2^i */
+    METRIC_ADD((*metrics).latency[bucket], 1);
+}
+
+
+/*
+starts a span
+@return start of the span, 0 when the calling thread does not trace
+*/
+long trace_begin() { return trace_buffer != NULL ? now_ns() : 0; }
+
+
+/*
+records a span that ends now into the buffer of the calling thread
+@param name name of the span, a string literal
+@param start start of the span, from trace_begin() or now_ns()
+@param slot fifo slot of the client
+*/
+void trace_end(char *name, long start, int slot) {
+    TraceEvent *event;
+
+    if (trace_buffer == NULL || start == 0) { return; }
+    if ((*trace_buffer).count == TRACE_EVENTS) {
+        (*trace_buffer).dropped++;
+        return;
+    }
+    event = &(*trace_buffer).events[(*trace_buffer).count];
+    (*event).name = name;
+    (*event).start = start;
+    (*event).end = now_ns();
+    (*event).slot = slot;
+    __atomic_store_n(&(*trace_buffer).count, (*trace_buffer).count + 1, __ATOMIC_RELEASE);
+}
+
+
+/* makes the calling thread trace into the given buffer, if tracing is on */
+void trace_attach(int buffer) {
+    if (tracer.path != NULL) { trace_buffer = &tracer.buffers[buffer]; }
+}
+
+
+/*
+turns tracing on if the environment variable QUIZIA_TRACE names the file the trace is written to
+@return 0 on success, 1 on memory error
+*/
+int trace_start() {
+    int i;
+
+    if ((tracer.path = getenv("QUIZIA_TRACE")) == NULL) { return 0; }
+    if ((tracer.buffers = aligned_alloc(64, METRIC_SLOTS * sizeof(TraceBuffer))) == NULL) { return 1; }
+    for (i = 0; i < METRIC_SLOTS; i++) {
+        tracer.buffers[i].count = tracer.buffers[i].dropped = 0;
+        if ((tracer.buffers[i].events = malloc(TRACE_EVENTS * sizeof(TraceEvent))) == NULL) { return 1; } /* pages are only touched as spans are recorded */
+    }
+    return 0;
+}
+
+
+/*
+writes the spans of every thread as Chrome trace-event JSON, to be opened in chrome://tracing or ui.perfetto.dev:
+one row per fifo slot, so a row is the timeline of the clients that leased that slot, and the thread of each span in its args
+*/
+void trace_dump() {
+    FILE *file;
+    int i, slot;
+    long j, count, spans = 0, dropped = 0, origin = -1;
+    TraceEvent *event;
+
+    if (tracer.path == NULL) { return; }
+    if ((file = fopen(tracer.path, "w")) == NULL) {
+        printf("failed to write the trace to %s\n", tracer.path);
+        return;
+    }
+
+    for (i = 0; i < METRIC_SLOTS; i++) { /* timestamps start at the first span */
+        if (__atomic_load_n(&tracer.buffers[i].count, __ATOMIC_ACQUIRE) > 0 && (origin == -1 || tracer.buffers[i].events[0].start < origin)) {
+            origin = tracer.buffers[i].events[0].start;
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (slot = 0; slot < POOL_SIZE; slot++) {
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"fifo slot %d\"}},\n", slot, slot);
+    }
+    for (i = 0; i < METRIC_SLOTS; i++) {
+        count = __atomic_load_n(&tracer.buffers[i].count, __ATOMIC_ACQUIRE);
+        for (j = 0; j < count; j++) {
+            event = &tracer.buffers[i].events[j];
+            fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"quizia\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"thread\":\"%s%d\"}}",
+                    spans++ ? ",\n" : "", (*event).name, (*event).slot, ((*event).start - origin) / 1000.0, ((*event).end - (*event).start) / 1000.0,
+                    i == SLOT_REGISTRATION ? "registration" : i == SLOT_TIMERS ? "timers" : "worker ", i < MAX_CLIENTS ? i : 0);
+        }
+        dropped += tracer.buffers[i].dropped;
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) { printf("failed to write the trace to %s\n", tracer.path); }
+    else { printf("trace of %ld spans written to %s, %ld dropped\n", spans, tracer.path, dropped); }
+}
+
+
+/*
+writes the journal: takes every record appended since its last commit, writes them and calls fdatasync() once for all of them,
+so the records of the games that end while the disk is busy are made durable together
+*/
+void *run_journal() {
+    char *buf;
+    long len, done, n;
+    unsigned long records;
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    pthread_mutex_lock(&journal.mtx);
+    while (1) {
+        while (journal.pending_len == 0 && !journal.stop) { pthread_cond_wait(&journal.cond, &journal.mtx); }
+        if (journal.pending_len == 0) { break; } /* stopped, and every record is written */
+
+        buf = journal.pending;
+        len = journal.pending_len;
+        records = journal.pending_records;
+        journal.pending = journal.committing;
+        journal.committing = buf;
+        n = journal.pending_size;
+        journal.pending_size = journal.committing_size;
+        journal.committing_size = n;
+        journal.pending_len = 0;
+        journal.pending_records = 0;
+        pthread_mutex_unlock(&journal.mtx);
+
+        for (done = 0; done < len; done += n) {
+            if ((n = write(journal.fd, buf + done, len - done)) == -1 && errno == EINTR) { n = 0; }
+            else if (n == -1) { break; }
+        }
+        n = done < len || fdatasync(journal.fd) == -1;
+
+        pthread_mutex_lock(&journal.mtx);
+        if (n) { journal.failed += records; }
+        else { journal.records += records; }
+        journal.commits++;
+    }
+    pthread_mutex_unlock(&journal.mtx);
+    return NULL;
+}
+
+
+/*
+opens the journal and starts its writer
+@param path file of the journal, QUIZIA_JOURNAL names another one
+@return 0 on success, 1 otherwise
+*/
+int journal_start(char *path) {
+    if ((journal.path = getenv("QUIZIA_JOURNAL")) == NULL) { journal.path = path; }
+    if ((journal.fd = open(journal.path, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1) { return 1; }
+
+    journal.pending = malloc(BUF_JOURNAL_SIZE);
+    journal.committing = malloc(BUF_JOURNAL_SIZE);
+    journal.pending_size = journal.committing_size = BUF_JOURNAL_SIZE;
+    if (journal.pending == NULL || journal.committing == NULL) { return 1; }
+
+    return pthread_create(&journal.writer, NULL, run_journal, NULL) != 0;
+}
+
+
+/*
+appends the record of a game to the journal, one line: end time in milliseconds since the epoch, player, score,
+questions answered and duration in milliseconds. it never waits for the disk, only for the writer to swap buffers
+@param session session of the game
+*/
+void journal_append(Session *session) {
+    char record[BUF_RECORD_SIZE], *buf;
+    int len;
+    struct timespec ts;
+
+    if (journal.fd == -1) { return; }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    len = snprintf(record, BUF_RECORD_SIZE, "%ld %s %d %d %ld\n", ts.tv_sec * 1000L + ts.tv_nsec / 1000000, (*session).name,
+                   (*session).points, (*session).answered, (now_ns() - (*session).opened) / 1000000);
+
+    pthread_mutex_lock(&journal.mtx);
+    if (journal.stop) { /* too late, the writer is gone */
+        pthread_mutex_unlock(&journal.mtx);
+        return;
+    }
+    if (journal.pending_len + len > journal.pending_size) {
+        if ((buf = realloc(journal.pending, 2 * journal.pending_size)) == NULL) {
+            journal.failed++;
+            pthread_mutex_unlock(&journal.mtx);
+            return;
+        }
+        journal.pending = buf;
+        journal.pending_size *= 2;
+    }
+    memcpy(journal.pending + journal.pending_len, record, len);
+    journal.pending_len += len;
+    journal.pending_records++;
+    pthread_cond_signal(&journal.cond);
+    pthread_mutex_unlock(&journal.mtx);
+}
+
+
+/* stops the writer once every record appended is written, and closes the journal */
+void journal_stop() {
+    if (journal.fd == -1) { return; }
+
+    pthread_mutex_lock(&journal.mtx);
+    journal.stop = 1;
+    pthread_cond_signal(&journal.cond);
+    pthread_mutex_unlock(&journal.mtx);
+    pthread_join(journal.writer, NULL);
+
+    printf("%lu games written to the journal %s in %lu commits, %lu lost\n", journal.records, journal.path, journal.commits, journal.failed);
+    close(journal.fd);
+    journal.fd = -1;
+    free(journal.pending);
+    free(journal.committing);
+}
+
+
+/*
+bucket of a value
+@param us value in microseconds
+@return index of the bucket
+*/
+int hdr_bucket(unsigned long us) {
+    int shift = 0, bucket;
+    unsigned long top;
+
+    if (us < HDR_SUB) { return us; }
+    for (top = us >> HDR_SUB_BITS; top; top >>= 1) { shift++; } /* the bucket is 2^shift wide */
+    bucket = HDR_SUB + (shift - 1) * (HDR_SUB / 2) + (int)(us >> shift) - HDR_SUB / 2;
+    return bucket < HDR_BUCKETS ? bucket : HDR_BUCKETS - 1;
+}
+
+
+/*
+highest value counted in a bucket
+@param bucket index of the bucket
+@return value in microseconds
+*/
+unsigned long hdr_highest(int bucket) {
+    int shift;
+
+    if (bucket < HDR_SUB) { return bucket; }
+    shift = (bucket - HDR_SUB) / (HDR_SUB / 2) + 1;
+    return ((unsigned long)((bucket - HDR_SUB) % (HDR_SUB / 2) + HDR_SUB / 2 + 1) << shift) - 1;
+}
+
+
+/*
+records a time in a histogram, several threads may record in the same one
+@param histogram histogram
+@param ns time in nanoseconds
+*/
+void hdr_record(Histogram *histogram, long ns) {
+    unsigned long us = ns / 1000;
+
+    METRIC_ADD((*histogram).counts[hdr_bucket(us)], 1);
+    METRIC_ADD((*histogram).count, 1);
+    METRIC_ADD((*histogram).sum_us, us);
+}
+
+
+/*
+adds the counts of a histogram to another one, the histogram merged may still be recorded in
+@param to histogram that receives the counts, owned by the caller
+@param from histogram to merge
+*/
+void hdr_merge(Histogram *to, Histogram *from) {
+    int i;
+
+    for (i = 0; i < HDR_BUCKETS; i++) { (*to).counts[i] += METRIC_GET((*from).counts[i]); }
+    (*to).count += METRIC_GET((*from).count);
+    (*to).sum_us += METRIC_GET((*from).sum_us);
+}
+
+
+/*
+value below which a ratio of the recorded values falls
+@param histogram histogram, not empty
+@param ratio e.g. 0.99 for the 99th percentile
+@return highest value of the bucket of the percentile, in microseconds
+*/
+unsigned long hdr_percentile(Histogram *histogram, double ratio) {
+    unsigned long rank = (unsigned long)(ratio * (*histogram).count + 0.999999), seen = 0;
+    int i;
+
+    if (rank == 0) { rank = 1; }
+    for (i = 0; i < HDR_BUCKETS - 1; i++) {
+        if ((seen += (*histogram).counts[i]) >= rank) { break; }
+    }
+    return hdr_highest(i);
+}
+
+
+/*
+formats one line of a histogram dump, nothing if the histogram is empty
+@param buf stores the line
+@param size size of buf
+@param name name of the line
+@param histogram histogram, not recorded in anymore, e.g. the result of hdr_merge()
+@param unit 1 to report microseconds, 1000 to report milliseconds
+@return length of the line
+*/
+int hdr_format(char *buf, int size, char *name, Histogram *histogram, int unit) {
+    if ((*histogram).count == 0) { return 0; }
+
+    return snprintf(buf, size, "%s count=%lu mean=%.1f p50=%lu p90=%lu p99=%lu p999=%lu max=%lu\n", name, (*histogram).count,
+                    (double)(*histogram).sum_us / (*histogram).count / unit, hdr_percentile(histogram, 0.5) / unit,
+                    hdr_percentile(histogram, 0.9) / unit, hdr_percentile(histogram, 0.99) / unit,
+                    hdr_percentile(histogram, 0.999) / unit, hdr_percentile(histogram, 1) / unit);
+}
+
+
+/*
+records the time a player took to answer a question, from the question being sent to the answer being requested
+@param q question
+@param ns time in nanoseconds
+*/
+void record_answer(Question *q, long ns) {
+    Histogram *histogram = __atomic_load_n(&(*q).answer_time, __ATOMIC_ACQUIRE), *expected = NULL;
+
+    if (histogram == NULL) { /* the first thread to install its histogram wins, the others free theirs */
+        if ((histogram = calloc(1, sizeof(Histogram))) == NULL) { return; }
+        if (!__atomic_compare_exchange_n(&(*q).answer_time, &expected, histogram, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            free(histogram);
+            histogram = expected;
+        }
+    }
+    hdr_record(histogram, ns);
+}
+
+
+/*
+xorshift64*, the random numbers of the draws
+@param state random state, never 0
+@return next random number
+*/
+unsigned long next_random(unsigned long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717UL;
+}
+
+
+/*
+difficulty of a question, from how many answered it right, asked for its clue and how long they took.
+before any answer it is half right and half the time
+@param stats what the players did with the question
+@return difficulty, from 0 to 1
+*/
+double difficulty(QuestionStats *stats) {
+    unsigned int served = METRIC_GET((*stats).served), answered = METRIC_GET((*stats).answered);
+    double wrong = 1 - (METRIC_GET((*stats).correct) + 1.0) / (answered + 2.0);
+    double clues = served ? (double)METRIC_GET((*stats).clues) / served : 0;
+    double slow = (METRIC_GET((*stats).latency_ms) + QUESTION_TIMEOUT_MS / 2.0) / ((answered + 1.0) * QUESTION_TIMEOUT_MS);
+
+    if (clues > 1) { clues = 1; }
+    if (slow > 1) { slow = 1; }
+    return 0.6 * wrong + 0.2 * clues + 0.2 * slow;
+}
+
+
+/* bucket of a difficulty */
+int difficulty_bucket(double d) {
+    int b = (int)(d * DIFFICULTY_BUCKETS);
+
+    return b < 0 ? 0 : (b >= DIFFICULTY_BUCKETS ? DIFFICULTY_BUCKETS - 1 : b);
+}
+
+
+/* builds the alias table of every level (Vose), holding the lock of the selector: a bucket weighs its questions times how close its difficulty is to the level */
+void selector_build() {
+    double weight[DIFFICULTY_BUCKETS], total, center, distance, target;
+    int small[DIFFICULTY_BUCKETS], large[DIFFICULTY_BUCKETS], l, b, s, g, ns, nl;
+
+    for (l = 0; l < LEVELS; l++) {
+        target = (l + 0.5) / LEVELS;
+        total = 0;
+        for (b = 0; b < DIFFICULTY_BUCKETS; b++) {
+            center = (b + 0.5) / DIFFICULTY_BUCKETS;
+            distance = (center - target) * LEVELS;
+            weight[b] = (selector.start[b + 1] - selector.start[b]) * (EXPLORE + 1 / (1 + distance * distance));
+            total += weight[b];
+        }
+
+        /* scaled so the average is 1, the buckets below 1 are topped up by the ones above */
+        ns = nl = 0;
+        for (b = 0; b < DIFFICULTY_BUCKETS; b++) {
+            weight[b] = weight[b] * DIFFICULTY_BUCKETS / total;
+            if (weight[b] < 1) { small[ns++] = b; }
+            else { large[nl++] = b; }
+        }
+        while (ns > 0 && nl > 0) {
+            s = small[--ns];
+            g = large[nl - 1];
+            selector.prob[l][s] = weight[s];
+            selector.alias[l][s] = g;
+            weight[g] -= 1 - weight[s];
+            if (weight[g] < 1) {
+                nl--;
+                small[ns++] = g;
+            }
+        }
+        while (nl > 0) { selector.prob[l][large[--nl]] = 1; }
+        while (ns > 0) { selector.prob[l][small[--ns]] = 1; } /* only left by rounding */
+    }
+    selector.dirty = 0;
+    selector.rebuilds++;
+}
+
+
+/*
+sorts the questions of the bank into the buckets of their difficulty, which makes questions drawn by difficulty, before the threads start
+@param head head of linked list
+@param count questions of the bank
+@return 0 on success, 1 otherwise
+*/
+int selector_init(QuestionNode *head, int count) {
+    int b, next[DIFFICULTY_BUCKETS];
+    QuestionNode *node;
+    Question *q;
+
+    if ((selector.order = malloc(count * sizeof(QuestionNode *))) == NULL) { return 1; }
+    selector.count = count;
+
+    memset(selector.start, 0, sizeof(selector.start));
+    for (node = head; node != NULL; node = (*node).next) {
+        q = (*node).question;
+        (*q).difficulty = difficulty(&(*q).stats);
+        (*q).bucket = difficulty_bucket((*q).difficulty);
+        selector.start[(*q).bucket + 1]++;
+    }
+    for (b = 0; b < DIFFICULTY_BUCKETS; b++) {
+        selector.start[b + 1] += selector.start[b];
+        next[b] = selector.start[b];
+    }
+    for (node = head; node != NULL; node = (*node).next) {
+        q = (*node).question;
+        (*q).slot = next[(*q).bucket]++;
+        selector.order[(*q).slot] = node;
+    }
+    selector_build();
+    return 0;
+}
+
+
+/* swaps two places of the questions of the selector, holding its lock */
+void selector_swap(int i, int j) {
+    QuestionNode *node = selector.order[i];
+
+    selector.order[i] = selector.order[j];
+    selector.order[j] = node;
+    (*(*selector.order[i]).question).slot = i;
+    (*(*selector.order[j]).question).slot = j;
+}
+
+
+/*
+updates the difficulty of a question after an answer, a timeout or a clue, moving it to the bucket of its new difficulty:
+it is swapped with the last question of its bucket, which then ends one place earlier, and so on up to its new bucket (or down)
+@param q the question
+*/
+void selector_update(Question *q) {
+    int b;
+
+    if (selector.order == NULL) { return; }
+    pthread_mutex_lock(&selector_mtx);
+    (*q).difficulty = difficulty(&(*q).stats);
+    if ((b = difficulty_bucket((*q).difficulty)) != (*q).bucket) {
+        for (; (*q).bucket < b; (*q).bucket++) {
+            selector_swap((*q).slot, selector.start[(*q).bucket + 1] - 1);
+            selector.start[(*q).bucket + 1]--;
+        }
+        for (; (*q).bucket > b; (*q).bucket--) {
+            selector_swap((*q).slot, selector.start[(*q).bucket]);
+            selector.start[(*q).bucket]++;
+        }
+        selector.dirty = 1;
+        selector.moves++;
+    }
+    pthread_mutex_unlock(&selector_mtx);
+}
+
+
+/*
+draws a question for a level, holding the lock of the selector
+@param level level of the player
+@param seed random state of the player
+@return node of the question
+*/
+QuestionNode *selector_draw(int level, unsigned long *seed) {
+    unsigned long r = next_random(seed);
+    int b = r % DIFFICULTY_BUCKETS;
+
+    if (selector.dirty) { selector_build(); }
+    if ((double)(r >> 11) / (1UL << 53) >= selector.prob[level][b]) { b = selector.alias[level][b]; }
+    return selector.order[selector.start[b] + next_random(seed) % (selector.start[b + 1] - selector.start[b])];
+}
+
+
+/* questions of a game drawn by difficulty, the whole bank when it is smaller */
+int game_questions() { return selector.count > GAME_QUESTIONS ? GAME_QUESTIONS : selector.count; }
+
+
+/* hash of a string (FNV-1a), of the name of a player or the text of a question */
+unsigned long text_hash(char *text) {
+    unsigned long hash = 14695981039346656037UL;
+
+    for (; *text; text++) { hash = (hash ^ (unsigned char)*text) * 1099511628211UL; }
+    return hash;
+}
+
+
+/* key of the items of a question in the review store, the hash of its text */
+unsigned long question_key(Question *q) { return text_hash((*q).question + 1); }
+
+
+/*
+finds the entry of a question in the index of a player
+@param player review state of the player
+@param question index of the question
+@return the entry of the question, or the free entry where it goes
+*/
+ReviewPlace *review_place(ReviewPlayer *player, int question) {
+    int mask = 2 * (*player).size - 1, i = (question * 2654435761U) & mask;
+
+    while ((*player).index[i].question != -1 && (*player).index[i].question != question) { i = (i + 1) & mask; }
+    return &(*player).index[i];
+}
+
+
+/* swaps two items of the heap of a player, and their places in the index */
+void review_swap(ReviewPlayer *player, int i, int j) {
+    Review item = (*player).heap[i];
+
+    (*player).heap[i] = (*player).heap[j];
+    (*player).heap[j] = item;
+    (*review_place(player, (*player).heap[i].question)).place = i;
+    (*review_place(player, (*player).heap[j].question)).place = j;
+}
+
+
+/*
+moves an item of the heap of a player up or down to the place of its due time
+@param player review state of the player
+@param i place of the item
+*/
+void review_sift(ReviewPlayer *player, int i) {
+    int child;
+
+    while (i > 0 && (*player).heap[i].due < (*player).heap[(i - 1) / 2].due) {
+        review_swap(player, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while ((child = 2 * i + 1) < (*player).count) {
+        if (child + 1 < (*player).count && (*player).heap[child + 1].due < (*player).heap[child].due) { child++; }
+        if ((*player).heap[i].due <= (*player).heap[child].due) { break; }
+        review_swap(player, i, child);
+        i = child;
+    }
+}
+
+
+/*
+doubles the heap of a player and rebuilds its index
+@param player review state of the player
+@return 0 on success, 1 on memory error
+*/
+int review_grow(ReviewPlayer *player) {
+    int i, size = (*player).size ? 2 * (*player).size : REVIEW_ITEMS;
+    Review *heap = realloc((*player).heap, size * sizeof(Review));
+    ReviewPlace *index = malloc(2 * size * sizeof(ReviewPlace));
+
+    if (heap != NULL) { (*player).heap = heap; }
+    if (heap == NULL || index == NULL) {
+        free(index);
+        return 1;
+    }
+    free((*player).index);
+    (*player).index = index;
+    (*player).size = size;
+    for (i = 0; i < 2 * size; i++) { index[i].question = -1; }
+    for (i = 0; i < (*player).count; i++) {
+        ReviewPlace *place = review_place(player, (*player).heap[i].question);
+
+        (*place).question = (*player).heap[i].question;
+        (*place).place = i;
+    }
+    return 0;
+}
+
+
+/*
+sets the state of an item of a player, adding it if the player has none for its question, in O(log n)
+@param player review state of the player
+@param item the new state
+@return 0 on success, 1 on memory error
+*/
+int review_set(ReviewPlayer *player, Review *item) {
+    ReviewPlace *place = (*player).size ? review_place(player, (*item).question) : NULL;
+
+    if (place == NULL || (*place).question == -1) {
+        if ((*player).count == (*player).size && review_grow(player)) { return 1; }
+        place = review_place(player, (*item).question);
+        (*place).question = (*item).question;
+        (*place).place = (*player).count++;
+        reviews.items++;
+    }
+    (*player).heap[(*place).place] = *item;
+    review_sift(player, (*place).place);
+    return 0;
+}
+
+
+/*
+finds the review state of a player by name, adding it if it has none, holding the lock of the store
+@param name name of the player
+@return the review state, NULL on memory error
+*/
+ReviewPlayer *review_player(char *name) {
+    ReviewPlayer *player, *next, *moved, **buckets;
+    unsigned long hash = text_hash(name);
+    int i;
+
+    for (player = reviews.buckets[hash & (reviews.buckets_count - 1)]; player != NULL; player = (*player).next) {
+        if (strcmp((*player).name, name) == 0) { return player; }
+    }
+    if ((player = calloc(1, sizeof(ReviewPlayer))) == NULL) { return NULL; }
+    snprintf((*player).name, BUF_NAME_SIZE, "%s", name);
+
+    /* the table doubles once it has as many players as buckets, so chains stay short */
+    if (reviews.players == reviews.buckets_count && (buckets = calloc(2 * reviews.buckets_count, sizeof(ReviewPlayer *))) != NULL) {
+        for (i = 0; i < reviews.buckets_count; i++) {
+            for (moved = reviews.buckets[i]; moved != NULL; moved = next) {
+                next = (*moved).next;
+                (*moved).next = buckets[text_hash((*moved).name) & (2 * reviews.buckets_count - 1)];
+                buckets[text_hash((*moved).name) & (2 * reviews.buckets_count - 1)] = moved;
+            }
+        }
+        free(reviews.buckets);
+        reviews.buckets = buckets;
+        reviews.buckets_count *= 2;
+    }
+    (*player).next = reviews.buckets[hash & (reviews.buckets_count - 1)];
+    reviews.buckets[hash & (reviews.buckets_count - 1)] = player;
+    reviews.players++;
+    return player;
+}
+
+
+/*
+appends the state of an item of a player to a review store
+@param player review state of the player
+@param item the item
+@param file the store
+*/
+void review_append(ReviewPlayer *player, Review *item, FILE *file) {
+    ReviewRecord record;
+
+    memset(&record, 0, sizeof(ReviewRecord));
+    memcpy(record.name, (*player).name, BUF_NAME_SIZE);
+    record.key = question_key((*bank_nodes[(*item).question]).question);
+    record.due = (*item).due;
+    record.interval = (*item).interval;
+    record.ease = (*item).ease;
+    record.streak = (*item).streak;
+    fwrite(&record, sizeof(ReviewRecord), 1, file);
+}
+
+
+/*
+the review state of a player, for a session that has its name
+@param name name of the player
+@return the review state, NULL if there is no store or on memory error
+*/
+ReviewPlayer *reviews_join(char *name) {
+    ReviewPlayer *player = NULL;
+
+    pthread_mutex_lock(&reviews_mtx);
+    if (reviews.buckets != NULL) { player = review_player(name); }
+    pthread_mutex_unlock(&reviews_mtx);
+    return player;
+}
+
+
+/*
+reschedules a question for the player who answered or failed it (SM-2), and appends its new state to the store
+@param player review state of the player
+@param q the question
+@param correct 1 if the answer was right
+*/
+void review_grade(ReviewPlayer *player, Question *q, int correct) {
+    Review item = { (*q).index, 0, 0, EASE_START, 0 };
+    ReviewPlace *place;
+
+    pthread_mutex_lock(&reviews_mtx);
+    if (reviews.buckets == NULL) { /* the server is terminating, the store is written */
+        pthread_mutex_unlock(&reviews_mtx);
+        return;
+    }
+    place = (*player).size ? review_place(player, (*q).index) : NULL;
+    if (place != NULL && (*place).question != -1) { item = (*player).heap[(*place).place]; }
+    if (correct) {
+        item.streak++;
+        if (item.streak == 1) { item.interval = REVIEW_FIRST_S; }
+        else if (item.streak == 2) { item.interval = REVIEW_SECOND_S; }
+        else { item.interval = (unsigned long)item.interval * item.ease / 100 > REVIEW_MAX_S ? REVIEW_MAX_S : (unsigned long)item.interval * item.ease / 100; }
+        item.ease = item.ease + EASE_RIGHT > EASE_MAX ? EASE_MAX : item.ease + EASE_RIGHT;
+    }
+    else {
+        item.streak = 0;
+        item.interval = REVIEW_RETRY_S;
+        item.ease = item.ease - EASE_WRONG < EASE_MIN ? EASE_MIN : item.ease - EASE_WRONG;
+    }
+    item.due = time(NULL) + item.interval;
+    if (review_set(player, &item) == 0 && reviews.file != NULL) {
+        review_append(player, &item, reviews.file);
+        reviews.appended++;
+    }
+    pthread_mutex_unlock(&reviews_mtx);
+}
+
+
+/*
+the first question a player has due, in O(1)
+@param player review state of the player, NULL if it has none
+@return node of the question, NULL if none is due
+*/
+QuestionNode *review_due(ReviewPlayer *player) {
+    QuestionNode *node = NULL;
+
+    if (player == NULL) { return NULL; }
+    pthread_mutex_lock(&reviews_mtx);
+    if (reviews.buckets != NULL && (*player).count > 0 && (*player).heap[0].due <= time(NULL)) { node = bank_nodes[(*player).heap[0].question]; }
+    pthread_mutex_unlock(&reviews_mtx);
+    return node;
+}
+
+
+/*
+opens the review store and replays its records, before the threads start.
+records of questions that are no longer in the bank are dropped
+@param path file of the store, QUIZIA_REVIEWS names another one
+@param head head of linked list
+@param count questions of the bank
+@return 0 on success, 1 otherwise
+*/
+int reviews_start(char *path, QuestionNode *head, int count) {
+    char magic[sizeof(REVIEWS_MAGIC) - 1];
+    int i, j, mask, loaded = 0, dropped = 0;
+    struct { unsigned long key; int question; } *keys; /* index of the questions by key, only while the records are replayed */
+    ReviewRecord record;
+    ReviewPlayer *player;
+    QuestionNode *node;
+    Review item;
+    FILE *file;
+
+    if ((reviews.path = getenv("QUIZIA_REVIEWS")) == NULL) { reviews.path = path; }
+    for (mask = 1; mask < 2 * count; mask *= 2);
+    reviews.buckets = calloc(REVIEW_PLAYERS, sizeof(ReviewPlayer *));
+    keys = malloc(mask * sizeof(*keys));
+    if (reviews.buckets == NULL || keys == NULL) {
+        free(keys);
+        return 1;
+    }
+    reviews.buckets_count = REVIEW_PLAYERS;
+    mask--;
+
+    for (i = 0; i <= mask; i++) { keys[i].question = -1; }
+    for (node = head, i = 0; node != NULL; node = (*node).next, i++) {
+        unsigned long key = question_key((*node).question);
+
+        for (j = key & mask; keys[j].question != -1 && keys[j].key != key; j = (j + 1) & mask);
+        keys[j].key = key; /* a question repeated in the bank is kept under its last index */
+        keys[j].question = i;
+    }
+
+    if ((file = fopen(reviews.path, "r")) != NULL) {
+        if (fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, REVIEWS_MAGIC, sizeof(magic)) == 0) {
+            while (fread(&record, sizeof(ReviewRecord), 1, file) == 1) {
+                record.name[BUF_NAME_SIZE - 1] = '\0';
+                for (j = record.key & mask; keys[j].question != -1 && keys[j].key != record.key; j = (j + 1) & mask);
+                if (keys[j].question == -1 || (player = review_player(record.name)) == NULL) {
+                    dropped++;
+                    continue;
+                }
+                item.question = keys[j].question;
+                item.due = record.due;
+                item.interval = record.interval;
+                item.ease = record.ease;
+                item.streak = record.streak;
+                if (review_set(player, &item) == 0) { loaded++; }
+                reviews.appended++;
+            }
+        }
+        else { printf("%s is not a review store, it will be overwritten\n", reviews.path); }
+        fclose(file);
+    }
+    free(keys);
+    printf("%d players with %lu questions to review loaded from %s (%d records, %d dropped)\n", reviews.players, reviews.items, reviews.path, loaded, dropped);
+
+    /* the records of the games to come are appended, to a new store if it was not one */
+    if ((reviews.file = fopen(reviews.path, reviews.appended > 0 ? "a" : "w")) == NULL) { return 1; }
+    if (reviews.appended == 0) { fwrite(REVIEWS_MAGIC, sizeof(magic), 1, reviews.file); }
+    return 0;
+}
+
+
+/* writes the records appended so far to the store, when a session closes */
+void reviews_flush() {
+    pthread_mutex_lock(&reviews_mtx);
+    if (reviews.file != NULL) { fflush(reviews.file); }
+    pthread_mutex_unlock(&reviews_mtx);
+}
+
+
+/* rewrites the review store with one record per item, so it does not grow with every answer, and frees it. the threads stop using it */
+void reviews_stop() {
+    char *path;
+    int i, j;
+    unsigned long written = 0;
+    ReviewPlayer *player, *next;
+    FILE *file = NULL;
+
+    pthread_mutex_lock(&reviews_mtx);
+    if (reviews.buckets == NULL) {
+        pthread_mutex_unlock(&reviews_mtx);
+        return;
+    }
+    if (reviews.file != NULL) { fclose(reviews.file); }
+    reviews.file = NULL;
+
+    /* written next to the store and renamed over it, a crash in the middle leaves the old one */
+    if ((path = malloc(strlen(reviews.path) + 5)) != NULL) {
+        sprintf(path, "%s.tmp", reviews.path);
+        file = fopen(path, "w");
+    }
+    if (file != NULL) { fwrite(REVIEWS_MAGIC, sizeof(REVIEWS_MAGIC) - 1, 1, file); }
+    for (i = 0; i < reviews.buckets_count; i++) {
+        for (player = reviews.buckets[i]; player != NULL; player = next) {
+            next = (*player).next;
+            for (j = 0; file != NULL && j < (*player).count; j++) { review_append(player, &(*player).heap[j], file); }
+            written += (*player).count;
+            /* a thread may still hold it in its session, it is freed with the process */
+        }
+    }
+    if (file != NULL && fclose(file) == 0 && rename(path, reviews.path) == 0) {
+        printf("%lu questions to review of %d players written to %s, %lu reviews served\n", written, reviews.players, reviews.path, reviews.served);
+    }
+    else { printf("failed to write the review store %s\n", reviews.path); }
+    free(path);
+    reviews.buckets = NULL;
+    pthread_mutex_unlock(&reviews_mtx);
+}
+
+
+/*
+maps the table of snapshots, before the threads start, from a file with -s so the games put aside by a previous run can be resumed
+@param path path of the file, NULL to keep the snapshots in memory only
+@return 0 on success, 1 otherwise
+*/
+int snapshots_start(char *path) {
+    int fd, i;
+    unsigned long hash = 0;
+
+    for (i = 0; i < bank_count; i++) { hash = hash * 31 + question_key((*bank_nodes[i]).question); }
+    snapshots.path = path;
+    snapshots.size = sizeof(SnapshotHeader) + SNAPSHOT_SLOTS * sizeof(Snapshot);
+    if (path == NULL) { snapshots.header = mmap(NULL, snapshots.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); }
+    else {
+        if ((fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) { return 1; }
+        if (ftruncate(fd, snapshots.size) == -1) {
+            close(fd);
+            return 1;
+        }
+        snapshots.header = mmap(NULL, snapshots.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    if (snapshots.header == MAP_FAILED) {
+        snapshots.header = NULL;
+        return 1;
+    }
+    snapshots.slots = (Snapshot *)(snapshots.header + 1);
+
+    if (memcmp((*snapshots.header).magic, SNAPSHOTS_MAGIC, sizeof((*snapshots.header).magic)) != 0 || (*snapshots.header).slots != SNAPSHOT_SLOTS ||
+        (*snapshots.header).questions != bank_count || (*snapshots.header).bank != hash) {
+        if (path != NULL && (*snapshots.header).magic[0]) { printf("%s holds the games of another bank, they are dropped\n", path); }
+        if (path != NULL) { memset(snapshots.header, 0, snapshots.size); }
+        memcpy((*snapshots.header).magic, SNAPSHOTS_MAGIC, sizeof((*snapshots.header).magic));
+        (*snapshots.header).slots = SNAPSHOT_SLOTS;
+        (*snapshots.header).questions = bank_count;
+        (*snapshots.header).bank = hash;
+    }
+    for (i = 0; i < SNAPSHOT_SLOTS; i++) { snapshots.count += snapshots.slots[i].token != 0; }
+    if (path != NULL) { printf("%d games to resume loaded from %s\n", snapshots.count, path); }
+    return 0;
+}
+
+
+/* writes the snapshots back to their file, if they have one, and unmaps them. the threads stop saving */
+void snapshots_stop() {
+    pthread_mutex_lock(&snapshots_mtx);
+    if (snapshots.header != NULL) {
+        if (snapshots.path != NULL) {
+            if (msync(snapshots.header, snapshots.size, MS_SYNC) == 0) { printf("%d games to resume written to %s\n", snapshots.count, snapshots.path); }
+            else { printf("failed to write the snapshots %s\n", snapshots.path); }
+        }
+        munmap(snapshots.header, snapshots.size);
+        snapshots.header = NULL;
+    }
+    pthread_mutex_unlock(&snapshots_mtx);
+}
+
+
+/*
+slot of a token in the table of snapshots, under snapshots_mtx
+@param token resume token, not 0
+@return index of the slot, -1 if the token has none
+*/
+int snapshot_find(unsigned long token) {
+    int i, slot;
+
+    for (i = 0; i < SNAPSHOT_PROBES; i++) {
+        slot = (token + i) & (SNAPSHOT_SLOTS - 1);
+        if (snapshots.slots[slot].token == token) { return slot; }
+    }
+    return -1;
+}
+
+
+/*
+finds a slot for a new token, under snapshots_mtx: a free one or one whose game expired, otherwise the game saved the longest ago gives its slot away
+@param token resume token, not 0
+@return index of the slot
+*/
+int snapshot_claim(unsigned long token) {
+    int i, slot, oldest = -1;
+    long now = time(NULL);
+
+    for (i = 0; i < SNAPSHOT_PROBES; i++) {
+        slot = (token + i) & (SNAPSHOT_SLOTS - 1);
+        if (snapshots.slots[slot].token == 0) {
+            snapshots.count++;
+            return slot;
+        }
+        if (now - snapshots.slots[slot].saved > SNAPSHOT_TTL_S) { return slot; }
+        if (oldest == -1 || snapshots.slots[slot].saved < snapshots.slots[oldest].saved) { oldest = slot; }
+    }
+    return oldest;
+}
+
+
+/*
+draws the question at the position of a game by difficulty, one the game did not have yet, unless the player has a question due
+@param session session of the player
+@return node of the question
+*/
+QuestionNode *session_draw(Session *session) {
+    QuestionNode *node = NULL;
+    int i, j, tries;
+
+    /* a question the player has to review comes first, once per game */
+    if ((node = review_due((*session).reviews)) != NULL) {
+        for (i = 0; i < (*session).position && (*session).played[i] != node; i++);
+        if (i < (*session).position) { node = NULL; }
+        else { __atomic_fetch_add(&reviews.served, 1, __ATOMIC_RELAXED); }
+    }
+
+    pthread_mutex_lock(&selector_mtx);
+    for (tries = 0; tries < DRAW_TRIES && node == NULL; tries++) {
+        node = selector_draw((*session).level, &(*session).seed);
+        for (i = 0; i < (*session).position && (*session).played[i] != node; i++);
+        if (i < (*session).position) { node = NULL; }
+    }
+    /* a small bank runs out of new questions at the level, the first new one of the bank is taken */
+    for (j = 0; node == NULL; j++) {
+        node = selector.order[j];
+        for (i = 0; i < (*session).position && (*session).played[i] != node; i++);
+        if (i < (*session).position) { node = NULL; }
+    }
+    pthread_mutex_unlock(&selector_mtx);
+
+    (*session).played[(*session).position] = node;
+    return node;
+}
+
+
+/*
+the player answered or failed a question: its statistics are updated and the player goes a level up or down
+@param session session of the player
+@param q the question
+@param correct 1 if the answer was right
+@param ms time taken to answer
+*/
+void session_graded(Session *session, Question *q, int correct, long ms) {
+    METRIC_ADD((*q).stats.answered, 1);
+    METRIC_ADD((*q).stats.correct, correct);
+    METRIC_ADD((*q).stats.latency_ms, ms);
+    selector_update(q);
+    if ((*session).reviews != NULL) { review_grade((*session).reviews, q, correct); }
+
+    if (correct && (*session).level < LEVELS - 1) { (*session).level++; }
+    if (!correct && (*session).level > 0) { (*session).level--; }
+}
+
+
+/*
+the session still saves its game into its snapshot, under snapshots_mtx: the slot was not given to another game and no other session resumed it
+@param session session of the player
+@return 1 if it does
+*/
+int session_owns(Session *session) {
+    Snapshot *snapshot;
+
+    if ((*session).snapshot == -1 || snapshots.header == NULL) { return 0; }
+    snapshot = &snapshots.slots[(*session).snapshot];
+    if ((*snapshot).token == (*session).token && (*snapshot).owner == (unsigned long)session) { return 1; }
+    (*session).snapshot = -1;
+    return 0;
+}
+
+
+/*
+saves the game into its snapshot, after every change a resumed game has to see
+@param session session of the player
+@param node current question
+@param graded 1 if the current question was answered
+*/
+void session_save(Session *session, QuestionNode *node, int graded) {
+    Snapshot *snapshot;
+    int i;
+
+    pthread_mutex_lock(&snapshots_mtx);
+    if (session_owns(session)) {
+        snapshot = &snapshots.slots[(*session).snapshot];
+        (*snapshot).game = (*session).game;
+        (*snapshot).saved = time(NULL);
+        memcpy((*snapshot).name, (*session).name, BUF_NAME_SIZE);
+        (*snapshot).question = (*(*node).question).index;
+        (*snapshot).graded = graded;
+        (*snapshot).position = (*session).position;
+        (*snapshot).points = (*session).points;
+        (*snapshot).best = (*session).best;
+        (*snapshot).answered = (*session).answered;
+        (*snapshot).clues = (*session).clues;
+        (*snapshot).adaptive = (*session).adaptive;
+        (*snapshot).level = (*session).level;
+        (*snapshot).seed = (*session).seed;
+        for (i = 0; (*session).adaptive && i <= (*session).position; i++) { (*snapshot).played[i] = (*(*(*session).played[i]).question).index; }
+    }
+    pthread_mutex_unlock(&snapshots_mtx);
+}
+
+
+/*
+drops the snapshot of the game, whose token no longer resumes it
+@param session session of the player
+*/
+void session_forget(Session *session) {
+    pthread_mutex_lock(&snapshots_mtx);
+    if (session_owns(session)) {
+        snapshots.slots[(*session).snapshot].token = 0;
+        snapshots.count--;
+    }
+    (*session).snapshot = -1;
+    pthread_mutex_unlock(&snapshots_mtx);
+}
+
+
+/*
+gives the game a resume token and a snapshot, once
+@param session session of the player
+@param node current question
+@param graded 1 if the current question was answered
+*/
+void session_token(Session *session, QuestionNode *node, int graded) {
+    unsigned long token = 0;
+    Snapshot *snapshot;
+
+    pthread_mutex_lock(&snapshots_mtx);
+    if (snapshots.header == NULL || session_owns(session)) {
+        pthread_mutex_unlock(&snapshots_mtx);
+        return;
+    }
+    while (token == 0 || snapshot_find(token) != -1) {
+        if (getrandom(&token, sizeof(token), 0) != sizeof(token)) { token = (unsigned long)now_ns() * 0x9E3779B97F4A7C15UL; }
+    }
+    (*session).snapshot = snapshot_claim(token);
+    (*session).token = token;
+    snapshot = &snapshots.slots[(*session).snapshot];
+    memset(snapshot, 0, sizeof(Snapshot));
+    (*snapshot).token = token;
+    (*snapshot).owner = (unsigned long)session;
+    snapshots.issued++;
+    pthread_mutex_unlock(&snapshots_mtx);
+    session_save(session, node, graded);
+}
+
+
+/*
+takes up the game of a token on this session, which has not been sent a question yet
+@param session session of the player
+@param token resume token
+@return node of the question the game goes on with, NULL if the token has no game to go on with
+*/
+QuestionNode *session_restore(Session *session, unsigned long token) {
+    int i, slot = -1, valid = 0;
+    Snapshot snapshot;
+    QuestionNode *node;
+
+    pthread_mutex_lock(&snapshots_mtx);
+    if (snapshots.header != NULL && (slot = snapshot_find(token)) != -1) {
+        snapshot = snapshots.slots[slot];
+        valid = time(NULL) - snapshot.saved <= SNAPSHOT_TTL_S && snapshot.question >= 0 && snapshot.question < bank_count;
+        /* the server no longer draws by difficulty */
+        if (snapshot.adaptive) { valid = valid && selector.order != NULL && snapshot.position >= 0 && snapshot.position < game_questions(); }
+        for (i = 0; valid && snapshot.adaptive && i <= snapshot.position; i++) { valid = snapshot.played[i] >= 0 && snapshot.played[i] < bank_count; }
+        /* the last question was graded, the game was over */
+        if (snapshot.graded && (snapshot.adaptive ? snapshot.position == game_questions() - 1 : snapshot.question == bank_count - 1)) { valid = 0; }
+    }
+    if (valid) {
+        snapshots.slots[slot].owner = (unsigned long)session; /* the session that had the game no longer saves it */
+        snapshots.resumed++;
+    }
+    pthread_mutex_unlock(&snapshots_mtx);
+    if (!valid) { return NULL; }
+
+    memcpy((*session).name, snapshot.name, BUF_NAME_SIZE);
+    (*session).name[BUF_NAME_SIZE - 1] = '\0';
+    (*session).game = snapshot.game;
+    (*session).position = snapshot.position;
+    (*session).points = snapshot.points;
+    (*session).best = snapshot.best;
+    (*session).answered = snapshot.answered;
+    (*session).clues = snapshot.clues;
+    (*session).adaptive = snapshot.adaptive;
+    (*session).level = snapshot.level;
+    (*session).seed = snapshot.seed;
+    (*session).snapshot = slot;
+    (*session).token = token;
+    for (i = 0; (*session).adaptive && i <= (*session).position; i++) { (*session).played[i] = bank_nodes[snapshot.played[i]]; }
+    (*session).reviews = (*session).adaptive ? reviews_join((*session).name) : NULL;
+    node = bank_nodes[snapshot.question];
+    if (snapshot.graded) { /* goes on as after NEXT_QUESTION */
+        (*session).position++;
+        node = (*session).adaptive ? session_draw(session) : (*node).next;
+    }
+    return node;
+}
+
+
+/*
+kind of a request, selects its service time histogram
+@param c request
+@return index in REQUEST_KINDS order, -1 if the request is unknown
+*/
+int request_kind(char c) {
+    switch (c) {
+        case QUESTION: return 0;
+        case ANSWER: return 1;
+        case CLUE: return 2;
+        case NEXT_QUESTION: return 3;
+        case EXIT: return 4;
+        case PLAYER_NAME: return 5;
+        case LEADERBOARD: return 6;
+        case JOIN: return 7;
+        case RESUME: return 8;
+    }
+    return -1;
+}
+
+
+/* name of a request, in spans and histogram dumps */
+char *request_name(char c) {
+    static char *names[REQUEST_KINDS] = { "question", "answer", "clue", "next", "exit", "name", "top", "join", "resume" };
+    int kind = request_kind(c);
+
+    return kind == -1 ? "unknown" : names[kind];
+}
+
+
+/*
+sums the slots of every thread and writes them in plain text, one "name value" per line, to a client of the stats socket
+@param args common arguments of the threads
+@param fd descriptor of the connection
+*/
+void write_stats(ServerClient *args, int fd) {
+    char buf[BUF_STATS_SIZE];
+    int i, j, len, players;
+    unsigned long count = 0, records, commits, failed, moves, rebuilds, items, issued, resumed;
+    int kept;
+    Metrics total, *m;
+
+    memset(&total, 0, sizeof(Metrics));
+    for (i = 0; i < METRIC_SLOTS; i++) {
+        m = &(*args).metrics[i];
+        total.questions += METRIC_GET((*m).questions);
+        total.answers += METRIC_GET((*m).answers);
+        total.clues += METRIC_GET((*m).clues);
+        total.timeouts += METRIC_GET((*m).timeouts);
+        total.sessions_opened += METRIC_GET((*m).sessions_opened);
+        total.sessions_closed += METRIC_GET((*m).sessions_closed);
+        total.registrations += METRIC_GET((*m).registrations);
+        total.shed_full += METRIC_GET((*m).shed_full);
+        total.shed_lag += METRIC_GET((*m).shed_lag);
+        total.bytes_in += METRIC_GET((*m).bytes_in);
+        total.bytes_out += METRIC_GET((*m).bytes_out);
+        total.latency_sum_us += METRIC_GET((*m).latency_sum_us);
+        for (j = 0; j < LATENCY_BUCKETS; j++) { total.latency[j] += METRIC_GET((*m).latency[j]); }
+    }
+
+    pthread_mutex_lock(&journal.mtx);
+    records = journal.records;
+    commits = journal.commits;
+    failed = journal.failed;
+    pthread_mutex_unlock(&journal.mtx);
+
+    pthread_mutex_lock(&selector_mtx);
+    moves = selector.moves;
+    rebuilds = selector.rebuilds;
+    pthread_mutex_unlock(&selector_mtx);
+
+    pthread_mutex_lock(&reviews_mtx);
+    players = reviews.players;
+    items = reviews.items;
+    pthread_mutex_unlock(&reviews_mtx);
+
+    pthread_mutex_lock(&snapshots_mtx);
+    kept = snapshots.count;
+    issued = snapshots.issued;
+    resumed = snapshots.resumed;
+    pthread_mutex_unlock(&snapshots_mtx);
+
+    len = snprintf(buf, BUF_STATS_SIZE,
+                   "questions_served %lu\nanswers_sent %lu\nclue_requests %lu\ntimeouts %lu\n"
+                   "sessions_active %lu\nsessions_total %lu\nregistrations %lu\nregistration_queue %d\n"
+                   "bytes_in %lu\nbytes_out %lu\njournal_records %lu\njournal_commits %lu\njournal_lost %lu\n"
+                   "difficulty_moves %lu\ndifficulty_rebuilds %lu\nreview_players %d\nreview_items %lu\nreviews_served %lu\n"
+                   "snapshots_kept %d\nsnapshots_issued %lu\nsnapshots_resumed %lu\nregistrations_shed_full %lu\nregistrations_shed_lag %lu\n",
+                   total.questions, total.answers, total.clues, total.timeouts,
+                   total.sessions_opened - total.sessions_closed, total.sessions_opened, total.registrations,
+                   __atomic_load_n((*args).count, __ATOMIC_RELAXED), total.bytes_in, total.bytes_out, records, commits, failed,
+                   moves, rebuilds, players, items, __atomic_load_n(&reviews.served, __ATOMIC_RELAXED), kept, issued, resumed,
+                   total.shed_full, total.shed_lag);
+
+    /* cumulative buckets, as they are usually exposed */
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        count += total.latency[i];
+        if (i < LATENCY_BUCKETS - 1) { len += snprintf(buf + len, BUF_STATS_SIZE - len, "request_latency_us_bucket{le=\"%lu\"} %lu\n", 1UL << i, count); }
+        else { len += snprintf(buf + len, BUF_STATS_SIZE - len, "request_latency_us_bucket{le=\"+Inf\"} %lu\n", count); }
+    }
+    len += snprintf(buf + len, BUF_STATS_SIZE - len, "request_latency_us_sum %lu\nrequest_latency_us_count %lu\n", total.latency_sum_us, count);
+
+    write(fd, buf, len);
+}
+
+
+/*
+merges the histograms of every thread and writes them in plain text, one line per histogram: the service time of each kind of request,
+then the time players took to answer, over every question and per question, numbered as the questions are served
+@param args common arguments of the threads
+@param fd descriptor to write to
+*/
+void write_histograms(ServerClient *args, int fd) {
+    char buf[BUF_DUMP_SIZE], name[64];
+    char requests[REQUEST_KINDS] = { QUESTION, ANSWER, CLUE, NEXT_QUESTION, EXIT, PLAYER_NAME, LEADERBOARD, JOIN, RESUME };
+    int i, j, len = 0;
+    Histogram merged, *histogram;
+    QuestionNode *node;
+
+    for (i = 0; i < REQUEST_KINDS; i++) {
+        memset(&merged, 0, sizeof(Histogram));
+        for (j = 0; j < METRIC_SLOTS; j++) { hdr_merge(&merged, &(*args).metrics[j].service[i]); }
+        sprintf(name, "service_time_us{request=\"%s\"}", request_name(requests[i]));
+        len += hdr_format(buf + len, BUF_DUMP_SIZE - len, name, &merged, 1);
+    }
+
+    /* the histogram of the server is the merge of the histograms of its questions */
+    memset(&merged, 0, sizeof(Histogram));
+    for (node = *((*args).head); node != NULL; node = (*node).next) {
+        if ((histogram = __atomic_load_n(&(*(*node).question).answer_time, __ATOMIC_ACQUIRE)) != NULL) { hdr_merge(&merged, histogram); }
+    }
+    len += hdr_format(buf + len, BUF_DUMP_SIZE - len, "answer_time_ms", &merged, 1000);
+
+    for (node = *((*args).head), i = 0; node != NULL; node = (*node).next, i++) {
+        if ((histogram = __atomic_load_n(&(*(*node).question).answer_time, __ATOMIC_ACQUIRE)) == NULL) { continue; }
+        if (len > BUF_DUMP_SIZE - 256) { /* a large bank does not fit in one buffer */
+            write(fd, buf, len);
+            len = 0;
+        }
+        memset(&merged, 0, sizeof(Histogram));
+        hdr_merge(&merged, histogram);
+        sprintf(name, "answer_time_ms{question=\"%d\"}", i);
+        len += hdr_format(buf + len, BUF_DUMP_SIZE - len, name, &merged, 1000);
+    }
+
+    /* what the players did with each question they were sent, and the difficulty it gives */
+    for (node = *((*args).head), i = 0; node != NULL; node = (*node).next, i++) {
+        QuestionStats *stats = &(*(*node).question).stats;
+        unsigned int served = METRIC_GET((*stats).served), answered = METRIC_GET((*stats).answered);
+
+        if (served == 0) { continue; }
+        if (len > BUF_DUMP_SIZE - 256) {
+            write(fd, buf, len);
+            len = 0;
+        }
+        len += snprintf(buf + len, BUF_DUMP_SIZE - len, "question_stats{question=\"%d\"} served=%u answered=%u correct_rate=%.2f clue_rate=%.2f mean_ms=%lu difficulty=%.2f\n",
+                        i, served, answered, answered ? (double)METRIC_GET((*stats).correct) / answered : 0,
+                        (double)METRIC_GET((*stats).clues) / served, answered ? METRIC_GET((*stats).latency_ms) / answered : 0,
+                        difficulty(stats));
+    }
+    write(fd, buf, len);
+}
+
+
+/*
+creates the stats socket: an AF_UNIX stream socket, e.g. socat - UNIX-CONNECT:<register-fifo>.stats
+@param path filesystem path of the socket
+@return descriptor of the listening socket, -1 on failure
+*/
+int stats_listener(char *path) {
+    int fd;
+    struct sockaddr_un address;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) { return -1; }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    unlink(path); /* left behind by a server that crashed */
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, 16) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/*
+answers the stats socket until it is shut down: a connection that sends the command "histograms" receives the histograms,
+anything else, or nothing at all, receives the counters
+*/
+void *run_stats(void *stats_args) {
+    ServerClient *args = (ServerClient *)stats_args;
+    char command[BUF_ANS_SIZE];
+    int fd, n;
+    struct timeval wait = { 1, 0 }; /* a connection that sends nothing does not hold the thread for longer */
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while ((fd = accept((*args).stats_fd, NULL, NULL)) != -1 || errno == EINTR || errno == ECONNABORTED) {
+        if (fd == -1) { continue; }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+        n = read(fd, command, BUF_ANS_SIZE);
+
+        if (n >= 10 && strncmp(command, "histograms", 10) == 0) { write_histograms(args, fd); }
+        else { write_stats(args, fd); }
+        close(fd);
+    }
+    return NULL;
+}
+
+
+/*
+converts a letter to lowercase if it is an uppercase letter
+@param c integer representing a characther
+@return letter in lowercase
+*/
+int lower(char c) {
+    if (c >= 'A' && c <= 'Z') { return c + ('a' - 'A'); }
+    return c;
+}
+
+
+/*
+compares the user's answer with the correct answer with the addition of letting a single error pass if there is one,
+the same comparison the client makes, so both agree on the verdict
+@param correct_answer correct answer
+@param answer user's answer
+@return 0 if the answers are the same, 1 otherwise
+*/
+int compare(char *correct_answer, char *answer) {
+    int diff, mistakes = 0;
+
+    /* while pointers are different than '\0' */
+    while (*correct_answer && *answer) {
+        diff = lower(*correct_answer) - lower(*answer);
+
+        if (diff != 0) {
+            mistakes++;
+            if (mistakes > 1) { return diff; }
+        }
+
+        correct_answer++;
+        answer++;
+    }
+    return lower(*correct_answer) - lower(*answer);
+}
+
+
+/*
+where a score goes in a leaderboard: the entry of its game, or the first free entry, or the last entry when the leaderboard is full
+@param board leaderboard
+@param score score
+@return index of the entry, -1 if the score does not change the leaderboard
+*/
+int leaderboard_position(Leaderboard *board, Score *score) {
+    int i;
+
+    for (i = 0; i < (*board).count && (*board).scores[i].game != (*score).game; i++);
+    if (i == TOP_K) { i--; }
+    if (i < (*board).count && (*score).score <= (*board).scores[i].score) { return -1; }
+    return i;
+}
+
+
+/*
+puts a score in a leaderboard and moves it up to its rank, ties keep the earlier score first
+@param board leaderboard
+@param score score
+@param i index given by leaderboard_position()
+*/
+void leaderboard_place(Leaderboard *board, Score *score, int i) {
+    if (i == (*board).count) { (*board).count++; }
+    for (; i > 0 && (*board).scores[i - 1].score < (*score).score; i--) { (*board).scores[i] = (*board).scores[i - 1]; }
+    (*board).scores[i] = *score;
+}
 
-#define MAX_CLIENTS 2
 
-#define BUF_PRS_SIZE 72
-#define BUF_ANS_SIZE 32
+/*
+offers the best score of a game to the leaderboard of the thread serving it, called on every graded answer,
+most of them leave the leaderboard as it is and never touch the seqlock
+@param session session of the game
+*/
+void leaderboard_update(Session *session) {
+    Leaderboard *board = (*session).board;
+    Score score;
+    int i;
+
+    memcpy(score.name, (*session).name, BUF_NAME_SIZE);
+    score.score = (*session).best;
+    score.game = (*session).game;
+    if ((i = leaderboard_position(board, &score)) == -1) { return; }
+
+    __atomic_store_n(&(*board).seq, (*board).seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); /* the odd sequence is visible before any entry changes */
+    leaderboard_place(board, &score, i);
+    __atomic_store_n(&(*board).seq, (*board).seq + 1, __ATOMIC_RELEASE);
+}
 
-#define LAST_QUESTION 'l'
-#define NEXT_QUESTION 'n'
-#define QUESTION 'q'
-#define PROCEED 'p'
-#define DISCARD 'd'
-#define ANSWER 'a'
-#define CLUE 'c'
-#define EXIT 'e'
 
-#define TO_INT(c) ((c) - '0')
+/*
+merges the leaderboards of every thread, each one copied again if its thread wrote it during the copy
+@param args common arguments of the threads
+@param merged stores the leaderboard of the server
+*/
+void leaderboard_merge(ServerClient *args, Leaderboard *merged) {
+    Leaderboard copy, *board;
+    unsigned long seq;
+    int i, j, position;
+
+    memset(merged, 0, sizeof(Leaderboard));
+    for (i = 0; i < METRIC_SLOTS; i++) {
+        board = &(*args).boards[i];
+        do {
+            seq = __atomic_load_n(&(*board).seq, __ATOMIC_ACQUIRE);
+            memcpy(&copy, board, sizeof(Leaderboard));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE); /* the copy is done before the sequence is read again */
+        } while ((seq & 1) || seq != __atomic_load_n(&(*board).seq, __ATOMIC_RELAXED));
+
+        for (j = 0; j < copy.count; j++) {
+            if ((position = leaderboard_position(merged, &copy.scores[j])) != -1) { leaderboard_place(merged, &copy.scores[j], position); }
+        }
+    }
+}
 
-int quit = 0;
 
+/*
+arms or cancels a timer of a session from a client thread
+@param args common arguments of the threads
+@param timer timer to arm or cancel
+@param ms milliseconds until it fires, 0 to cancel it
+@return 1 if the timer was armed before the call, 0 otherwise
+*/
+int session_timer(ServerClient *args, Timer *timer, int ms) {
+    int armed;
 
-typedef struct {
-    char *question, *answer, *clue;
-    int question_length, answer_length, clue_length;
-} Question;
+    pthread_mutex_lock((*args).wheel_mtx);
+    armed = (*timer).next != NULL;
+    if (ms) { timer_arm((*args).wheel, timer, ms); }
+    else { timer_cancel(timer); }
+    pthread_mutex_unlock((*args).wheel_mtx);
 
-typedef struct QuestionNode {
-    Question *question;
-    struct QuestionNode *next;
-} QuestionNode;
+    return armed;
+}
 
-typedef struct {
-    int id;
-    char *request_fifo_path, *response_fifo_path;
-} Client;
 
-typedef struct {
-    int *producer_ptr, *consumer_ptr, *count, *status;
-    pthread_mutex_t *mtx;
-    pthread_cond_t *producer_cond;
-    pthread_cond_t *consumer_cond;
-    Client **client;
-    QuestionNode **head;
-} ServerClient; 
+/*
+writes a response to the client, unless the question already timed out
+@param session session of the client
+@param frame frame of the bank: QUESTION, ANSWER or CLUE, so the client can tell it apart from a TIMEOUT verdict, then the string
+@param len length of the frame
+*/
+void respond(Session *session, char *frame, int len) {
+    long span = trace_begin();
+
+    pthread_mutex_lock(&(*session).write_mtx);
+    if (!(*session).timed_out && write((*session).response_fifo_fd, frame, len) > 0) { /* up to PIPE_BUF bytes, the write is atomic */
+        METRIC_ADD((*(*session).metrics).bytes_out, len);
+    }
+    pthread_mutex_unlock(&(*session).write_mtx);
+    trace_end("write", span, (*session).slot);
+}
 
 
+/*
+writes the leaderboard of the server to the client, one frame per score and an empty frame after the last one,
+whether the question timed out or not
+@param args common arguments of the threads
+@param session session of the client
+*/
+void respond_leaderboard(ServerClient *args, Session *session) {
+    char buf[BUF_TOP_SIZE];
+    int i, len = 0;
+    Leaderboard merged;
+
+    leaderboard_merge(args, &merged);
+    for (i = 0; i < merged.count; i++) {
+        len += sprintf(buf + len, "%c%d. %s %d", LEADERBOARD, i + 1, merged.scores[i].name, merged.scores[i].score) + 1;
+    }
+    buf[len++] = LEADERBOARD;
+    buf[len++] = '\0';
 
+    pthread_mutex_lock(&(*session).write_mtx);
+    if (write((*session).response_fifo_fd, buf, len) > 0) { METRIC_ADD((*(*session).metrics).bytes_out, len); } /* below PIPE_BUF, the write is atomic */
+    pthread_mutex_unlock(&(*session).write_mtx);
+}
 
 
-void sigint_handler() { quit = 1; }
+/*
+answers RESUME with the token of the game and its points, or with an empty frame if it has no token or its token did not resume a game
+@param session session of the client
+@param ok 0 if the token sent did not resume a game
+*/
+void respond_resume(Session *session, int ok) {
+    char frame[BUF_TOKEN_SIZE];
+    int len;
+
+    pthread_mutex_lock(&snapshots_mtx);
+    ok = ok && session_owns(session);
+    pthread_mutex_unlock(&snapshots_mtx);
+    if (ok) { len = sprintf(frame, "%c%016lx %d", RESUME, (*session).token, (*session).points) + 1; }
+    else { len = sprintf(frame, "%c", RESUME) + 1; }
+    respond(session, frame, len);
+}
 
-void sigpipe_handler() { signal(SIGPIPE, sigpipe_handler); }
 
+/*
+reads the next request of the client, the fifo is read a buffer at a time
+@param session session of the client
+@param c stores the request
+@return 1 on success, 0 if the client closed the fifo, -1 on error
+*/
+int read_request(Session *session, char *c) {
+    int n;
+
+    if ((*session).requests_start == (*session).requests_end) {
+        if ((n = read((*session).request_fifo_fd, (*session).requests, BUF_REQ_SIZE)) <= 0) { return n; }
+        METRIC_ADD((*(*session).metrics).bytes_in, n);
+        (*session).requests_start = 0;
+        (*session).requests_end = n;
+    }
+    *c = (*session).requests[(*session).requests_start++];
+    return 1;
+}
 
 
 /*
-frees all the memory allocated
-@param **head head of linked list
+reads the string that follows an ANSWER, PLAYER_NAME, JOIN or RESUME request, up to its null terminator
+@param session session of the client
+@param text stores the string, longer strings are cut to BUF_ANS_SIZE - 1 characters
+@return 0 on success, 1 if the client is gone
 */
-void clear(QuestionNode **head) {
-    QuestionNode *node;
+int read_text(Session *session, char *text) {
+    int i = 0;
+    char c;
 
-    while (*head != NULL) {
-        node = *head;
-        *head = (**head).next;
-        free((*(*node).question).question);
-        free((*(*node).question).answer);
-        free((*(*node).question).clue);
-        free((*node).question);
-        free(node);
-    }
+    do {
+        if (read_request(session, &c) != 1) { return 1; }
+        if (i < BUF_ANS_SIZE - 1) { text[i++] = c; }
+    } while (c != '\0');
+    text[i] = '\0';
+    return 0;
 }
 
 
 /*
-duplicates a string
-@param *src string to be duplicated
-@return pointer to a null-terminated string, which is a duplicate of the *src string
+scores a question of the session and offers the best score of the game to the leaderboard
+@param session session of the client
+@param correct 1 if the question was answered right, 0 if it was failed
 */
-char *duplicate(char *src) {
-    char *str, *p;
-    int len = 0;
+void grade(Session *session, int correct) {
+    if (correct) { (*session).points++; }
+    else { (*session).points--; }
+    if ((*session).points > (*session).best) { (*session).best = (*session).points; }
+    leaderboard_update(session);
+}
 
-    while (src[len]) { len++; }
-    str = malloc(len + 1);
-    p = str;
-    while (*src) { *(p++) = *(src++); }
-    *p = '\0';
 
-    return str;
+/*
+copies the name of a player or a room, it is sent to other players so it is kept to printable characters
+@param to stores the name
+@param from name sent by the client
+*/
+void copy_name(char *to, char *from) {
+    int i;
+
+    for (i = 0; from[i] && i < BUF_NAME_SIZE - 1; i++) { to[i] = (from[i] > ' ' && from[i] <= '~') ? from[i] : '_'; }
+    if (i > 0) { to[i] = '\0'; }
 }
 
 
 /*
-parses the next line from the database
-@param fd file descriptor of database
-@param buf buffer to store the information of the line
-@param len length of line
-@return 0 and line length if parsed successfully, 1 otherwise
+releases the current question to the members of the room waiting for it, once all of them are, called holding the lock of the room.
+the first question waits for the room to be full, or for ROOM_WAIT_MS
+@param room the room
 */
-int parse_line(int fd, char *buf, int *len) {
-    char c;
-    int n, count = 0, bytes = 0;
+void room_release(Room *room) {
+    int i;
 
-    while ((n = read(fd, &c, 1)) == 1 && c >= '0' && c <= '9') { 
-        bytes = (bytes * 10) + TO_INT(c);
-        count++;
+    if ((*room).ready < (*room).count || (*room).count == 0) { return; }
+    if ((*room).round == 0 && (*room).count < ROOM_SIZE && now_ns() - (*room).created < ROOM_WAIT_MS * 1000000L) { return; }
+
+    (*room).round++;
+    (*room).ready = 0;
+    __atomic_store_n(&(*room).winner, NULL, __ATOMIC_RELAXED);
+    for (i = 0; i < (*room).count; i++) {
+        if ((*(*room).members[i]).room_state == ROOM_WAITING) { (*(*room).members[i]).room_state = ROOM_PLAYING; }
     }
-    if (n != 1) { /* EOF */
-        close(fd);
-        return 1;
+    pthread_cond_broadcast(&(*room).cond);
+}
+
+
+/*
+waits until every member of the room asked for the current question,
+or until the client is discarded for being idle, which the timer thread marks with timed_out
+@param session session of the member
+*/
+void room_wait(Session *session) {
+    Room *room = (*session).room;
+    struct timespec until;
+
+    pthread_mutex_lock(&(*room).mtx);
+    (*session).room_state = ROOM_WAITING;
+    (*room).ready++;
+    room_release(room);
+    while ((*session).room_state == ROOM_WAITING && !__atomic_load_n(&(*session).timed_out, __ATOMIC_RELAXED)) {
+        /* woken every tick, so a room that is not full starts on time and a discarded member stops waiting */
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += TICK_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&(*room).cond, &(*room).mtx, &until);
+        room_release(room);
     }
-    if (!count) {
-        printf("database is not formatted: line needs to start with its size\n");
-        close(fd);
-        return 1;
+    if ((*session).room_state == ROOM_WAITING) { /* discarded, the others no longer wait for the member */
+        (*session).room_state = ROOM_IDLE;
+        (*room).ready--;
     }
-    buf[0] = c;
-    read(fd, buf + 1, bytes); /* newline included */
-    buf[bytes] = '\0';
+    pthread_mutex_unlock(&(*room).mtx);
+}
 
-    *len = bytes;
 
-    return 0;
+/* chains every room of the pool into the free rooms, called before the client threads start */
+void rooms_init() {
+    int i;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        pthread_mutex_init(&room_pool[i].mtx, NULL);
+        pthread_cond_init(&room_pool[i].cond, NULL);
+        room_pool[i].next = free_rooms;
+        free_rooms = &room_pool[i];
+    }
 }
 
 
 /*
-parses the database
-@param head head of linked list
-@return 0 if parsed successfully, 1 otherwise
+puts the player in the room of that name that has not started yet, a new one if there is none
+@param session session of the player
+@param name name of the room
 */
-int parser(QuestionNode **head) {
-    int fd, len;
-    char buf[BUF_PRS_SIZE];
+void room_join(Session *session, char *name) {
+    Room *room;
+
+    pthread_mutex_lock(&rooms_mtx);
+    for (room = rooms; room != NULL; room = (*room).next) {
+        if (strcmp((*room).name, name) != 0) { continue; }
+        pthread_mutex_lock(&(*room).mtx);
+        if ((*room).round == 0 && (*room).count < ROOM_SIZE) { break; } /* joined holding the lock of the room */
+        pthread_mutex_unlock(&(*room).mtx);
+    }
+    if (room == NULL) {
+        if ((room = free_rooms) == NULL) { /* the player plays alone */
+            pthread_mutex_unlock(&rooms_mtx);
+            return;
+        }
+        free_rooms = (*room).next;
+        memset(room, 0, offsetof(Room, mtx));
+        strcpy((*room).name, name);
+        (*room).created = now_ns();
+        (*room).next = rooms;
+        rooms = room;
+        pthread_mutex_lock(&(*room).mtx);
+    }
 
-    if ((fd = open(DATABASE_PATH, O_RDONLY)) == -1) {
-        printf("failed to open database\n");
-        return 1;
+    (*room).members[(*room).count++] = session;
+    (*session).room = room;
+    log_message(LOG_INFO, "player %s joined room %s (%d/%d)", (*session).name, name, (*room).count, ROOM_SIZE);
+    pthread_mutex_unlock(&(*room).mtx);
+    pthread_mutex_unlock(&rooms_mtx);
+}
+
+
+/*
+takes the player out of their room, which goes on without them, and gives the room back to the pool once it is empty
+@param session session of the player
+*/
+void room_leave(Session *session) {
+    Room *room = (*session).room, **link;
+    int i;
+
+    if (room == NULL) { return; }
+
+    pthread_mutex_lock(&rooms_mtx);
+    pthread_mutex_lock(&(*room).mtx);
+    for (i = 0; (*room).members[i] != session; i++);
+    (*room).members[i] = (*room).members[--(*room).count];
+    if ((*session).room_state == ROOM_WAITING) { (*room).ready--; }
+    (*session).room = NULL;
+
+    if ((*room).count > 0) {
+        room_release(room); /* the others may have been waiting only for them */
+        pthread_mutex_unlock(&(*room).mtx);
+        pthread_mutex_unlock(&rooms_mtx);
+        return;
     }
-    while (1) {  /* we will parse 3 lines in each iteration, until we reach EOF */
-        Question *q = malloc(sizeof(Question));
-        QuestionNode *node = malloc(sizeof(QuestionNode));
+    for (link = &rooms; *link != room; link = &(**link).next);
+    *link = (*room).next;
+    pthread_mutex_unlock(&(*room).mtx);
+    (*room).next = free_rooms;
+    free_rooms = room;
+    pthread_mutex_unlock(&rooms_mtx);
+}
 
-        if (q == NULL || node == NULL) {
-            printf("memory error\n");
-            clear(head);
-            close(fd);
-            return 1;
+
+/*
+announces the first right answer of the question to every member of the room: the WINNER frame is formatted once and the
+thread of the winner writes the same bytes to every member, under the lock of the room so none of them leaves meanwhile
+@param room the room
+@param winner session of the player who answered first
+*/
+void room_announce(Room *room, Session *winner) {
+    char frame[BUF_NAME_SIZE + 1];
+    int i, len = sprintf(frame, "%c%s", WINNER, (*winner).name) + 1;
+    Session *member;
+
+    pthread_mutex_lock(&(*room).mtx);
+    for (i = 0; i < (*room).count; i++) {
+        member = (*room).members[i];
+        pthread_mutex_lock(&(*member).write_mtx);
+        if (write((*member).response_fifo_fd, frame, len) > 0) { METRIC_ADD((*(*member).metrics).bytes_out, len); } /* below PIPE_BUF, the write is atomic */
+        pthread_mutex_unlock(&(*member).write_mtx);
+    }
+    pthread_mutex_unlock(&(*room).mtx);
+}
+
+
+/*
+discards the client of a session and makes its thread drop the session, called holding the wheel lock
+@param session session to discard
+@param metrics slot of the calling thread
+*/
+void session_discard(Session *session, Metrics *metrics) {
+    char c = DISCARD;
+    int fd;
+
+    pthread_mutex_lock(&(*session).write_mtx);
+    __atomic_store_n(&(*session).timed_out, 1, __ATOMIC_RELAXED); /* also read by room_wait() without the lock */
+    if (write((*session).response_fifo_fd, &c, 1) == 1) { METRIC_ADD((*metrics).bytes_out, 1); }
+    pthread_mutex_unlock(&(*session).write_mtx);
+
+    /* the thread of the session is blocked reading the request fifo, an EXIT written there ends the session */
+    if ((fd = open((*session).request_fifo_path, O_WRONLY | O_NONBLOCK)) != -1) {
+        c = EXIT;
+        write(fd, &c, 1);
+        close(fd);
+    }
+}
+
+
+/*
+handles a timer that fired, called by the timer thread holding the wheel lock:
+a question deadline sends the TIMEOUT verdict, an idle timeout discards the client and makes its thread drop the session
+@param timer timer that fired
+@param metrics slot of the timer thread
+*/
+void handle_timer(Timer *timer, Metrics *metrics) {
+    Session *session;
+    char c = TIMEOUT;
+    long span = trace_begin();
+
+    if ((*timer).kind == TIMER_IDLE) {
+        session = (Session *)((char *)timer - offsetof(Session, idle));
+        session_discard(session, metrics);
+        trace_end("discard", span, (*session).slot);
+        return;
+    }
+
+    session = (Session *)((char *)timer - offsetof(Session, deadline));
+    pthread_mutex_lock(&(*session).write_mtx);
+    __atomic_store_n(&(*session).timed_out, 1, __ATOMIC_RELAXED); /* also read by room_wait() without the lock */
+    if (write((*session).response_fifo_fd, &c, 1) == 1) { METRIC_ADD((*metrics).bytes_out, 1); }
+    pthread_mutex_unlock(&(*session).write_mtx);
+    trace_end("timeout", span, (*session).slot);
+    METRIC_ADD((*metrics).timeouts, 1);
+}
+
+
+/* drives the timer wheel: every tick, the question deadlines and idle timeouts that are due are fired */
+void *run_timers(void *timer_args) {
+    ServerClient *args = (ServerClient *)timer_args;
+    struct timespec next;
+    Timer expired, *timer;
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    log_attach(SLOT_TIMERS);
+    trace_attach(SLOT_TIMERS);
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    /* only stopped once every client thread returned, the sessions they drop on the way out may still wait for a tick */
+    while (__atomic_load_n((*args).status, __ATOMIC_ACQUIRE) != STATUS_STOPPED) {
+        next.tv_nsec += TICK_MS * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
         }
-        
-        /* parse line (Question) - will return 1 if EOF is reached */
-        if (parse_line(fd, buf, &len)) {
-            free(q);
-            free(node);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        pthread_mutex_lock((*args).wheel_mtx);
+
+        expired.next = &expired;
+        expired.prev = &expired;
+        wheel_advance((*args).wheel, current_tick(), &expired);
+
+        while ((timer = expired.next) != &expired) {
+            expired.next = (*timer).next;
+            (*(*timer).next).prev = &expired;
+            (*timer).next = NULL;
+            (*timer).prev = NULL;
+            handle_timer(timer, &(*args).metrics[SLOT_TIMERS]);
+        }
+
+        pthread_mutex_unlock((*args).wheel_mtx);
+        pool_sweep((*args).pool);
+    }
+    return NULL;
+}
+
+
+/*
+serves one client until it leaves, reading their requests and responding to them
+@param args common arguments of the threads
+@param session session of the client, with its fifos open
+*/
+void serve_client(ServerClient *args, Session *session) {
+    int n, kind;
+    char text[BUF_ANS_SIZE];
+    unsigned long token;
+    int asked = 0; /* a question was asked, the player can no longer join a room */
+    Session *none;
+    long start, elapsed;
+    QuestionNode *node = (*session).adaptive ? session_draw(session) : *((*args).head);
+    Metrics *metrics = (*session).metrics;
+
+    session_timer(args, &(*session).idle, IDLE_TIMEOUT_MS);
+
+    while (node != NULL) {
+        char c;
+        int next_question = 0;
+        int done = 0;
+        int graded = 0;
+        int correct;
+        int released = 0; /* the room released the question to the player */
+        QuestionNode *resumed = NULL; /* the game of a token goes on from this question instead */
+        Question *q = (*node).question;
+
+        /* 1. the server starts by writing the status of the question, i.e.,
+                if we are not in the last question (PROCEED), or
+                if we are in the last question (LAST_QUESTION), or exceptionally,
+                if the server has to terminate because of SIGINT (DISCARD)
+        */
+        if ((*session).adaptive ? (*session).position == game_questions() - 1 : (*node).next == NULL) { c = LAST_QUESTION; }
+        else { c = PROCEED; }
+        session_save(session, node, 0);
+
+        start = trace_begin();
+        pthread_mutex_lock(&(*session).write_mtx);
+        (*session).timed_out = 0;
+        (*session).question_sent = 0;
+        n = write((*session).response_fifo_fd, &c, 1); /* if client has finished, a sigpipe will be throwed */
+        pthread_mutex_unlock(&(*session).write_mtx);
+        trace_end("write", start, (*session).slot);
+        if (n == 1) { METRIC_ADD((*metrics).bytes_out, 1); }
+
+        if (n == -1) {
+            log_message(LOG_WARN, "write error: the response fifo appears to be broken. is the client finished?");
             break;
         }
-        (*q).question = duplicate(buf);
-        (*q).question_length = len;
-        
-        /* parse line (Answer) */
-        parse_line(fd, buf, &len);
-        (*q).answer = duplicate(buf);
-        (*q).answer_length = len;
 
-        /* parse line (Clue) */
-        parse_line(fd, buf, &len);
-        (*q).clue = duplicate(buf);
-        (*q).clue_length = len;
+        while ((n = read_request(session, &c)) == 1) { /* 2. server reads the client requests for this question */
+            start = now_ns();
+            if ((c == ANSWER || c == PLAYER_NAME || c == JOIN || c == RESUME) && read_text(session, text)) { /* the client is gone in the middle of the request */
+                n = 0;
+                break;
+            }
+            session_timer(args, &(*session).idle, IDLE_TIMEOUT_MS);
+
+            switch (c) {
+                case QUESTION:
+                    /* a member of a room gets the question once every member asked for it, a discarded one never does */
+                    if ((*session).room != NULL && !released) {
+                        room_wait(session);
+                        released = 1;
+                    }
+                    respond(session, (*q).question, (*q).question_length);
+                    METRIC_ADD((*metrics).questions, 1);
+                    asked = 1;
+                    pthread_mutex_lock((*args).wheel_mtx);
+                    if ((*session).deadline.next == NULL && !(*session).timed_out) { timer_arm((*args).wheel, &(*session).deadline, QUESTION_TIMEOUT_MS); }
+                    pthread_mutex_unlock((*args).wheel_mtx);
+                    if ((*session).question_sent == 0) {
+                        (*session).question_sent = now_ns();
+                        METRIC_ADD((*q).stats.served, 1);
+                    }
+                    break;
+                
+                case ANSWER:
+                    /* once cancelled, no TIMEOUT can follow the answer, an answer after the TIMEOUT is not timed */
+                    correct = 0;
+                    if (session_timer(args, &(*session).deadline, 0) && (*session).question_sent) {
+                        elapsed = now_ns() - (*session).question_sent;
+                        record_answer(q, elapsed);
+                        correct = compare((*q).answer + 1, text) == 0;
+                        grade(session, correct); /* only the first answer is graded */
+                        session_graded(session, q, correct, elapsed / 1000000);
+                        (*session).answered++;
+                        graded = 1;
+                        session_save(session, node, graded);
+                    }
+                    (*session).question_sent = 0;
+                    respond(session, (*q).answer, (*q).answer_length);
+                    METRIC_ADD((*metrics).answers, 1);
+                    /* the first right answer of a room wins the question, announced after the verdict of the winner */
+                    none = NULL;
+                    if (correct && (*session).room != NULL &&
+                        __atomic_compare_exchange_n(&(*(*session).room).winner, &none, session, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                        room_announce((*session).room, session);
+                    }
+                    break;
+                
+                case CLUE:
+                    respond(session, (*q).clue, (*q).clue_length);
+                    METRIC_ADD((*metrics).clues, 1);
+                    METRIC_ADD((*q).stats.clues, 1);
+                    selector_update(q);
+                    (*session).clues++;
+                    session_save(session, node, graded);
+                    break;
+                
+                case NEXT_QUESTION:
+                    session_timer(args, &(*session).deadline, 0);
+                    /* the timer thread set timed_out holding the wheel lock, which session_timer() took after it */
+                    if ((*session).timed_out && !graded) {
+                        grade(session, 0);
+                        session_graded(session, q, 0, QUESTION_TIMEOUT_MS);
+                    }
+                    next_question = 1; /* so we can exit the inner loop that reads customer requests, and move on to the next question */
+                    break;
+                
+                case EXIT: 
+                    next_question = 1;
+                    done = 1;
+                    (*session).finished = 1;
+                    break;; /* the client has finished */
+
+                case PLAYER_NAME:
+                    copy_name((*session).name, text);
+                    /* a returning player gets the questions it has due first, even the first one if it was not asked yet */
+                    if ((*session).adaptive && (*session).reviews == NULL && ((*session).reviews = reviews_join((*session).name)) != NULL &&
+                        !asked && review_due((*session).reviews) != NULL) {
+                        node = session_draw(session);
+                        q = (*node).question;
+                    }
+                    session_save(session, node, graded);
+                    break;
+
+                case JOIN:
+                    /* only before the first question, the members of a room have to be at the same question */
+                    if ((*session).room == NULL && !asked && text[0]) {
+                        char name[BUF_NAME_SIZE];
+
+                        copy_name(name, text);
+                        room_join(session, name);
+                        /* the members of a room play the same questions, in the order of the bank */
+                        if ((*session).room != NULL && (*session).adaptive) {
+                            (*session).adaptive = 0;
+                            node = *((*args).head);
+                            q = (*node).question;
+                        }
+                        if ((*session).room != NULL) { session_forget(session); } /* it follows the other members, its game cannot be put aside */
+                    }
+                    break;
 
-        (*node).question = q;
+                case LEADERBOARD:
+                    respond_leaderboard(args, session);
+                    break;
 
-        /* insert node in the beginning of linked list */
-        (*node).next = *head;
-        *head = node;
+                case RESUME:
+                    /* an empty string gives the game a resume token, a token takes up its game before the first question. a room does not wait for a game put aside */
+                    if ((*session).room == NULL) {
+                        if (text[0] == '\0') { session_token(session, node, graded); }
+                        else if (!asked && sscanf(text, "%lx", &token) == 1 && token != 0) { resumed = session_restore(session, token); }
+                    }
+                    respond_resume(session, text[0] == '\0' || resumed != NULL);
+                    if (resumed != NULL) {
+                        log_message(LOG_INFO, "resumed game %lu", (*session).game);
+                        node = resumed;
+                        next_question = 1; /* the status of the question the game goes on with is written next */
+                    }
+                    break;
+            }
+            elapsed = now_ns() - start;
+            record_latency(metrics, elapsed);
+            if ((kind = request_kind(c)) != -1) { hdr_record(&(*metrics).service[kind], elapsed); }
+            trace_end(request_name(c), start, (*session).slot);
+            if (next_question) { break; } /* exit the inner loop */
+        }
+        if (done) { break; }
+        if (n == 0) { /* if the client has finished! */
+            log_message(LOG_WARN, "read error: the request fifo appears to be broken. is the client finished?");
+            break;
+        }
+        if (resumed != NULL) { continue; }
+        if (!(*session).adaptive) { node = (*node).next; }
+        else if ((*session).position == game_questions() - 1) { node = NULL; }
+        else {
+            (*session).position++;
+            node = session_draw(session);
+        }
+        if (node == NULL) { (*session).finished = 1; }
     }
-    return 0;
+
+    /* after this, the timer thread no longer knows about the session */
+    session_timer(args, &(*session).deadline, 0);
+    session_timer(args, &(*session).idle, 0);
 }
 
 
 /* deals with one client in one thread, reading their requests and responding to them */
 void *handle_client(void *client_args) {
-    Client *c;
+    Client c;
+    Session session;
+    int slot;
+    long span;
     ServerClient *args = (ServerClient *)client_args;
+    int worker = __atomic_fetch_add((*args).workers, 1, __ATOMIC_RELAXED);
+    Metrics *metrics = &(*args).metrics[worker];
 
 	sigset_t mask; // represents a set of signals to block in this thread
 	sigemptyset(&mask); // initialize the set to an empty set
 	sigaddset(&mask, SIGINT); // add the SIGUSR1 signal to the set
 	pthread_sigmask(SIG_BLOCK, &mask, NULL); // block the SIGUSR1 signal in this thread
 
-    printf("thread lauched\n");
+    log_attach(worker);
+    trace_attach(worker);
+
+    log_message(LOG_INFO, "thread lauched");
 
     while (1) {
         if (args == NULL) { continue; }
 
         pthread_mutex_lock((*args).mtx);
 
-        while (*((*args).count) == 0) {
-            printf("thread(unknown) will wait, buffer empty!\n");
+        while (*((*args).count) == 0 && *((*args).status) == STATUS_RUNNING) {
+            log_message(LOG_DEBUG, "thread will wait, buffer empty!");
             pthread_cond_wait((*args).consumer_cond, (*args).mtx);
         }
+        if (*((*args).count) == 0) { /* the server terminates and no client is left waiting */
+            pthread_mutex_unlock((*args).mtx);
+            break;
+        }
 
-        printf("thread will proceed, buffer not empty!\n");
+        log_message(LOG_DEBUG, "thread will proceed, buffer not empty!");
 
-        c = (*args).client[*((*args).consumer_ptr)]; /* retrieve client */
+        c = (*args).client[*((*args).consumer_ptr)]; /* retrieve client, copied out so its place can be reused */
         
         *((*args).consumer_ptr) += 1;
         if (*((*args).consumer_ptr) == MAX_CLIENTS) { *((*args).consumer_ptr) = 0; }
@@ -223,117 +3326,160 @@ void *handle_client(void *client_args) {
 
         pthread_mutex_unlock((*args).mtx);
 
-        if (c == NULL) { continue; }
-        else {
-            int n, request_fifo_fd, response_fifo_fd;
-            QuestionNode *node = *((*args).head);
-
-            printf("thread identified <%s><%s><%d> and will start!\n", (*c).request_fifo_path, (*c).response_fifo_path, (*c).id);
-
-            request_fifo_fd = open((*c).request_fifo_path, O_RDONLY);
-            response_fifo_fd = open((*c).response_fifo_path, O_WRONLY);
-
-            free((*c).request_fifo_path);
-            free((*c).response_fifo_path);
-            free(c);
-
-            while (node != NULL) {
-                char c;
-                int next_question = 0;
-                int done = 0;
-
-                /* 1. the server starts by writing the status of the question, i.e.,
-                        if we are not in the last question (PROCEED), or
-                        if we are in the last question (LAST_QUESTION), or exceptionally,
-                        if the server has to terminate because of SIGINT (DISCARD)
-                */
-                if ((*node).next == NULL) { c = LAST_QUESTION; }
-                else { c = PROCEED; }
-
-                n = write(response_fifo_fd, &c, 1); /* if client has finished, a sigpipe will be throwed */
-                
-                if (n == -1) {
-                    printf("write error: the response fifo appears to be broken. is the client finished?\n");
-                    break;
-                }
-
-                while ((n = read(request_fifo_fd, &c, 1)) == 1) { /* 2. server reads the client requests for this question */
-                    switch (c) {
-                        case QUESTION:
-                            write(response_fifo_fd, (*(*node).question).question, (*(*node).question).question_length + 1);
-                            break;
-                        
-                        case ANSWER:
-                            write(response_fifo_fd, (*(*node).question).answer, (*(*node).question).answer_length + 1);
-                            break;
-                        
-                        case CLUE:
-                            write(response_fifo_fd, (*(*node).question).clue, (*(*node).question).clue_length + 1);
-                            break;
-                        
-                        case NEXT_QUESTION:
-                            next_question = 1; /* so we can exit the inner loop that reads customer requests, and move on to the next question */
-                            break;
-                        
-                        case EXIT: 
-                            next_question = 1;
-                            done = 1;
-                            break;; /* the client has finished */
-                    }
-                    if (next_question) { break; } /* exit the inner loop */
-                }
-                if (done) { break; }
-                if (n == 0) { /* if the client has finished! */
-                    printf("read error: the request fifo appears to be broken. is the client finished?\n");
-                    break;
-                }
-                node = (*node).next;
-            }
-            printf("thread has finished one client\n");
-            close(request_fifo_fd);
-            close(response_fifo_fd);
+        slot = c.slot;
+        span = trace_begin();
+
+        log_message(LOG_INFO, "thread identified <%d><%d> and will start!", slot, c.id);
+
+        trace_end("queued", c.registered, slot); /* from registration to a thread taking the client */
+
+        memset(&session, 0, sizeof(Session));
+        pthread_mutex_init(&session.write_mtx, NULL);
+        session.deadline.kind = TIMER_DEADLINE;
+        session.idle.kind = TIMER_IDLE;
+        session.metrics = metrics;
+        session.board = &(*args).boards[worker];
+        session.points = session.best = START_POINTS;
+        session.game = ((unsigned long)worker << 32) + METRIC_GET((*metrics).sessions_opened); /* unique across the threads */
+        strcpy(session.name, "anonymous"); /* until the client sends the name of the player */
+        session.opened = now_ns();
+        session.slot = slot;
+        session.snapshot = -1;
+        if (selector.order != NULL) {
+            session.adaptive = 1;
+            session.level = START_LEVEL;
+            session.seed = (session.game * 0x9E3779B97F4A7C15UL) ^ session.opened;
+            if (session.seed == 0) { session.seed = 1; }
         }
+        session.request_fifo_path = (*(*args).pool).request_fifo_paths[slot];
+        session.request_fifo_fd = open(session.request_fifo_path, O_RDONLY);
+        session.response_fifo_fd = open((*(*args).pool).response_fifo_paths[slot], O_WRONLY);
+        trace_end("open", span, slot);
+
+        /* from here the session is discarded with the others if the server terminates, or at once if it already does */
+        pthread_mutex_lock((*args).wheel_mtx);
+        (*args).live[worker] = &session;
+        if (__atomic_load_n((*args).status, __ATOMIC_ACQUIRE) != STATUS_RUNNING) { session_discard(&session, metrics); }
+        pthread_mutex_unlock((*args).wheel_mtx);
+
+        METRIC_ADD((*metrics).sessions_opened, 1);
+        span = trace_begin();
+        serve_client(args, &session);
+        pthread_mutex_lock((*args).wheel_mtx);
+        (*args).live[worker] = NULL;
+        pthread_mutex_unlock((*args).wheel_mtx);
+        room_leave(&session);
+        trace_end("session", span, slot);
+        /* a game put aside keeps its snapshot and is recorded once it ends, in the session that resumed it */
+        if (session.finished) { session_forget(&session); }
+        if (session.token == 0 || session.finished || (snapshots.path == NULL && __atomic_load_n((*args).status, __ATOMIC_ACQUIRE) != STATUS_RUNNING)) { journal_append(&session); }
+        if (session.reviews != NULL) { reviews_flush(); }
+        METRIC_ADD((*metrics).sessions_closed, 1);
+
+        log_message(LOG_INFO, "thread has finished one client");
+        pthread_mutex_destroy(&session.write_mtx);
+        retire_slot((*args).pool, slot, session.request_fifo_fd, session.response_fifo_fd); /* the next client of this slot never talks to this thread */
     }
-}
 
+    log_message(LOG_INFO, "thread stopped");
+    return NULL;
+}
 
 
 
 
 int main(int argc, char **argv) {
-    char *request_fifo_path, *response_fifo_path;
-    int i, register_fifo_fd, len, producer_ptr = 0, consumer_ptr = 0, count = 0, status = 0;
-    QuestionNode *linked_list_questions_head = NULL;
+    int i, questions = 0, register_fifo_fd, slot, producer_ptr = 0, consumer_ptr = 0, count = 0, status = 0, workers = 0, opt, adaptive = 0, snapshot = 0, wrong = 0, full;
+    char *stats_path, *journal_path, *reviews_path, *snapshots_path = NULL;
+    QuestionNode *linked_list_questions_head = NULL, *node;
 	pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 	pthread_cond_t producer_cond = PTHREAD_COND_INITIALIZER;
 	pthread_cond_t consumer_cond = PTHREAD_COND_INITIALIZER;
-    pthread_t threads[MAX_CLIENTS];
-    Client *buffer[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS], timer_thread, stats_thread;
+    Session *live[MAX_CLIENTS] = { NULL };
+	pthread_mutex_t wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+    TimerWheel wheel;
+    Client buffer[MAX_CLIENTS];
+    FifoPool pool;
+    Metrics *metrics;
+    Leaderboard *boards;
     ServerClient *common_arguments;
+    struct sigaction sa;
+
 
+    /*
+    -a draws the questions of every game by difficulty instead of sending them in the order of the bank,
+    -s keeps the snapshots of the games in <register-fifo>.snapshots, so they can be resumed after a restart,
+    -Q sheds the registrations that find that many clients waiting for a thread, -L those that find the first one waiting for longer than that many milliseconds
+    */
+    while ((opt = getopt(argc, argv, "asQ:L:")) != -1) {
+        if (opt == 'a') { adaptive = 1; }
+        else if (opt == 's') { snapshot = 1; }
+        else if (opt == 'Q') { admission.depth = atoi(optarg); }
+        else if (opt == 'L') { admission.target_ns = atol(optarg) * 1000000L; }
+        else { wrong = 1; }
+    }
+    if (wrong || (argc - optind != 1 && argc - optind != 2) || admission.depth < 0 || admission.depth > MAX_CLIENTS || admission.target_ns < 0) {
+        printf("usage: %s [-a] [-s] [-Q max-waiting (at most %d)] [-L max-wait-ms] <register-fifo> [database-path]\n", argv[0], MAX_CLIENTS);
+        return 1;
+    }
+    if (getrandom(&admission.seed, sizeof(admission.seed), 0) != sizeof(admission.seed)) { admission.seed = (unsigned long)now_ns() * 0x9E3779B97F4A7C15UL; }
+    if (admission.seed == 0) { admission.seed = 1; }
+    argv += optind - 1; /* the fifo path is argv[1] from here on, and the database argv[2] */
+    argc -= optind - 1;
 
-    if (argc != 2) {
-        printf("usage: %s <register-fifo>\n", argv[0]);
+    /* another database, e.g. a large one written by the generator, can be given instead of the default */
+    if (parser(&linked_list_questions_head, argc == 3 ? argv[2] : DATABASE_PATH)) {
+        printf("failed to parse the database\n");
         return 1;
     }
+    for (node = linked_list_questions_head; node != NULL; node = (*node).next) { questions++; }
+    printf("database was parsed successfully: %d questions, %ld KiB resident\n", questions, resident_kib());
+    if (bank_index(linked_list_questions_head, questions)) {
+        clear(&linked_list_questions_head);
+        printf("memory error\n");
+        return 1;
+    }
+    if (adaptive && questions > 0) {
+        if (selector_init(linked_list_questions_head, questions)) {
+            clear(&linked_list_questions_head);
+            printf("memory error\n");
+            return 1;
+        }
+        printf("games of %d questions drawn by difficulty\n", game_questions());
+    }
 
     if (mkfifo(argv[1], 0666) == -1) {
         printf("failed to create register fifo\n");
         return 1;
     }
 
-    if ((register_fifo_fd = open(argv[1], O_RDONLY)) == -1) {
+    /* opened for reading and writing, so that read() blocks instead of returning EOF whenever no client is registering */
+    if ((register_fifo_fd = open(argv[1], O_RDWR)) == -1) {
         printf("failed to open the register fifo\n");
         return 1;
     }
 
-    if (parser(&linked_list_questions_head)) {
-        printf("failed to parse the database\n");
+    if (create_pool(&pool, argv[1])) {
+        printf("failed to create the fifo pool\n");
+        return 1;
+    }
+
+    stats_path = pool_path(argv[1], "stats", -1);
+    journal_path = pool_path(argv[1], "journal", -1);
+    metrics = aligned_alloc(64, METRIC_SLOTS * sizeof(Metrics));
+    boards = aligned_alloc(64, METRIC_SLOTS * sizeof(Leaderboard));
+    if (stats_path == NULL || journal_path == NULL || metrics == NULL || boards == NULL) {
+        printf("memory error\n");
         return 1;
     }
-    printf("database was parsed successfully\n");
+    memset(metrics, 0, METRIC_SLOTS * sizeof(Metrics));
+    memset(boards, 0, METRIC_SLOTS * sizeof(Leaderboard));
 
-    signal(SIGINT, sigint_handler);
+    /* no SA_RESTART, a SIGINT has to interrupt the blocking read of the register fifo */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigint_handler;
+    sigaction(SIGINT, &sa, NULL);
     signal(SIGPIPE, sigpipe_handler);
 
     common_arguments = malloc(sizeof(ServerClient));
@@ -346,45 +3492,93 @@ int main(int argc, char **argv) {
     (*common_arguments).mtx = &mutex;
     (*common_arguments).client = buffer;
     (*common_arguments).head = &linked_list_questions_head;
+    (*common_arguments).pool = &pool;
+    (*common_arguments).wheel = &wheel;
+    (*common_arguments).wheel_mtx = &wheel_mutex;
+    (*common_arguments).metrics = metrics;
+    (*common_arguments).boards = boards;
+    (*common_arguments).workers = &workers;
+    (*common_arguments).live = live;
+
+    if (((*common_arguments).stats_fd = stats_listener(stats_path)) == -1) { printf("failed to create the stats socket, running without it\n"); }
+    else { pthread_create(&stats_thread, NULL, run_stats, common_arguments); }
+
+    if (log_start()) {
+        printf("failed to start the log writer\n");
+        return 1;
+    }
+    log_attach(SLOT_REGISTRATION);
+
+    if (trace_start()) {
+        printf("memory error\n");
+        return 1;
+    }
+    trace_attach(SLOT_REGISTRATION);
+
+    if (journal_start(journal_path)) {
+        printf("failed to open the journal\n");
+        return 1;
+    }
+
+    /* the review state of the players is kept next to the journal, games drawn by difficulty serve the questions due first */
+    reviews_path = pool_path(argv[1], "reviews", -1);
+    if (selector.order != NULL && (reviews_path == NULL || reviews_start(reviews_path, linked_list_questions_head, questions))) {
+        printf("failed to open the review store\n");
+        return 1;
+    }
+
+    if ((snapshot && (snapshots_path = pool_path(argv[1], "snapshots", -1)) == NULL) || snapshots_start(snapshots_path)) {
+        printf("failed to open the snapshots\n");
+        return 1;
+    }
 
+    wheel_init(&wheel, current_tick());
+    pthread_create(&timer_thread, NULL, run_timers, common_arguments);
+
+    rooms_init();
     for (i = 0; i < MAX_CLIENTS; i++) { pthread_create(&threads[i], NULL, handle_client, common_arguments); }
 
     while (1) {
         if (quit) { break; }
-        if((read(register_fifo_fd, &len, sizeof(int))) == sizeof(int)) {
-            Client *new_client = malloc(sizeof(Client));
+        if((read(register_fifo_fd, &slot, sizeof(int))) == sizeof(int)) {
+            long span = trace_begin();
 
-            if (len == 11) {
-                printf("received code from client to terminate server\n");
-                free(new_client);
+            if (slot == TERMINATE) {
+                log_message(LOG_INFO, "received code from client to terminate server");
                 break;
             }
+            if (slot < 0 || slot >= POOL_SIZE) {
+                log_message(LOG_WARN, "ignoring registration of unknown slot %d", slot);
+                continue;
+            }
 
-            printf("registering client...\n");
-
-            request_fifo_path = malloc(len + 1);
-            read(register_fifo_fd, request_fifo_path, len);
-            request_fifo_path[len] = '\0';
-
-            read(register_fifo_fd, &len, sizeof(int));
-            response_fifo_path = malloc(len + 1);
-            read(register_fifo_fd, response_fifo_path, len);
-            response_fifo_path[len] = '\0';
-
-            (*new_client).request_fifo_path = request_fifo_path;
-            (*new_client).response_fifo_path = response_fifo_path;
+            log_message(LOG_DEBUG, "registering client...");
 
             pthread_mutex_lock(&mutex);
 
+            /* with limits the client is told at once to come back later rather than wait behind the others */
+            full = admission.depth > 0 && count >= admission.depth;
+            if (full || (admission.target_ns > 0 && count > 0 && now_ns() - buffer[consumer_ptr].registered > admission.target_ns)) {
+                if (full) { METRIC_ADD(metrics[SLOT_REGISTRATION].shed_full, 1); }
+                else { METRIC_ADD(metrics[SLOT_REGISTRATION].shed_lag, 1); }
+                pthread_mutex_unlock(&mutex);
+                log_message(LOG_INFO, "client of slot %d shed, %d waiting", slot, count);
+                shed_client(&pool, slot, ADMISSION_RETRY_MS + (int)(next_random(&admission.seed) % ADMISSION_RETRY_MS));
+                trace_end("shed", span, slot);
+                continue;
+            }
+
             while (count == MAX_CLIENTS) {
-                printf("server is full at the moment, please wait!\n");
+                log_message(LOG_WARN, "server is full at the moment, please wait!");
                 pthread_cond_wait(&producer_cond, &mutex);
             }
 
-            (*new_client).id = producer_ptr;
+            buffer[producer_ptr].slot = slot;
+            buffer[producer_ptr].id = producer_ptr;
+            buffer[producer_ptr].registered = now_ns(); /* the wait for a free place is not part of the queue */
 
-            buffer[producer_ptr] = new_client;
-            printf("client registered! <%s><%s><%d>\n", request_fifo_path, response_fifo_path, producer_ptr);
+            log_message(LOG_INFO, "client registered! <%d><%d>", slot, producer_ptr);
+            METRIC_ADD(metrics[SLOT_REGISTRATION].registrations, 1);
 
             producer_ptr++;
             if (producer_ptr == MAX_CLIENTS) { producer_ptr = 0; }
@@ -394,10 +3588,44 @@ int main(int argc, char **argv) {
             pthread_cond_signal(&consumer_cond);
 
             pthread_mutex_unlock(&mutex);
+            trace_end("register", span, slot);
         }
     }
 
-    status = 1;
+    /* the client threads serve no one new, the sessions they serve are discarded, and every game that ends is journaled before the journal stops */
+    pthread_mutex_lock(&mutex);
+    __atomic_store_n(&status, STATUS_DRAINING, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&consumer_cond);
+    pthread_mutex_unlock(&mutex);
+
+    pthread_mutex_lock(&wheel_mutex);
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (live[i] == NULL) { continue; }
+        timer_cancel(&(*live[i]).idle);
+        session_discard(live[i], &metrics[SLOT_REGISTRATION]);
+    }
+    pthread_mutex_unlock(&wheel_mutex);
+
+    for (i = 0; i < MAX_CLIENTS; i++) { pthread_join(threads[i], NULL); }
+    __atomic_store_n(&status, STATUS_STOPPED, __ATOMIC_RELEASE);
+    pthread_join(timer_thread, NULL);
+
+    if ((*common_arguments).stats_fd != -1) {
+        shutdown((*common_arguments).stats_fd, SHUT_RDWR); /* makes accept() fail, so the stats thread returns */
+        pthread_join(stats_thread, NULL);
+        close((*common_arguments).stats_fd);
+        unlink(stats_path);
+    }
+    free(stats_path);
+    log_stop();
+    journal_stop();
+    free(journal_path);
+    reviews_stop();
+    free(reviews_path);
+    snapshots_stop();
+    free(snapshots_path);
+    write_histograms(common_arguments, STDOUT_FILENO);
+    trace_dump();
 
     /*
     pthread_mutex_destroy(&mutex);
@@ -410,7 +3638,8 @@ int main(int argc, char **argv) {
 
     clear(&linked_list_questions_head);
     close(register_fifo_fd);
+    destroy_pool(&pool);
     unlink(argv[1]);
 
     return 0;
-}
\ No newline at end of file
+}
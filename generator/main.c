@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_LINE 71 /* longest line every program can parse: the servers read lines into 72 byte buffers */
+#define DUPLICATE_POOL 4096 /* duplicates repeat one of the earlier records kept here */
+#define OUTPUT_BUF_SIZE (1 << 20)
+
+#define UNIFORM 0
+#define NORMAL 1
+
+#define QUESTION 0
+#define ANSWER 1
+#define CLUE 2
+
+
+
+/* range of lengths of one kind of line */
+typedef struct {
+    int min, max;
+} Range;
+
+
+/* a record of the database: question, answer and clue */
+typedef struct {
+    char line[3][MAX_LINE + 1];
+} Record;
+
+
+
+unsigned long long state; /* state of the random generator, the same seed always gives the same database */
+
+
+
+/*
+xorshift64*, so the output does not depend on the rand() of the C library
+@return next random number
+*/
+unsigned long long next_random() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+
+/*
+random number in [0, 1)
+*/
+double uniform() {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/*
+draws a length from a range
+@param range range of lengths
+@param distribution UNIFORM, or NORMAL centered in the range with the range spanning 6 standard deviations
+@return the length
+*/
+int draw_length(Range *range, int distribution) {
+    double x;
+    int i, len;
+
+    if (distribution == UNIFORM) { return (*range).min + (int)(uniform() * ((*range).max - (*range).min + 1)); }
+
+    for (x = -6, i = 0; i < 12; i++) { x += uniform(); } /* sum of 12 uniforms: close enough to a standard normal */
+    len = (int)((*range).min + ((*range).max - (*range).min) * (0.5 + x / 6) + 0.5);
+
+    if (len < (*range).min) { len = (*range).min; }
+    if (len > (*range).max) { len = (*range).max; }
+    return len;
+}
+
+
+/*
+writes random words until the line has the given length
+@param line stores the line
+@param len length of the line
+@param kind QUESTION, ANSWER or CLUE, questions end with a question mark
+*/
+void random_line(char *line, int len, int kind) {
+    static char *words[] = { "what", "which", "who", "is", "the", "of", "largest", "capital", "element", "known",
+                             "as", "in", "human", "body", "planet", "ocean", "river", "atomic", "number", "world",
+                             "first", "country", "city", "animal", "author", "year", "discovered", "famous" };
+    int i = 0, j;
+    char *word;
+
+    while (i < len) {
+        word = words[next_random() % (sizeof(words) / sizeof(words[0]))];
+        for (j = 0; word[j] && i < len; j++) { line[i++] = word[j]; }
+        if (i < len) { line[i++] = ' '; }
+    }
+    if (line[len - 1] == ' ') { line[len - 1] = 's'; }
+    if (kind == QUESTION) {
+        if (len > 2 && line[len - 2] == ' ') { line[len - 2] = 's'; }
+        line[len - 1] = '?';
+    }
+    if (line[0] >= 'a' && line[0] <= 'z') { line[0] -= 'a' - 'A'; }
+    line[len] = '\0';
+}
+
+
+/*
+reads a range of lengths given as MIN-MAX
+@param arg the argument
+@param range stores the range
+@return 0 on success, 1 if the range is not valid
+*/
+int parse_range(char *arg, Range *range) {
+    if (sscanf(arg, "%d-%d", &(*range).min, &(*range).max) != 2) { return 1; }
+    return (*range).min < 1 || (*range).max < (*range).min || (*range).max > MAX_LINE;
+}
+
+
+void usage(char *name) {
+    printf("usage: %s [-n questions] [-s seed] [-q MIN-MAX] [-a MIN-MAX] [-c MIN-MAX] [-D uniform|normal] [-r duplicate-rate] [-o output]\n", name);
+    printf("\t-q, -a, -c lengths of questions, answers and clues, at most %d\n", MAX_LINE);
+    printf("\t-r ratio of records that repeat an earlier record\n");
+}
+
+
+int main(int argc, char **argv) {
+    char *output = NULL, *buf;
+    int opt, kind, distribution = UNIFORM, kept = 0;
+    long i, questions = 1000000, duplicates = 0;
+    double duplicate_rate = 0;
+    Range ranges[3] = { { 20, 70 }, { 3, 20 }, { 10, 60 } };
+    Record record, *pool;
+    FILE *file = stdout;
+
+    state = 1;
+    while ((opt = getopt(argc, argv, "n:s:q:a:c:D:r:o:")) != -1) {
+        switch (opt) {
+            case 'n': questions = atol(optarg); break;
+            case 's': state = strtoull(optarg, NULL, 10); break;
+            case 'q': if (parse_range(optarg, &ranges[QUESTION])) { opt = '?'; } break;
+            case 'a': if (parse_range(optarg, &ranges[ANSWER])) { opt = '?'; } break;
+            case 'c': if (parse_range(optarg, &ranges[CLUE])) { opt = '?'; } break;
+            case 'D':
+                if (strcmp(optarg, "uniform") == 0) { distribution = UNIFORM; }
+                else if (strcmp(optarg, "normal") == 0) { distribution = NORMAL; }
+                else { opt = '?'; }
+                break;
+            case 'r': duplicate_rate = atof(optarg); break;
+            case 'o': output = optarg; break;
+            default: opt = '?'; break;
+        }
+        if (opt == '?') {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc || questions < 0 || duplicate_rate < 0 || duplicate_rate > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (state == 0) { state = 1; } /* xorshift never leaves 0 */
+
+    if (output != NULL && (file = fopen(output, "w")) == NULL) {
+        printf("failed to open %s\n", output);
+        return 1;
+    }
+    pool = malloc(DUPLICATE_POOL * sizeof(Record));
+    buf = malloc(OUTPUT_BUF_SIZE);
+    if (pool == NULL || buf == NULL) {
+        printf("memory error\n");
+        return 1;
+    }
+    setvbuf(file, buf, _IOFBF, OUTPUT_BUF_SIZE);
+
+    for (i = 0; i < questions; i++) {
+        if (kept > 0 && uniform() < duplicate_rate) {
+            record = pool[next_random() % kept];
+            duplicates++;
+        }
+        else {
+            for (kind = QUESTION; kind <= CLUE; kind++) {
+                random_line(record.line[kind], draw_length(&ranges[kind], distribution), kind);
+            }
+            /* the pool keeps the first records, then replaces them at random so duplicates come from anywhere in the file */
+            if (kept < DUPLICATE_POOL) { pool[kept++] = record; }
+            else { pool[next_random() % DUPLICATE_POOL] = record; }
+        }
+
+        for (kind = QUESTION; kind <= CLUE; kind++) {
+            fprintf(file, "%d%s\n", (int)strlen(record.line[kind]), record.line[kind]);
+        }
+    }
+
+    if (fclose(file) != 0) {
+        printf("failed to write the database\n");
+        return 1;
+    }
+    free(pool);
+    free(buf);
+
+    if (output != NULL) { printf("%ld questions (%ld duplicates) written to %s\n", questions, duplicates, output); }
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+
+#define ITERATIONS 100000 /* request/response round trips measured per transport */
+#define SETUP_ROUNDS 2000 /* connections set up and torn down per transport */
+
+#define UNIX_SOCKET_PATH "/tmp/quizia-bench.sock"
+#define REQUEST_FIFO_PATH "/tmp/quizia-bench.request"
+#define RESPONSE_FIFO_PATH "/tmp/quizia-bench.response"
+
+#define QUESTION 'q'
+#define EXIT 'e'
+
+/* a question of typical length, the server sends it together with its null terminator */
+#define MESSAGE "Diamonds are an arrengement of atoms of which chemical element?"
+
+#define TCP 0
+#define UNIX 1
+#define FIFO 2
+
+
+/// @brief both ends of one connection, for FIFOs reading and writing happen on different descriptors
+typedef struct {
+    int client_read_fd, client_write_fd;
+    int server_read_fd, server_write_fd;
+} Connection;
+
+
+/// @brief current time of the monotonic clock
+/// @return time in nanoseconds
+long long now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/// @brief compares two latencies, used by qsort
+int compare_latency(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/// @brief reads exactly len bytes, as a stream socket or a pipe may return a message in pieces
+/// @return 0 on success, 1 if the connection was closed
+int read_full(int fd, char *buf, int len) {
+    int n;
+
+    while (len > 0) {
+        if ((n = read(fd, buf, len)) <= 0) { return 1; }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/// @brief creates a listening socket for the given transport
+/// @param transport TCP or UNIX
+/// @param address filled with the address clients have to connect to
+/// @param addrlen filled with the size of address
+/// @return descriptor of the listening socket, -1 on failure
+int listener(int transport, struct sockaddr_storage *address, socklen_t *addrlen) {
+    int fd;
+
+    memset(address, 0, sizeof(*address));
+
+    if (transport == TCP) {
+        struct sockaddr_in *in = (struct sockaddr_in *)address;
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        in->sin_family = AF_INET;
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        in->sin_port = 0; // let the kernel pick a free port, it is read back with getsockname()
+        *addrlen = sizeof(*in);
+    }
+    else {
+        struct sockaddr_un *un = (struct sockaddr_un *)address;
+
+        fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        un->sun_family = AF_UNIX;
+        strncpy(un->sun_path, UNIX_SOCKET_PATH, sizeof(un->sun_path) - 1);
+        unlink(UNIX_SOCKET_PATH);
+        *addrlen = sizeof(*un);
+    }
+    if (fd == -1) { return -1; }
+
+    if (bind(fd, (struct sockaddr *)address, *addrlen) == -1 || listen(fd, 64) == -1 || getsockname(fd, (struct sockaddr *)address, addrlen) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/// @brief measures how long it takes to establish and tear down one connection, as a new client of the server would
+/// @param transport TCP, UNIX or FIFO
+/// @return average time in nanoseconds, -1 on failure
+long long bench_setup(int transport) {
+    int i, listen_fd = -1;
+    long long start;
+    struct sockaddr_storage address;
+    socklen_t addrlen;
+
+    if (transport != FIFO && (listen_fd = listener(transport, &address, &addrlen)) == -1) { return -1; }
+
+    start = now();
+    for (i = 0; i < SETUP_ROUNDS; i++) {
+        if (transport == FIFO) {
+            // what every FIFO client and server pair does: create both fifos, open both ends of each, unlink them
+            int request_read_fd, request_write_fd, response_read_fd, response_write_fd;
+
+            if (mkfifo(REQUEST_FIFO_PATH, 0660) == -1 || mkfifo(RESPONSE_FIFO_PATH, 0660) == -1) { return -1; }
+            request_read_fd = open(REQUEST_FIFO_PATH, O_RDONLY | O_NONBLOCK);
+            request_write_fd = open(REQUEST_FIFO_PATH, O_WRONLY);
+            response_read_fd = open(RESPONSE_FIFO_PATH, O_RDONLY | O_NONBLOCK);
+            response_write_fd = open(RESPONSE_FIFO_PATH, O_WRONLY);
+            close(request_read_fd);
+            close(request_write_fd);
+            close(response_read_fd);
+            close(response_write_fd);
+            unlink(REQUEST_FIFO_PATH);
+            unlink(RESPONSE_FIFO_PATH);
+        }
+        else {
+            int client_fd, server_fd;
+
+            client_fd = socket(address.ss_family, transport == TCP ? SOCK_STREAM : SOCK_SEQPACKET, 0);
+            if (connect(client_fd, (struct sockaddr *)&address, addrlen) == -1) { return -1; }
+            server_fd = accept(listen_fd, NULL, NULL);
+            close(client_fd);
+            close(server_fd);
+        }
+    }
+    start = (now() - start) / SETUP_ROUNDS;
+
+    if (listen_fd != -1) { close(listen_fd); }
+    if (transport == UNIX) { unlink(UNIX_SOCKET_PATH); }
+
+    return start;
+}
+
+
+/// @brief connects a client to a server for the given transport, both ends stay in this process until fork()
+/// @return 0 on success, 1 otherwise
+int open_connection(int transport, Connection *connection) {
+    if (transport == FIFO) {
+        unlink(REQUEST_FIFO_PATH);
+        unlink(RESPONSE_FIFO_PATH);
+        if (mkfifo(REQUEST_FIFO_PATH, 0660) == -1 || mkfifo(RESPONSE_FIFO_PATH, 0660) == -1) { return 1; }
+        connection->server_read_fd = open(REQUEST_FIFO_PATH, O_RDONLY | O_NONBLOCK);
+        connection->client_write_fd = open(REQUEST_FIFO_PATH, O_WRONLY);
+        connection->client_read_fd = open(RESPONSE_FIFO_PATH, O_RDONLY | O_NONBLOCK);
+        connection->server_write_fd = open(RESPONSE_FIFO_PATH, O_WRONLY);
+        unlink(REQUEST_FIFO_PATH);
+        unlink(RESPONSE_FIFO_PATH);
+
+        // the read ends were only opened non-blocking so that open() would not wait for a writer
+        fcntl(connection->server_read_fd, F_SETFL, 0);
+        fcntl(connection->client_read_fd, F_SETFL, 0);
+    }
+    else {
+        int listen_fd;
+        struct sockaddr_storage address;
+        socklen_t addrlen;
+
+        if ((listen_fd = listener(transport, &address, &addrlen)) == -1) { return 1; }
+        connection->client_read_fd = socket(address.ss_family, transport == TCP ? SOCK_STREAM : SOCK_SEQPACKET, 0);
+        if (connect(connection->client_read_fd, (struct sockaddr *)&address, addrlen) == -1) { return 1; }
+        connection->server_read_fd = accept(listen_fd, NULL, NULL);
+        connection->client_write_fd = connection->client_read_fd;
+        connection->server_write_fd = connection->server_read_fd;
+        close(listen_fd);
+        if (transport == UNIX) { unlink(UNIX_SOCKET_PATH); }
+    }
+    return connection->server_read_fd == -1 || connection->client_read_fd == -1;
+}
+
+
+/// @brief answers QUESTION requests the way the server does, until EXIT is received
+void serve(int read_fd, int write_fd) {
+    char c;
+
+    while (read(read_fd, &c, 1) == 1 && c != EXIT) {
+        if (c == QUESTION) { write(write_fd, MESSAGE, sizeof(MESSAGE)); }
+    }
+}
+
+
+/// @brief measures request/response round trips against a server process
+/// @param transport TCP, UNIX or FIFO
+/// @param latencies filled with the ITERATIONS round trip times, in nanoseconds
+/// @return total time of the run in nanoseconds, -1 on failure
+long long bench_round_trip(int transport, long long *latencies) {
+    int i;
+    pid_t pid;
+    long long start, total;
+    char request = QUESTION, response[sizeof(MESSAGE)];
+    Connection connection;
+
+    if (open_connection(transport, &connection)) { return -1; }
+    fflush(stdout); // otherwise the child inherits and prints again whatever is still buffered
+
+    if ((pid = fork()) == 0) {
+        close(connection.client_read_fd);
+        if (connection.client_write_fd != connection.client_read_fd) { close(connection.client_write_fd); }
+        serve(connection.server_read_fd, connection.server_write_fd);
+        exit(0);
+    }
+    close(connection.server_read_fd);
+    if (connection.server_write_fd != connection.server_read_fd) { close(connection.server_write_fd); }
+
+    total = now();
+    for (i = 0; i < ITERATIONS; i++) {
+        start = now();
+        write(connection.client_write_fd, &request, 1);
+        if (read_full(connection.client_read_fd, response, sizeof(response))) { return -1; }
+        latencies[i] = now() - start;
+    }
+    total = now() - total;
+
+    request = EXIT;
+    write(connection.client_write_fd, &request, 1);
+    waitpid(pid, NULL, 0);
+
+    close(connection.client_read_fd);
+    if (connection.client_write_fd != connection.client_read_fd) { close(connection.client_write_fd); }
+
+    return total;
+}
+
+
+int main() {
+    int transport;
+    char *names[] = { "tcp", "unix-seqpacket", "fifo" };
+    long long setup, total, *latencies = malloc(ITERATIONS * sizeof(long long));
+
+    if (latencies == NULL) {
+        printf("memory error\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%d round trips of a %d byte question per transport\n\n", ITERATIONS, (int)sizeof(MESSAGE));
+    printf("%-16s %12s %10s %10s %10s %12s\n", "transport", "setup(us)", "p50(us)", "p99(us)", "p999(us)", "req/s");
+
+    for (transport = TCP; transport <= FIFO; transport++) {
+        if ((setup = bench_setup(transport)) == -1 || (total = bench_round_trip(transport, latencies)) == -1) {
+            printf("%-16s failed\n", names[transport]);
+            continue;
+        }
+        qsort(latencies, ITERATIONS, sizeof(long long), compare_latency);
+
+        printf("%-16s %12.2f %10.2f %10.2f %10.2f %12.0f\n", names[transport], setup / 1000.0,
+               latencies[ITERATIONS / 2] / 1000.0, latencies[ITERATIONS * 99 / 100] / 1000.0,
+               latencies[ITERATIONS * 999 / 1000] / 1000.0, ITERATIONS / (total / 1e9));
+    }
+
+    free(latencies);
+    return 0;
+}
@@ -0,0 +1,608 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+
+
+#define PORT 8080
+#define SERVER_IP "127.0.0.1"
+#define STATS_SOCKET_PATH "/tmp/quizia.stats.sock"
+
+#define BUF_PRS_SIZE 84
+#define BUF_ANS_SIZE 32
+#define BUF_MSG_SIZE 256
+
+#define QUESTION 'q'
+#define ANSWER 'a'
+#define CLUE 'c'
+#define NEXT_QUESTION 'n'
+#define EXIT 'e'
+#define LAST_QUESTION 'l'
+#define PROCEED 'p'
+#define DISCARD 'd'
+#define TIMEOUT 't'
+#define PLAYER_NAME 'u'
+#define LEADERBOARD 'b'
+#define JOIN 'j'
+#define WINNER 'w'
+#define TOURNAMENT 'o'
+#define STANDING 's'
+#define BUSY 'x'
+
+#define ROOM_SIZE 4 /* players of a room, as the server has it */
+
+#define KINDS 5 /* kinds of request whose latency is measured */
+#define KIND_QUESTION 0
+#define KIND_CLUE 1
+#define KIND_ANSWER 2
+#define KIND_NEXT 3 /* NEXT_QUESTION, and the status sent when connecting, both answered with a status byte */
+#define KIND_TOP 4 /* LEADERBOARD, until the empty message after the last score */
+
+
+/// @brief buffered reader of the socket, so the server messages are split correctly however recv() returns them
+typedef struct {
+    int fd, start, end;
+    char buf[BUF_MSG_SIZE];
+} Reader;
+
+
+/// @brief latencies of one kind of request, in nanoseconds
+typedef struct {
+    long long *values;
+    int count, size;
+} Latencies;
+
+
+/// @brief a scripted player, each one runs on its own thread and plays its games one after the other
+typedef struct {
+    unsigned int seed;
+    int id, games, questions, correct, clues, timeouts, errors, shed;
+    unsigned long *keys; // hashes of the questions whose answer was learnt, 0 in a free slot
+    char (*answers)[BUF_ANS_SIZE]; // answers learnt from the server, in the slot of their question
+    int known, size; // questions whose answer was learnt, and slots of the table, a power of two
+    Latencies latencies[KINDS];
+} Player;
+
+
+// configuration shared by every player, set once by main() before the threads start
+char *unix_socket_path = NULL; // NULL means TCP
+int games_per_player = 20;
+int think_ms = 0;
+double correct_ratio = 0.7, clue_rate = 0.2;
+int rooms = 0; // players play in rooms of ROOM_SIZE instead of alone
+int tournament = 0; // players register for the tournament of the server, those who are too late play alone
+int idle = 0; // connections held open without playing, for the memory report, 0 to play
+
+
+/// @brief current time of the monotonic clock
+/// @return time in nanoseconds
+long long now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/// @brief compares two latencies, used by qsort
+int compare_latency(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/// @brief records a latency, the array grows as needed
+/// @return 0 on success, 1 on memory error
+int record(Latencies *latencies, long long value) {
+    if ((*latencies).count == (*latencies).size) {
+        int size = (*latencies).size ? 2 * (*latencies).size : 1024;
+        long long *values = realloc((*latencies).values, size * sizeof(long long));
+
+        if (values == NULL) { return 1; }
+        (*latencies).values = values;
+        (*latencies).size = size;
+    }
+    (*latencies).values[(*latencies).count++] = value;
+    return 0;
+}
+
+
+/// @brief reads the next byte sent by the server
+/// @return 0 on success, 1 if the server closed the connection
+int read_byte(Reader *reader, char *c) {
+    if ((*reader).start == (*reader).end) {
+        int n = recv((*reader).fd, (*reader).buf, BUF_MSG_SIZE, 0);
+
+        if (n <= 0) { return 1; }
+        (*reader).start = 0;
+        (*reader).end = n;
+    }
+    *c = (*reader).buf[(*reader).start++];
+    return 0;
+}
+
+
+/// @brief reads the next message sent by the server: either a single status byte or a QUESTION, ANSWER, CLUE, LEADERBOARD, WINNER, STANDING or BUSY byte followed by a string
+/// @param text stores the string of the message, if there is one
+/// @return the type of the message, DISCARD if the server closed the connection
+char read_message(Reader *reader, char *text) {
+    char type, c;
+    int i = 0;
+
+    if (read_byte(reader, &type)) { return DISCARD; }
+    if (type != QUESTION && type != ANSWER && type != CLUE && type != LEADERBOARD && type != WINNER && type != STANDING && type != BUSY) { return type; }
+
+    do {
+        if (read_byte(reader, &c)) { return DISCARD; }
+        if (i < BUF_PRS_SIZE - 1) { text[i++] = c; }
+    } while (c != '\0');
+    text[i] = '\0';
+
+    return type;
+}
+
+
+/// @brief sends a request, followed by its string if it has one
+/// @param arg string of the request, NULL if it has none
+/// @return 0 on success, 1 otherwise
+int send_request(Reader *reader, char request, char *arg) {
+    char buf[BUF_ANS_SIZE + 1];
+    int len = 1;
+
+    buf[0] = request;
+    if (arg != NULL) {
+        len = strlen(arg) + 2;
+        memcpy(buf + 1, arg, len - 1);
+    }
+    return send((*reader).fd, buf, len, MSG_NOSIGNAL) != len;
+}
+
+
+/// @brief sends a request and waits for its reply, recording how long the round trip took
+/// @param request request to send, 0 to only wait for the message the server sends on its own
+/// @param arg string of the request, NULL if it has none
+/// @param kind kind of request, selects where the latency is recorded
+/// @return the type of the reply
+char round_trip(Player *player, Reader *reader, char request, char *arg, int kind, char *text) {
+    long long start = now();
+    char reply;
+
+    if (request && send_request(reader, request, arg)) { return DISCARD; }
+    reply = read_message(reader, text);
+    // the leaderboard is a message per score, the round trip ends with the empty message after the last one,
+    // the winner of a question of a room is announced whenever someone answers it first, and the standing in the tournament after every round
+    while ((reply == LEADERBOARD && text[0] != '\0') || reply == WINNER || reply == STANDING) { reply = read_message(reader, text); }
+    if (reply != DISCARD && reply != TIMEOUT && reply != BUSY && record(&(*player).latencies[kind], now() - start)) { return DISCARD; }
+
+    return reply;
+}
+
+
+/// @brief connects to the server, through its unix socket if a path was given, through TCP/IP otherwise
+/// @return descriptor of the connected socket, -1 on failure
+int connect_server() {
+    int fd;
+
+    if (unix_socket_path != NULL) {
+        struct sockaddr_un addr;
+
+        if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0) { return -1; }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, unix_socket_path, sizeof(addr.sun_path) - 1);
+
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    else {
+        struct sockaddr_in serv_addr;
+
+        if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) { return -1; }
+        memset(&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_port = htons(PORT);
+
+        if (inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0 || connect(fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+
+/// @brief hash of the text of a question (FNV-1a), the key its answer is learnt under. The server may ask the questions of
+///        a game in any order (-a), so the answers cannot be learnt by position
+/// @return the hash, never 0
+unsigned long question_key(char *question) {
+    unsigned long key = 14695981039346656037UL;
+
+    for (; *question; question++) { key = (key ^ (unsigned char)*question) * 1099511628211UL; }
+    return key ? key : 1;
+}
+
+
+/// @brief finds the slot of a question in the table of learnt answers, open addressing with linear probing
+/// @return the slot of the question, or the free slot where it goes
+int answer_slot(Player *player, unsigned long key) {
+    int i = key & ((*player).size - 1);
+
+    while ((*player).keys[i] != 0 && (*player).keys[i] != key) { i = (i + 1) & ((*player).size - 1); }
+    return i;
+}
+
+
+/// @brief answer learnt for a question
+/// @return the answer, NULL if it was not learnt yet
+char *recall(Player *player, unsigned long key) {
+    int i;
+
+    if ((*player).size == 0) { return NULL; }
+    i = answer_slot(player, key);
+    return (*player).keys[i] == key ? (*player).answers[i] : NULL;
+}
+
+
+/// @brief learns the answer of a question, the table doubles when it is half full
+/// @param key hash of the question
+/// @param answer answer sent by the server
+/// @return 0 on success, 1 on memory error
+int learn(Player *player, unsigned long key, char *answer) {
+    int i, j, size, old = (*player).size;
+    unsigned long *keys = (*player).keys;
+    char (*answers)[BUF_ANS_SIZE] = (*player).answers;
+
+    if (recall(player, key) != NULL) { return 0; }
+    if (2 * ((*player).known + 1) > old) {
+        size = old ? 2 * old : 64;
+        (*player).keys = calloc(size, sizeof(unsigned long));
+        (*player).answers = malloc(size * BUF_ANS_SIZE);
+        if ((*player).keys == NULL || (*player).answers == NULL) {
+            free((*player).keys);
+            free((*player).answers);
+            (*player).keys = keys;
+            (*player).answers = answers;
+            return 1;
+        }
+        (*player).size = size;
+        for (i = 0; i < old; i++) {
+            if (keys[i] == 0) { continue; }
+            j = answer_slot(player, keys[i]);
+            (*player).keys[j] = keys[i];
+            memcpy((*player).answers[j], answers[i], BUF_ANS_SIZE);
+        }
+        free(keys);
+        free(answers);
+    }
+    i = answer_slot(player, key);
+    (*player).keys[i] = key;
+    snprintf((*player).answers[i], BUF_ANS_SIZE, "%s", answer);
+    (*player).known++;
+    return 0;
+}
+
+
+/// @brief plays one game the way the interactive client does. The server grades the answers, so the player sends the answers
+///        it learnt from the server in earlier questions, the right one with probability correct_ratio once it is known.
+///        a server that sheds the player is tried again once the time it tells has passed
+/// @return 0 if the game was played to its end, 1 if the server dropped the player
+int play(Player *player) {
+    char status, reply, name[BUF_ANS_SIZE], *answer, text[BUF_PRS_SIZE];
+    char *learnt;
+    int points = 2, right;
+    unsigned long key = 0;
+    Reader reader;
+    struct timespec think = { think_ms / 1000, (think_ms % 1000) * 1000000L }, retry;
+
+    while (1) {
+        if ((reader.fd = connect_server()) < 0) { return 1; }
+        reader.start = reader.end = 0;
+        // the status of the first question is sent on connection, or BUSY if the server does not admit the player
+        if ((status = round_trip(player, &reader, 0, NULL, KIND_NEXT, text)) != BUSY) { break; }
+        (*player).shed++;
+        close(reader.fd);
+        retry.tv_sec = atoi(text) / 1000;
+        retry.tv_nsec = atoi(text) % 1000 * 1000000L;
+        nanosleep(&retry, NULL);
+    }
+
+    sprintf(name, "bot%d", (*player).id);
+    if (send_request(&reader, PLAYER_NAME, name)) {
+        close(reader.fd);
+        return 1;
+    }
+    sprintf(name, "room%d", (*player).id / ROOM_SIZE); // the same players meet in the same room every game
+    if (rooms && send_request(&reader, JOIN, name)) {
+        close(reader.fd);
+        return 1;
+    }
+    if (tournament && send_request(&reader, TOURNAMENT, NULL)) {
+        close(reader.fd);
+        return 1;
+    }
+
+    while (status == PROCEED || status == LAST_QUESTION) {
+        (*player).questions++;
+        // a question of the tournament asked once its round is over is answered with TIMEOUT instead
+        if ((reply = round_trip(player, &reader, QUESTION, NULL, KIND_QUESTION, text)) == QUESTION) {
+            key = question_key(text);
+            reply = 0;
+        }
+        else if (reply != TIMEOUT) { break; }
+
+        if (!reply && rand_r(&(*player).seed) < clue_rate * RAND_MAX) {
+            (*player).clues++;
+            if ((reply = round_trip(player, &reader, CLUE, NULL, KIND_CLUE, text)) == CLUE) { reply = 0; }
+        }
+        if (!reply && think_ms) { nanosleep(&think, NULL); }
+
+        learnt = reply ? NULL : recall(player, key);
+        right = learnt != NULL && rand_r(&(*player).seed) < correct_ratio * RAND_MAX;
+        answer = right ? learnt : "-"; // no answer is a dash
+        if (!reply) { reply = round_trip(player, &reader, ANSWER, answer, KIND_ANSWER, text); }
+
+        if (reply == TIMEOUT) {
+            (*player).timeouts++;
+            points--;
+        }
+        else if (reply != ANSWER || learn(player, key, text)) { break; }
+        else if (!right) { points--; }
+        else {
+            (*player).correct++;
+            points++;
+        }
+
+        if (points < 0 || status == LAST_QUESTION) {
+            // the leaderboard is asked for at the end of every game, as a player would
+            if (round_trip(player, &reader, LEADERBOARD, NULL, KIND_TOP, text) != LEADERBOARD) { break; }
+            send_request(&reader, EXIT, NULL); // the player "requests" its termination
+            close(reader.fd);
+            (*player).games++;
+            return 0;
+        }
+        status = round_trip(player, &reader, NEXT_QUESTION, NULL, KIND_NEXT, text);
+    }
+
+    close(reader.fd);
+    return 1;
+}
+
+
+/// @brief thread of a player
+/// @param arg the player
+void *run_player(void *arg) {
+    Player *player = (Player *)arg;
+    int i;
+
+    for (i = 0; i < games_per_player; i++) {
+        if (play(player)) { (*player).errors++; }
+    }
+    free((*player).keys);
+    free((*player).answers);
+    return NULL;
+}
+
+
+/// @brief reads a counter of the server from its stats socket
+/// @param name name of the counter
+/// @return its value, -1 if it could not be read
+long server_stat(char *name) {
+    char buf[8192], *line;
+    int fd, n, len = 0, name_len = strlen(name);
+    struct sockaddr_un addr;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) { return -1; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, STATS_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    shutdown(fd, SHUT_WR); // sends nothing, so it gets the counters
+    while (len < (int)sizeof(buf) - 1 && (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) { len += n; }
+    close(fd);
+    buf[len] = '\0';
+
+    for (line = buf; line != NULL && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+        if (strncmp(line, name, name_len) == 0 && line[name_len] == ' ') { return atol(line + name_len + 1); }
+    }
+    return -1;
+}
+
+
+/// @brief memory the kernel keeps in its slab caches, where the sockets and their buffers are
+/// @return slab memory in KiB, 0 if unknown
+long kernel_slab_kib() {
+    char line[128];
+    long kib = 0;
+    FILE *file = fopen("/proc/meminfo", "r");
+
+    if (file == NULL) { return 0; }
+    while (fgets(line, sizeof(line), file) != NULL && sscanf(line, "Slab: %ld", &kib) != 1);
+    fclose(file);
+    return kib;
+}
+
+
+/// @brief opens idle connections, each one reads the status the server sends and then nothing, and reports the memory
+///        they cost the server, whose counters it reads before and after, and the kernel, both ends of every connection
+/// @return 0 on success, 1 otherwise
+int report_idle() {
+    char status, text[BUF_PRS_SIZE];
+    int i, opened, *fds = malloc(idle * sizeof(int));
+    long resident, slab, kernel;
+    struct rlimit limit;
+    Reader reader;
+
+    if (fds == NULL) { return 1; }
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) { // a descriptor per connection
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if ((resident = server_stat("resident_kib")) == -1 || (slab = server_stat("session_slab_kib")) == -1) {
+        printf("failed to read the stats socket %s\n", STATS_SOCKET_PATH);
+        free(fds);
+        return 1;
+    }
+    kernel = kernel_slab_kib();
+
+    for (opened = 0; opened < idle; opened++) {
+        memset(&reader, 0, sizeof(reader));
+        if ((reader.fd = connect_server()) < 0) { break; }
+        fds[opened] = reader.fd;
+        if ((status = read_message(&reader, text)) == DISCARD) { break; }
+    }
+    if (opened == 0) {
+        printf("failed to connect\n");
+        free(fds);
+        return 1;
+    }
+
+    sleep(1); // the server has taken every connection by now
+    resident = server_stat("resident_kib") - resident;
+    slab = server_stat("session_slab_kib") - slab;
+    kernel = kernel_slab_kib() - kernel;
+
+    printf("%d idle sessions over %s, %ld active on the server\n\n", opened, unix_socket_path ? unix_socket_path : "tcp", server_stat("sessions_active"));
+    printf("%-22s %10s %14s\n", "memory", "KiB", "bytes/session");
+    printf("%-22s %10s %14ld\n", "session struct", "", server_stat("session_bytes"));
+    printf("%-22s %10ld %14.0f\n", "session slab", slab, slab * 1024.0 / opened);
+    printf("%-22s %10ld %14.0f\n", "server resident", resident, resident * 1024.0 / opened);
+    printf("%-22s %10ld %14.0f\n", "kernel slab (2 ends)", kernel, kernel * 1024.0 / opened);
+
+    for (i = 0; i < opened; i++) { close(fds[i]); }
+    free(fds);
+    return 0;
+}
+
+
+/// @brief prints the percentiles of a set of latencies
+/// @param name name of the row
+void report(char *name, Latencies *latencies) {
+    int n = (*latencies).count;
+
+    if (n == 0) {
+        printf("%-10s %10d\n", name, 0);
+        return;
+    }
+    qsort((*latencies).values, n, sizeof(long long), compare_latency);
+    printf("%-10s %10d %10.2f %10.2f %10.2f %10.2f\n", name, n,
+           (*latencies).values[n / 2] / 1000.0, (*latencies).values[(long long)n * 99 / 100] / 1000.0,
+           (*latencies).values[(long long)n * 999 / 1000] / 1000.0, (*latencies).values[n - 1] / 1000.0);
+}
+
+
+int main(int argc, char **argv) {
+    char *names[] = { "question", "clue", "answer", "next", "top", "all" };
+    int i, k, opt, players = 16;
+    long long elapsed, requests = 0;
+    pthread_t *threads;
+    Player *all;
+    Latencies merged[KINDS + 1];
+
+    while ((opt = getopt(argc, argv, "n:g:t:r:c:u:moi:")) != -1) {
+        switch (opt) {
+            case 'n': players = atoi(optarg); break;
+            case 'g': games_per_player = atoi(optarg); break;
+            case 't': think_ms = atoi(optarg); break;
+            case 'r': correct_ratio = atof(optarg); break;
+            case 'c': clue_rate = atof(optarg); break;
+            case 'u': unix_socket_path = optarg; break;
+            case 'm': rooms = 1; break;
+            case 'o': tournament = 1; break;
+            case 'i': idle = atoi(optarg); break;
+            default:
+                printf("usage: %s [-n players] [-g games-per-player] [-t think-ms] [-r correct-ratio] [-c clue-rate] [-u unix-socket-path] [-m] [-o] [-i idle-connections]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (idle > 0) { return report_idle(); }
+    if (players < 1 || games_per_player < 1 || think_ms < 0) {
+        printf("players and games must be positive, think time must not be negative\n");
+        return 1;
+    }
+    if (rooms && tournament) {
+        printf("players play either in rooms or in the tournament\n");
+        return 1;
+    }
+    if (rooms && players % ROOM_SIZE) { // a room that is not full waits for players before it starts
+        printf("players must be a multiple of %d to play in rooms\n", ROOM_SIZE);
+        return 1;
+    }
+
+    threads = malloc(players * sizeof(pthread_t));
+    all = calloc(players, sizeof(Player));
+    if (threads == NULL || all == NULL) {
+        printf("memory error\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%d players x %d games over %s, think %d ms, correct %.2f, clues %.2f\n\n", players, games_per_player,
+           unix_socket_path ? unix_socket_path : "tcp", think_ms, correct_ratio, clue_rate);
+
+    elapsed = now();
+    for (i = 0; i < players; i++) {
+        all[i].seed = (unsigned int)time(NULL) ^ (i * 2654435761u);
+        all[i].id = i;
+        if (pthread_create(&threads[i], NULL, run_player, &all[i]) != 0) {
+            printf("failed to create player %d\n", i);
+            players = i;
+            break;
+        }
+    }
+    for (i = 0; i < players; i++) { pthread_join(threads[i], NULL); }
+    elapsed = now() - elapsed;
+
+    // the latencies of every player are merged per kind of request, and all together in the last row
+    memset(merged, 0, sizeof(merged));
+    for (i = 1; i < players; i++) {
+        all[0].games += all[i].games;
+        all[0].questions += all[i].questions;
+        all[0].correct += all[i].correct;
+        all[0].clues += all[i].clues;
+        all[0].timeouts += all[i].timeouts;
+        all[0].errors += all[i].errors;
+        all[0].shed += all[i].shed;
+    }
+    for (i = 0; i < players; i++) {
+        for (k = 0; k < KINDS; k++) {
+            int j;
+
+            for (j = 0; j < all[i].latencies[k].count; j++) {
+                if (record(&merged[k], all[i].latencies[k].values[j]) || record(&merged[KINDS], all[i].latencies[k].values[j])) {
+                    printf("memory error\n");
+                    return 1;
+                }
+            }
+            free(all[i].latencies[k].values);
+        }
+    }
+    requests = merged[KINDS].count;
+
+    printf("games %d, questions %d, correct %d, clues %d, timeouts %d, dropped %d, shed %d\n", all[0].games, all[0].questions,
+           all[0].correct, all[0].clues, all[0].timeouts, all[0].errors, all[0].shed);
+    printf("%lld requests in %.2f s: %.0f req/s, %.0f games/s\n\n", requests, elapsed / 1e9, requests / (elapsed / 1e9),
+           all[0].games / (elapsed / 1e9));
+
+    printf("%-10s %10s %10s %10s %10s %10s\n", "request", "count", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+    for (k = 0; k <= KINDS; k++) {
+        report(names[k], &merged[k]);
+        free(merged[k].values);
+    }
+
+    free(threads);
+    free(all);
+    return 0;
+}
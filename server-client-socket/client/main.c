@@ -2,7 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
+#include <signal.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #define PORT 8080
 #define SERVER_IP "127.0.0.1" // 127.0.0.1 for local machine. change this to the server's IP address
@@ -10,6 +14,11 @@
 #define BUF_PRS_SIZE 84
 #define BUF_CMD_SIZE 16
 #define BUF_ANS_SIZE 32
+#define BUF_NAME_SIZE 16
+#define BUF_MSG_SIZE 256
+#define BUF_TOKEN_SIZE 17
+
+#define RECONNECT_TRIES 10 /* a game with a resume token reconnects once a second, this many times, when its connection breaks */
 
 #define CMD_START 2
 #define CMD_EXIT 3
@@ -19,6 +28,7 @@
 #define CMD_INVALID 7
 #define CMD_EOC 8
 #define CMD_NOT 9
+#define CMD_TOP 10
 
 #define QUESTION 'q'
 #define ANSWER 'a'
@@ -28,11 +38,27 @@
 #define LAST_QUESTION 'l'
 #define PROCEED 'p'
 #define DISCARD 'd'
+#define TIMEOUT 't'
+#define PLAYER_NAME 'u'
+#define LEADERBOARD 'b'
+#define JOIN 'j'
+#define WINNER 'w'
+#define TOURNAMENT 'o'
+#define STANDING 's'
+#define RESUME 'r'
+#define BUSY 'x' // the server did not admit the client, followed by the milliseconds to wait before trying again
+#define CLOSED '\0' /* not sent by the server: the connection is gone */
+
+#define WAIT_STATUS 0 /* states of the game: waiting for the status of the next question */
+#define WAIT_QUESTION 1 /* waiting for the question */
+#define PLAYING 2 /* the question is on screen and the user can answer */
+#define WAIT_ANSWER 3 /* the user answered and the client waits for the correct answer */
 
 #define CORRECT "\t\t\t\033[1;32mCorrect Answer!\033[0m\n\n"
 #define INCORRECT "\t\t\t\033[1;31mWrong Answer!\033[0m\n\n"
 #define LOSE "\033[1;31mYou have -1 points! YOU LOST!\033[0m\n"
 #define WIN "\033[1;32mCongratulations! You answered all the questions!\033[0m\n"
+#define TIMES_UP "\t\t\t\033[1;33mTIME IS UP!\033[0m\n\n"
 #define SCREEN_HOME "\n\t\tWelcome to Quizia - a simple, fun and challenging trivia quiz\n\n\n"
 #define HELP    "\t\t\033[1;33mHOW TO PLAY?\033[0m\n"\
                 "\t- You will start with a total of 2 points\n"\
@@ -46,10 +72,18 @@
                 "\t- Answering: Simply type your answer and press enter\n"\
                 "\t- Requesting a clue: Type the /clue command\n"\
                 "\t- Requesting your points: Type the /points command\n"\
+                "\t- Requesting the best scores of every player: Type the /top command\n"\
                 "\t- Exiting: Type the `/exit` command\n\n"
 
 
 
+/// @brief buffered reader of the messages sent by the server, so they are split correctly however read() returns them
+typedef struct {
+    int fd, start, end;
+    char buf[BUF_MSG_SIZE];
+} Reader;
+
+
 /// @brief concatenate two strings
 /// @param src initial string
 /// @param plus string to concatenate
@@ -117,7 +151,7 @@ int get_command(int fd, int len, char *answer) {
 
     if (read(fd, buf + 1, 1) != 1) { return CMD_INVALID; }
 
-    /* buf[1] is the command identifier such that: s = /start, e = /exit, h = /help, p = /points, c = /clue */
+    /* buf[1] is the command identifier such that: s = /start, e = /exit, h = /help, p = /points, c = /clue, t = /top */
     switch (buf[1]) {
         case 's': 
             if ((n = read(fd, buf + 2, 4)) != 4 || strncmp(buf, "/start", 6) != 0) { /* read the next 4 bytes expecting to form the string "tart", and store them in the buffer and check if it matches the command */
@@ -169,6 +203,16 @@ int get_command(int fd, int len, char *answer) {
                 return CMD_INVALID;
             }
             return CMD_CLUE;
+        case 't':
+            if ((n = read(fd, buf + 2, 2)) != 2 || strncmp(buf, "/top", 4) != 0) {
+                if (n == 2 && buf[3] != '\n') { cleanup(fd); }
+                return CMD_INVALID;
+            }
+            if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+                cleanup(fd);
+                return CMD_INVALID;
+            }
+            return CMD_TOP;
         case '\n':
             return CMD_INVALID;
         default:
@@ -210,123 +254,401 @@ int compare(char *correct_answer, char *answer) {
 }
 
 
-/// @brief responsible for the game
+/// @brief reads the next byte sent by the server
+/// @param reader reader of the server messages
+/// @param c stores the byte read
+/// @return 0 on success, 1 if the server closed the connection
+int read_byte(Reader *reader, char *c) {
+    if ((*reader).start == (*reader).end) {
+        int n = read((*reader).fd, (*reader).buf, BUF_MSG_SIZE);
+
+        if (n <= 0) { return 1; }
+        (*reader).start = 0;
+        (*reader).end = n;
+    }
+    *c = (*reader).buf[(*reader).start++];
+    return 0;
+}
+
+
+/// @brief reads the next message sent by the server: either a single status byte or a QUESTION, ANSWER, CLUE, LEADERBOARD, WINNER, STANDING, RESUME or BUSY byte followed by a string
+/// @param reader reader of the server messages
+/// @param text stores the string of the message, if there is one
+/// @return the type of the message, CLOSED if the connection is gone
+char read_message(Reader *reader, char *text) {
+    char type, c;
+    int i = 0;
+
+    if (read_byte(reader, &type)) { return CLOSED; }
+    if (type != QUESTION && type != ANSWER && type != CLUE && type != LEADERBOARD && type != WINNER && type != STANDING && type != RESUME && type != BUSY) { return type; }
+
+    do {
+        if (read_byte(reader, &c)) { return CLOSED; }
+        if (i < BUF_PRS_SIZE - 1) { text[i++] = c; } // longer strings are cut
+    } while (c != '\0');
+    text[i] = '\0';
+
+    return type;
+}
+
+
+/// @brief scores the question once the server replied to the answer
 /// @param client_socket_fd descriptor of the client socket
-void game(int client_socket_fd) {
-    char request, question_status, user_buf[BUF_ANS_SIZE], server_buf[BUF_PRS_SIZE];
-    int answered, points = 2;
+/// @param points total of points
+/// @param reply reply of the server: ANSWER or TIMEOUT
+/// @param question_status status of the question
+/// @param user_buf user's answer
+/// @param server_buf correct answer
+/// @return 1 if the game is over, 0 otherwise
+int verdict(int client_socket_fd, int *points, char reply, char question_status, char *user_buf, char *server_buf) {
+    char request = EXIT;
+
+    if (reply == TIMEOUT) {
+        printf(TIMES_UP);
+        (*points)--;
+    }
+    else if (compare(server_buf, user_buf) == 0) {
+        printf(CORRECT);
+        (*points)++;
+    }
+    else {
+        printf(INCORRECT);
+        (*points)--;
+    }
+    sleep(1);
 
-    memset(server_buf, '\0', BUF_PRS_SIZE);
-    printf("\n\n");
+    if (*points < 0) {
+        printf(LOSE);
+        send(client_socket_fd, &request, 1, 0); // the client "requests" its termination
+        return 1;
+    }
+    if (question_status == LAST_QUESTION) {
+        printf(WIN);
+        send(client_socket_fd, &request, 1, 0); // the client "requests" its termination
+        return 1;
+    }
+    return 0;
+}
 
-    while (1) {
-        answered = 0; // tells if the user has answered to the question
 
-        // 1. the client starts by reading the status of the question, i.e.,
-        //      if we are not in the last question (PROCEED), or
-        //      if we are in the last question (LAST_QUESTION), or exceptionally,
-        //      if the server has to terminate because of SIGINT (DISCARD)
+/// @brief sends a request followed by a string, such as the answer of the user
+/// @param client_socket_fd descriptor of the client socket
+/// @param request the request
+/// @param text the string
+void send_text(int client_socket_fd, char request, char *text) {
+    char buf[BUF_ANS_SIZE + 1];
+    int len = strlen(text);
+
+    buf[0] = request;
+    memcpy(buf + 1, text, len + 1); // the null terminator ends the string
+    send(client_socket_fd, buf, len + 2, 0);
+}
 
-        read(client_socket_fd, &question_status, 1);
 
-        if (question_status == DISCARD) { // if the server has to terminate, we also terminate the client
-            printf("server terminated\n");
-            return;
-        }
-	
-	    system("clear");
-
-        request = QUESTION;
-        send(client_socket_fd, &request, 1, 0); // 2. if status of question is ok, the client requests the question
-        read(client_socket_fd, server_buf, BUF_PRS_SIZE); // 3. the client reads the question and stores it
-        printf("%s\n", server_buf); // print the question
-
-        while (!answered) {
-            printf("> ");
-            fflush(stdout);
-            switch (get_command(STDIN_FILENO, BUF_ANS_SIZE, user_buf)) { // get user's command from stdin
-                case CMD_EXIT:
-                    request = EXIT;
-                    send(client_socket_fd, &request, 1, 0); // the client "requests" its termination
-                    return; // the client terminates
-                case CMD_HELP:
-                    printf(HELP);
+/// @brief prints the prompt, if the user can answer
+/// @param state state of the game
+void prompt(int state) {
+    if (state == PLAYING) {
+        printf("> ");
+        fflush(stdout);
+    }
+}
+
+
+/// @brief connects to the server through its local unix socket
+/// @param path filesystem path of the server's unix socket
+/// @return descriptor of the connected socket, -1 on failure
+int connect_unix(char *path) {
+    int fd;
+    struct sockaddr_un addr;
+
+    // SOCK_SEQPACKET keeps message boundaries, so each read() below returns exactly one server message
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0) { return -1; }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/// @brief connects to the server through TCP/IP
+/// @return descriptor of the connected socket, -1 on failure
+int connect_tcp() {
+    int fd;
+    struct sockaddr_in serv_addr;
+
+    // creates the client socket of type SOCK_STREAM, domain AF_INET (IPv4), protocol 0 (default)
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) { return -1; }
+
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(PORT);
+
+    // convert IPv4 and IPv6 addresses from text to binary form
+    if (inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0 || connect(fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/// @brief connects to the server
+/// @param path filesystem path of the server's unix socket, NULL to connect through TCP/IP
+/// @return descriptor of the connected socket, -1 on failure
+int connect_server(char *path) { return path != NULL ? connect_unix(path) : connect_tcp(); }
+
+
+/// @brief sends the requests that open a game: the name of the player, then the room, the tournament or the resume token
+/// @param client_socket_fd descriptor of the client socket
+/// @param room room to play in with other players, NULL to play alone
+/// @param tournament 1 to play the tournament of the server
+/// @param token resume token of the game, empty to get one
+void open_game(int client_socket_fd, char *room, int tournament, char *token) {
+    char request, name[BUF_NAME_SIZE];
+
+    // the server keeps the score of the game under this name in its leaderboard
+    snprintf(name, BUF_NAME_SIZE, "%s", getenv("USER") != NULL ? getenv("USER") : "player");
+    send_text(client_socket_fd, PLAYER_NAME, name);
+    if (room != NULL) {
+        // the questions of a room are sent once every player asked for them, the first one waits for the room to be full
+        send_text(client_socket_fd, JOIN, room);
+        printf("waiting for the other players of room %s...\n", room);
+    }
+    if (tournament) {
+        // every player of the tournament gets its questions at the same instant, the server tells when it starts
+        request = TOURNAMENT;
+        send(client_socket_fd, &request, 1, 0);
+    }
+    else if (room == NULL) { send_text(client_socket_fd, RESUME, token); }
+}
+
+
+/// @brief responsible for the game: a single loop waits on the user and on the server at the same time,
+///        so whatever the server pushes (timeouts, termination) is handled at once, even while the user is typing.
+///        a game played alone gets a resume token, if its connection breaks the client reconnects and the game goes on where it was.
+///        a server too busy to admit the client tells it when to try again, and it does
+/// @param client_socket_fd descriptor of the client socket
+/// @param path filesystem path of the server's unix socket, NULL for TCP/IP, to reconnect
+/// @param room room to play in with other players, NULL to play alone
+/// @param tournament 1 to play the tournament of the server
+/// @param resume resume token of a game to go on with, NULL to start a new one
+/// @return descriptor of the client socket, another one if the client reconnected
+int game(int client_socket_fd, char *path, char *room, int tournament, char *resume) {
+    char request, type, question_status = PROCEED, user_buf[BUF_ANS_SIZE], server_buf[BUF_PRS_SIZE], token[BUF_TOKEN_SIZE] = "";
+    int buffered, state = WAIT_STATUS, points = 2, resuming = 0, tries, busy = 0;
+    struct pollfd fds[2];
+    Reader reader;
+
+    reader.fd = client_socket_fd;
+    reader.start = reader.end = 0;
+
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = client_socket_fd;
+    fds[1].events = POLLIN;
+
+    memset(server_buf, '\0', BUF_PRS_SIZE);
+    memset(user_buf, '\0', BUF_ANS_SIZE);
+    printf("\n\n");
+
+    // the status of the new game is set aside until the server answers whether the game of the token goes on instead
+    if (resume != NULL && room == NULL && !tournament) { snprintf(token, BUF_TOKEN_SIZE, "%s", resume); }
+    resuming = token[0] != '\0';
+    open_game(client_socket_fd, room, tournament, token);
+
+    while (1) {
+        // messages that arrived together with the previous one are already in the reader, poll() would not report them
+        buffered = reader.start != reader.end;
+        if (!buffered && poll(fds, 2, -1) == -1) { continue; }
+
+        if (buffered || fds[1].revents) {
+            switch ((type = read_message(&reader, server_buf))) {
+                case PROCEED:
+                case LAST_QUESTION:
+                    // 1. the server sends the status of the question, i.e., if we are not in the last question (PROCEED), or
+                    //      if we are in the last question (LAST_QUESTION)
+                    question_status = type;
+                    if (resuming) { break; }
+                    state = WAIT_QUESTION;
+                    system("clear");
+                    request = QUESTION;
+                    send(client_socket_fd, &request, 1, 0); // 2. if status of question is ok, the client requests the question
                     break;
-                case CMD_POINTS:
-                    printf("you have a total of %d points\n", points);
+                case QUESTION:
+                    printf("%s\n", server_buf); // 3. print the question
+                    state = PLAYING;
+                    prompt(state);
                     break;
-                case CMD_CLUE:
-                    request = CLUE;
-                    send(client_socket_fd, &request, 1, 0); // the client requests a clue
-                    read(client_socket_fd, server_buf, BUF_PRS_SIZE); // the client reads the clue and stores it
+                case CLUE:
                     printf("%s\n", server_buf); // print the clue
+                    prompt(state);
                     break;
-                case CMD_INVALID:
-                    printf("invalid command!\n");
+                case WINNER:
+                    printf("\t\t\t%s answered first!\n", server_buf);
+                    prompt(state);
                     break;
-                case CMD_NOT:
-                    answered = 1;
-                    request = ANSWER;
-                    send(client_socket_fd, &request, 1, 0); // the client requests the answer
-                    read(client_socket_fd, server_buf, BUF_PRS_SIZE); // the client reads the answer and stores it
-
-                    if (compare(server_buf, user_buf) == 0) {
-                        printf(CORRECT);
-                        sleep(1);
-                        points++;
+                case STANDING:
+                    printf("\t\t\t%s\n", server_buf);
+                    prompt(state);
+                    break;
+                case RESUME:
+                    // the token of the game and its points, empty if there is no game to go on with
+                    if (sscanf(server_buf, "%16s %d", token, &points) == 2) {
+                        if (resuming) { printf("the game goes on with %d points\n", points); }
+                        else { printf("resume token of this game: %s\n", token); }
+                        resuming = 0;
+                        break;
                     }
-                    else {
-                        printf(INCORRECT);
-                        sleep(1);
-                        points--;
-                        if (points < 0) {
-                            printf(LOSE);
-                            request = EXIT;
-                            send(client_socket_fd, &request, 1, 0); // the client "requests" its termination
-                            return;
-                        }
+                    if (!resuming) { break; }
+                    printf("the game of token %s cannot be resumed, a new game starts\n", token);
+                    token[0] = '\0';
+                    resuming = 0;
+                    if (state != WAIT_STATUS) { break; } // a question of the game in the middle of which the connection broke
+                    state = WAIT_QUESTION; // the status set aside was the one of the new game
+                    request = QUESTION;
+                    send(client_socket_fd, &request, 1, 0);
+                    break;
+                case LEADERBOARD:
+                    // one score per message, an empty message after the last one
+                    if (server_buf[0] != '\0') { printf("\t%s\n", server_buf); }
+                    else { prompt(state); }
+                    break;
+                case ANSWER:
+                case TIMEOUT:
+                    // the reply to the answer of the user or, at any moment of the question, the end of its time
+                    // a question of the tournament asked once its round is over is answered with TIMEOUT instead
+                    if (state == WAIT_STATUS) { break; }
+                    if (type == TIMEOUT) { printf("\n"); }
+
+                    if (verdict(client_socket_fd, &points, type, question_status, user_buf, server_buf)) { return client_socket_fd; }
+
+                    state = WAIT_STATUS;
+                    request = NEXT_QUESTION;
+                    send(client_socket_fd, &request, 1, 0);
+                    break;
+                case DISCARD: // the server has to terminate (SIGINT) or dropped us for being idle
+                    printf("\nserver terminated\n");
+                    if (token[0]) { printf("resume the game with -k %s\n", token); }
+                    return client_socket_fd;
+                case BUSY: // the server is overloaded and closes the connection, the game starts over on a new one once it is time
+                    close(client_socket_fd);
+                    client_socket_fd = -1;
+                    if (busy++ < RECONNECT_TRIES) {
+                        printf("server busy, trying again in %d ms...\n", atoi(server_buf));
+                        usleep(atoi(server_buf) * 1000);
+                        client_socket_fd = connect_server(path);
                     }
-                    if (question_status == LAST_QUESTION) {
-                        printf(WIN);
-                        request = EXIT;
-                        send(client_socket_fd, &request, 1, 0); // the client "requests" its termination
-                        return;
+                    if (client_socket_fd == -1) {
+                        printf("\nserver busy, try again later\n");
+                        return -1;
                     }
+                    reader.fd = fds[1].fd = client_socket_fd;
+                    reader.start = reader.end = 0;
+                    state = WAIT_STATUS;
+                    open_game(client_socket_fd, room, tournament, token);
                     break;
-                default:
+                case CLOSED: // the connection broke, a game with a token goes on through a new one
+                    close(client_socket_fd);
+                    client_socket_fd = -1;
+                    for (tries = 0; token[0] && tries < RECONNECT_TRIES && client_socket_fd == -1; tries++) {
+                        printf("\nconnection lost, reconnecting...\n");
+                        sleep(1);
+                        client_socket_fd = connect_server(path);
+                    }
+                    if (client_socket_fd == -1) {
+                        printf("\nserver terminated\n");
+                        if (token[0]) { printf("resume the game with -k %s\n", token); }
+                        return -1;
+                    }
+                    reader.fd = fds[1].fd = client_socket_fd;
+                    reader.start = reader.end = 0;
+                    state = WAIT_STATUS;
+                    resuming = 1;
+                    send_text(client_socket_fd, RESUME, token);
                     break;
             }
+            continue;
         }
-        request = NEXT_QUESTION;
-        send(client_socket_fd, &request, 1, 0);
+
+        if (!fds[0].revents) { continue; }
+
+        switch (get_command(STDIN_FILENO, BUF_ANS_SIZE, user_buf)) { // get user's command from stdin
+            case CMD_EXIT:
+                request = EXIT;
+                send(client_socket_fd, &request, 1, 0); // the client "requests" its termination
+                return client_socket_fd; // the client terminates
+            case CMD_HELP:
+                printf(HELP);
+                break;
+            case CMD_POINTS:
+                printf("you have a total of %d points\n", points);
+                break;
+            case CMD_CLUE:
+                if (state != PLAYING) { break; }
+                request = CLUE;
+                send(client_socket_fd, &request, 1, 0); // the client requests a clue, printed when it arrives
+                continue;
+            case CMD_TOP:
+                printf("best scores:\n");
+                request = LEADERBOARD;
+                send(client_socket_fd, &request, 1, 0); // printed when it arrives
+                continue;
+            case CMD_INVALID:
+                printf("invalid command!\n");
+                break;
+            case CMD_EOC:
+                fds[0].fd = -1; // stdin is closed, only the server is left to wait for
+                break;
+            case CMD_NOT:
+                if (state != PLAYING) {
+                    printf("wait for the next question!\n");
+                    break;
+                }
+                state = WAIT_ANSWER;
+                // the server grades the answer for the leaderboard, the user's answer is also scored here when the correct one arrives
+                send_text(client_socket_fd, ANSWER, user_buf);
+                break;
+            default:
+                break;
+        }
+        prompt(state);
     }
 }
 
 
-int main() {
-    int client_socket_fd = 0, stop = 0;
-    struct sockaddr_in serv_addr;
+int main(int argc, char **argv) {
+    int client_socket_fd = 0, stop = 0, opt, wrong = 0, tournament = 0;
+    char *room = NULL, *resume = NULL, *path;
 
-    // creates the client socket of type SOCK_STREAM, domain AF_INET (IPv4), protocol 0 (default)
-    if ((client_socket_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        printf("failed to create client socket\n");
-        return -1;
+    // -r plays in a room, with the other players who join it, -t plays the tournament, -k goes on with the game of a resume token
+    while ((opt = getopt(argc, argv, "r:tk:")) != -1) {
+        if (opt == 'r') { room = optarg; }
+        else if (opt == 't') { tournament = 1; }
+        else if (opt == 'k') { resume = optarg; }
+        else { wrong = 1; }
     }
-
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
-
-    // convert IPv4 and IPv6 addresses from text to binary form
-    if (inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0) {
-        printf("invalid address / address not supported\n");
+    if (wrong || argc - optind > 1) {
+        printf("usage: %s [-r room] [-t] [-k resume-token] [unix-socket-path]\n", argv[0]);
         return -1;
     }
 
-    if (connect(client_socket_fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+    // with a path the client stays on this machine and talks to the server through its unix socket
+    path = optind < argc ? argv[optind] : NULL;
+    client_socket_fd = connect_server(path);
+
+    if (client_socket_fd < 0) {
         printf("connection failed \n");
         return -1;
     }
 
+    signal(SIGPIPE, SIG_IGN); // a server that sheds the client closes the connection, the requests sent meanwhile only fail
+
     system("clear"); 
 
     printf(SCREEN_HOME);
@@ -337,7 +659,7 @@ int main() {
         fflush(stdout);
         switch (get_command(STDIN_FILENO, 0, NULL)) { /* get user's command from stdin */
             case CMD_START:
-                game(client_socket_fd);
+                client_socket_fd = game(client_socket_fd, path, room, tournament, resume);
                 stop = 1;
                 break;
             case CMD_EXIT:
@@ -353,6 +675,6 @@ int main() {
                 break;
         }
     }
-    close(client_socket_fd);
+    if (client_socket_fd != -1) { close(client_socket_fd); }
     return 0;
 }
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE /* accept4(), memfd_create() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,14 +7,57 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/random.h>
 
 
 #define PORT 8080 /* port of server and client */
+#define UNIX_SOCKET_PATH "/tmp/quizia.sock" /* local clients can skip the TCP stack by connecting here */
+#define STATS_SOCKET_PATH "/tmp/quizia.stats.sock" /* every connection here receives the metrics of the server in plain text */
+#define JOURNAL_PATH "/tmp/quizia.journal" /* a line is appended here for every game played, QUIZIA_JOURNAL names another file */
+#define REVIEWS_PATH "/tmp/quizia.reviews" /* review state of every player, with -a, QUIZIA_REVIEWS names another file */
+#define SNAPSHOTS_MAGIC "QZSNAP01" /* first bytes of the file of the snapshots given with -s */
 
 #define DATABASE_PATH "../database/super-secret.db"
 
 #define BUF_PRS_SIZE 72
 #define BUF_ANS_SIZE 32
+#define BUF_NAME_SIZE 16
+#define BUF_REQ_SIZE 64
+#define BUF_STATS_SIZE 4096
+#define BUF_JOURNAL_SIZE 65536 /* initial size of the journal buffers, they grow while the disk falls behind */
+#define BUF_RECORD_SIZE 96
+
+#define MAX_SESSIONS 131072 /* sessions are indexed by their descriptor, so this is also the highest descriptor accepted */
+#define SESSION_SIZE 256 /* bytes of a session in the slab */
+#define SLOT_FREE 0 /* kinds of the slots of the slab */
+#define SLOT_CLIENT 1
+#define SLOT_STATS 2 /* a connection to the stats socket, waiting for its command */
+#define SLOT_DUMP 3 /* a connection to the stats socket being sent the histograms, see HistogramDump */
+#define MAX_EVENTS 256
+
+#define TICK_MS 100 /* resolution of the timer wheel */
+#define ADMISSION_INTERVAL_MS 100 /* the lag of the event loop is judged over intervals this long */
+#define ADMISSION_RETRY_MS 1000 /* a shed client is told to try again after this long, plus as much again at random so the retries spread */
+#define QUESTION_TIMEOUT_MS 15000 /* each question has a timer of 15 seconds */
+#define IDLE_TIMEOUT_MS 120000 /* a client that sends nothing for this long is disconnected */
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4 /* 64^4 ticks of 100ms, about 19 days */
 
 #define LAST_QUESTION 'l'
 #define NEXT_QUESTION 'n'
@@ -22,16 +67,100 @@
 #define ANSWER 'a'
 #define CLUE 'c'
 #define EXIT 'e'
+#define TIMEOUT 't'
+#define PLAYER_NAME 'u' // followed by the name of the player, as the answer is followed by the answer of the player
+#define LEADERBOARD 'b' // answered with one frame per score of the leaderboard, and an empty frame after the last one
+#define JOIN 'j' // followed by the name of a room, the player plays the game with the other players who join it
+#define WINNER 'w' // sent to every member of a room, followed by the name of the first player to answer the question right
+#define TOURNAMENT 'o' // registers the player for the tournament, whose questions are sent to every player at the same instant
+#define STANDING 's' // sent to the players of the tournament, followed by their registration or the result of a round
+#define RESUME 'r' // followed by a resume token to take up its game, or by an empty string to get a token for this one.
+                   // answered with a RESUME frame of the token and the points, empty if there is no game to resume, then the status of the resumed question
+#define BUSY 'x' // sent instead of the first status when the server sheds the client, followed by the milliseconds to wait before trying again
+
+
+#define LATENCY_BUCKETS 24 /* bucket i counts requests served in at most 2^i microseconds (and more than 2^(i-1)), the last one counts the rest */
+
+#define HDR_SUB_BITS 4 /* values below 2^4 get a bucket each, then 8 buckets (HDR_SUB / 2) per power of 2, so a value is kept within 1/8 of itself */
+#define HDR_SUB (1 << HDR_SUB_BITS)
+#define HDR_BUCKETS 256 /* up to 2^34 microseconds, about 4 hours, larger values are counted in the last bucket */
+#define BUF_DUMP_SIZE 16384
+#define DUMP_QUESTIONS 256 /* questions a histogram dump goes through per turn of the event loop, so a large bank never stalls it */
+#define DUMP_SERVICE 0 /* parts of a histogram dump, in order: the service time of each kind of request */
+#define DUMP_MERGE 1 /* the answer time of every question, merged into the one of the server */
+#define DUMP_ANSWER_TIME 2 /* the answer time of each question */
+#define DUMP_QUESTION_STATS 3 /* what the players did with each question */
+#define DUMP_DONE 4
+
+#define REQUEST_KINDS 10 /* QUESTION, ANSWER, CLUE, NEXT_QUESTION, EXIT, PLAYER_NAME, LEADERBOARD, JOIN, TOURNAMENT and RESUME, in this order */
+
+#define START_POINTS 2 /* points of a player when the game starts */
+#define TOP_K 10 /* scores kept in the leaderboard */
+
+#define ROOM_SIZE 4 /* players of a room */
+#define ROOM_WAIT_MS 10000 /* a room that is not full starts this long after it was created, with the players it has */
+#define ROOM_IDLE 0 /* states of a member of a room or a player of the tournament: has not asked for the current question yet */
+#define ROOM_WAITING 1 /* asked for it and waits for the other members, or for the round to start */
+#define ROOM_PLAYING 2 /* got it */
+
+#define DIFFICULTY_BUCKETS 32 /* with -a, questions are drawn by bucket of difficulty, then uniformly within their bucket */
+#define LEVELS 4 /* levels of the players, each level draws questions around a difficulty of its own */
+#define START_LEVEL 1
+#define GAME_QUESTIONS 10 /* questions of a game whose questions are drawn by difficulty */
+#define DRAW_TRIES 8 /* draws of a question the game already had before looking for one it did not */
+#define EXPLORE 0.05 /* weight of a bucket at any level, so no question stops being drawn and its difficulty stays current */
+
+#define REVIEWS_MAGIC "QZREV001" /* first bytes of the review store, followed by its records */
+#define REVIEW_PLAYERS 1024 /* initial buckets of the table of players of the review store, it doubles with the players */
+#define REVIEW_ITEMS 16 /* initial items of a player, they double */
+#define REVIEW_RETRY_S 60 /* a question failed is due again a minute later */
+#define REVIEW_FIRST_S 600 /* a question answered right is due again 10 minutes later, then an hour later, then ease times later */
+#define REVIEW_SECOND_S 3600
+#define REVIEW_MAX_S 31536000 /* intervals stop growing at a year */
+#define EASE_START 250 /* ease of a new item, in hundredths: its interval grows 2.5 times with every right answer */
+#define EASE_MIN 130
+#define EASE_MAX 350
+#define EASE_RIGHT 10 /* a right answer makes a question easier to the player by this much, a failed one harder by EASE_WRONG */
+#define EASE_WRONG 20
+
+#define SNAPSHOT_SLOTS 65536 /* games that can be put aside at once, a power of two */
+#define SNAPSHOT_PROBES 16 /* slots a token can be kept in, from the slot its low bits select on */
+#define SNAPSHOT_TTL_S 3600 /* a game not resumed within an hour of its last save gives its slot away */
+#define BUF_TOKEN_SIZE 48
+
+#define TOURNAMENT_PAUSE_MS 2000 /* between the deadline of a round and the next question, the players read their standing */
+#define BUF_STANDING_SIZE 80
+
+#define TRACE_EVENTS 1048576 /* spans kept when tracing, later ones are counted and dropped */
 
 #define TO_INT(c) ((c) - '0')
 
-int quit = 0;
+volatile sig_atomic_t quit = 0;
+
 
+/// @brief HDR-style histogram of times in microseconds: buckets are linear up to HDR_SUB and then 8 per power of 2,
+///        so the relative error is the same for every value, and two histograms merge by adding their counts
+typedef struct {
+    unsigned long counts[HDR_BUCKETS];
+    unsigned long count, sum_us;
+} Histogram;
+
+/// @brief what the players did with a question, its difficulty is computed from it
+typedef struct {
+    unsigned int served, answered, correct, clues; // sessions it was sent to, answers and timeouts, right answers, clue requests
+    unsigned long latency_ms; // sum of the time taken to answer, a timeout counts as the whole time
+} QuestionStats;
 
-/// @brief structure to hold the question, answer, and clue
+/// @brief structure to hold the question, answer, and clue, as the frames sent to the clients:
+///        the type byte, then the string and its null terminator, all of them back to back in the bank
 typedef struct {
     char *question, *answer, *clue;
-    int question_length, answer_length, clue_length;
+    int question_length, answer_length, clue_length; // lengths of the frames
+    Histogram *answer_time; // time players took to answer it, allocated on its first answer
+    QuestionStats stats;
+    double difficulty; // from 0, always answered right at once, to 1
+    int bucket, slot; // bucket of its difficulty, and its index in the questions of the selector
+    int index; // index in the list of the bank, the review state of the players refers to it
 } Question;
 
 /// @brief structure to hold the question node
@@ -40,6 +169,274 @@ typedef struct QuestionNode {
     struct QuestionNode *next;
 } QuestionNode;
 
+/// @brief a timer linked into one slot of the timer wheel, embedded in the structure it belongs to
+typedef struct Timer {
+    struct Timer *next, *prev;
+    unsigned long expires; // tick at which the timer fires
+} Timer;
+
+/// @brief hierarchical timer wheel: level 0 has one slot per tick, every level above has slots 64 times coarser.
+///        timers are re-inserted into a finer level when the wheel reaches their coarse slot, so arming and cancelling are O(1)
+typedef struct {
+    unsigned long now; // current tick
+    Timer slots[WHEEL_LEVELS][WHEEL_SLOTS]; // heads of circular lists
+} TimerWheel;
+
+/// @brief counters of the server, the event loop is its only writer and reader so they need no synchronization
+typedef struct {
+    unsigned long questions, answers, clues, timeouts; // requests served and verdicts sent
+    unsigned long sessions_active, sessions_total;
+    unsigned long bytes_in, bytes_out;
+    unsigned long latency[LATENCY_BUCKETS], latency_sum_us; // time from reading a request to having responded to it
+    Histogram service[REQUEST_KINDS]; // the same time per kind of request
+} Metrics;
+
+/// @brief admission control: a client beyond the limits is sent BUSY with a retry hint and closed as soon as it is accepted,
+///        so the players already admitted keep their latency during a spike. the lag of the event loop is how long the last
+///        ready event of a batch waited and took, and the server sheds while the shortest lag of a whole interval is above the target,
+///        so a single slow batch sheds nobody
+typedef struct {
+    int max_clients; // sessions served at once, 0 for no limit
+    long target_ns; // lag above which new clients are shed, 0 for no target
+    long interval_start, lag_min; // the shortest lag of the current interval
+    long lag; // the shortest lag of the last interval
+    int overloaded; // it was above the target
+    unsigned long shed_full, shed_lag; // clients shed for each reason
+    unsigned long seed; // random state of the retry hints, seeded per run so restarted servers spread their clients differently
+} Admission;
+
+/// @brief a span of time spent on a client, one complete event of the Chrome trace format
+typedef struct {
+    char *name; // a string literal
+    long start, end; // monotonic clock, in nanoseconds
+    int fd; // descriptor of the client, spans are grouped by it
+} TraceEvent;
+
+/// @brief spans recorded only when QUIZIA_TRACE names a file, they are written there as Chrome trace-event JSON on shutdown
+typedef struct {
+    char *path;
+    TraceEvent *events; // NULL when tracing is off
+    long count, dropped;
+} Trace;
+
+/// @brief histograms being sent to a connection of the stats socket: they are formatted a buffer at a time, each time the socket
+///        is writable again, so neither a client that reads slowly nor a large bank holds up the event loop
+typedef struct HistogramDump {
+    int fd;
+    int part; // DUMP_SERVICE to DUMP_DONE
+    int question; // index in the bank of the next question of the part
+    int len, sent; // bytes formatted into buf, and bytes of them sent
+    Histogram all; // answer time over every question, merged during DUMP_MERGE
+    struct HistogramDump *next;
+    char buf[BUF_DUMP_SIZE];
+} HistogramDump;
+
+/// @brief the database as read, turned in place into the frames of its questions
+typedef struct {
+    char *frames;
+    long size; // bytes allocated
+    int fd; // memfd the frames are mapped from when they are sent with sendfile(), -1 when they are on the heap and sent with send()
+    struct QuestionNode **nodes; // questions by index, Question.index is their place, the reviews and the snapshots refer to them by it
+    int count;
+} Bank;
+
+/// @brief a score of the leaderboard: the best score a game reached
+typedef struct {
+    char name[BUF_NAME_SIZE];
+    int score;
+    unsigned long game; // number of the session, a game is in the leaderboard once
+} Score;
+
+/// @brief the TOP_K best scores of every game played since the server started, best first
+typedef struct {
+    Score scores[TOP_K];
+    int count;
+} Leaderboard;
+
+/// @brief append-only journal of the games played: the event loop appends their records to a buffer in memory,
+///        a writer thread takes the whole buffer at once, writes it and makes it durable with a single fdatasync() (group commit)
+typedef struct {
+    char *path;
+    int fd, stop;
+    char *pending, *committing; // the event loop appends to pending while the writer writes committing, they are swapped under mtx
+    long pending_len, pending_size, committing_size;
+    unsigned long pending_records;
+    unsigned long records, commits, failed; // records made durable, fdatasync() calls, and records lost to a failed write
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    pthread_t writer;
+} Journal;
+
+/// @brief players who play the same questions at the same time: a question is sent to all of them once every one has asked for it,
+///        and the first right answer wins the question, announced to all of them with a single WINNER frame
+typedef struct Room {
+    char name[BUF_NAME_SIZE];
+    struct Session *members[ROOM_SIZE];
+    int count, ready; // members, and members waiting for the current question
+    int round; // questions sent so far, players join only before the first one
+    long created;
+    struct Session *winner; // first member to answer the current question right
+    struct Room *next;
+} Room;
+
+/// @brief draws the questions of a game by difficulty in O(1): the questions are kept in an array grouped by bucket of difficulty,
+///        the alias table of the level of the player picks a bucket, weighted by its questions and how close it is to the level,
+///        then a question of the bucket is picked uniformly. a question whose difficulty drifts into another bucket moves there
+///        by a swap at each bucket boundary it crosses, and only the alias tables, one entry per bucket, are rebuilt
+typedef struct {
+    struct QuestionNode **order; // bucket b is order[start[b]] to order[start[b + 1] - 1], NULL when questions are sent in the order of the bank
+    int count; // questions
+    int start[DIFFICULTY_BUCKETS + 1];
+    double prob[LEVELS][DIFFICULTY_BUCKETS]; // chance of keeping the column drawn rather than taking its alias
+    int alias[LEVELS][DIFFICULTY_BUCKETS];
+    int dirty; // buckets changed since the alias tables were built
+    unsigned long moves, rebuilds;
+    struct QuestionNode *head; // first question of the bank, rooms and the tournament play in the order of the bank
+} Selector;
+
+/// @brief review state of a question for a player (SM-2): answered right, it is due again after an interval that grows by its ease,
+///        failed, it is due again soon and its ease drops
+typedef struct {
+    int question; // index of the question in the bank
+    unsigned int due; // seconds since the epoch
+    unsigned int interval; // seconds
+    unsigned short ease; // hundredths
+    unsigned short streak; // right answers in a row
+} Review;
+
+/// @brief an entry of the index of the items of a player
+typedef struct {
+    int question, place; // question -1 when the entry is free
+} ReviewPlace;
+
+/// @brief review state of one player: a binary min-heap of its items by due time, so the first question due is at the top,
+///        and an open-addressing index from question to place in the heap, so the item of any question is found and rescheduled in O(log n)
+typedef struct ReviewPlayer {
+    char name[BUF_NAME_SIZE];
+    Review *heap;
+    ReviewPlace *index; // 2 * size entries, a power of two
+    int count, size;
+    struct ReviewPlayer *next; // next player of the same bucket
+} ReviewPlayer;
+
+/// @brief a record of the review store, the state of one item of a player. the file is the records appended as items change after
+///        REVIEWS_MAGIC, replayed in order when the server starts and rewritten with one record per item when it terminates
+typedef struct {
+    char name[BUF_NAME_SIZE];
+    unsigned long key; // hash of the text of the question, so the store outlives changes to the order or the size of the bank
+    unsigned int due, interval;
+    unsigned short ease, streak;
+} ReviewRecord;
+
+/// @brief every player's review state, with -a: a game serves the questions its player has due before drawing any
+typedef struct {
+    char *path;
+    FILE *file; // records are appended through its buffer, flushed when a session closes
+    ReviewPlayer **buckets; // NULL when there is no store
+    int buckets_count, players; // buckets is a power of two
+    unsigned long items, served, appended; // items of every player, reviews served, records appended since the store was written
+} ReviewStore;
+
+/// @brief what a game needs to go on after its connection broke or the server restarted, a fixed-size record per game that has a resume token
+typedef struct {
+    unsigned long token; // 0 when the slot is free
+    unsigned long game; // number of the game, it keeps it on every connection so it is in the leaderboard once
+    unsigned long owner; // session that saves the game, a resume hands it to the new one
+    long saved; // seconds since the epoch
+    char name[BUF_NAME_SIZE];
+    int question; // index of the current question in the bank
+    int graded; // the current question was answered or timed out, the game goes on from the next one
+    int position, points, best, answered, clues;
+    int adaptive, level;
+    unsigned long seed;
+    int played[GAME_QUESTIONS]; // indices of the questions of the game so far, when drawn by difficulty
+} Snapshot;
+
+/// @brief first bytes of the table of snapshots
+typedef struct {
+    char magic[sizeof(SNAPSHOTS_MAGIC) - 1];
+    int slots, questions;
+    unsigned long bank; // hash of the texts of the questions, the snapshots of another bank are dropped
+} SnapshotHeader;
+
+/// @brief the snapshots of the games that have a resume token, SNAPSHOT_SLOTS records behind a header, open addressing on the token.
+///        with -s it is a file mapped into the server, so a save is a few stores to memory and the games outlive the server
+typedef struct {
+    char *path; // NULL when the table is anonymous memory
+    SnapshotHeader *header;
+    Snapshot *slots;
+    long size; // bytes mapped
+    int count; // slots taken
+    unsigned long issued, resumed;
+} Snapshots;
+
+/// @brief a tournament scheduled with -T: every registered player gets each question at the same instant and has until the same deadline
+///        to answer it. answers are tallied as they are graded, so at the deadline the round is resolved in a single pass over the players:
+///        those who did not answer time out, and every player is sent their rank, counted from the number of players per score
+typedef struct {
+    long start; // when the first question is sent, monotonic clock in nanoseconds, 0 when there is no tournament
+    long window; // nanoseconds the players have to answer a question
+    int rounds, released; // questions of the tournament, and questions sent so far
+    int open; // the last question sent still takes answers
+    struct Session **players; // registered players, in no particular order
+    int count, size;
+    int answered, right; // answers to the open question, counted as they are graded
+    long resolve_ns; // time the last round took to resolve
+} Tournament;
+
+/// @brief state of one connection, a slot of the slab of sessions indexed by descriptor. the fields are sized to what they hold
+///        and what a request reads comes first, so a session is SESSION_SIZE bytes, four cache lines, and an idle one costs nothing else
+typedef struct Session {
+    int fd;
+    unsigned char kind; // SLOT_FREE, SLOT_CLIENT, SLOT_STATS or SLOT_DUMP
+    char pending; // ANSWER, PLAYER_NAME, JOIN or RESUME while their string is being read, 0 otherwise
+    unsigned char text_len;
+    unsigned char timed_out; // the deadline of the current question has passed, requests for it are ignored
+    unsigned char graded; // the current question was answered or timed out
+    unsigned char room_state; // ROOM_IDLE, ROOM_WAITING or ROOM_PLAYING for the current question
+    unsigned char adaptive; // the questions are drawn by difficulty, see Selector
+    unsigned char level; // level of the player, from 0 to LEVELS - 1, up with every right answer and down with every failed one
+    unsigned char finished; // the game ended, its snapshot is dropped with the session
+    int question_number;
+    int points, best; // the server grades the answers, so the score of a game is kept here and not only by the client
+    int answered; // questions graded
+    int clues; // clues asked in the game
+    int position; // index of the current question in the game
+    int seat; // index in the players of the tournament, -1 when not registered
+    int snapshot; // slot of the game in the snapshots, -1 when it has no resume token
+    QuestionNode *node; // current question
+    long question_sent; // when the current question was first sent, 0 until then and once it is answered
+    char text[BUF_ANS_SIZE]; // the string being read, longer strings are cut
+    Timer deadline, idle;
+    Room *room; // NULL when the player plays alone
+    ReviewPlayer *reviews; // review state of the player, once it sent its name in a game drawn by difficulty
+    unsigned long seed; // random state of the draws
+    unsigned long game; // number of the session
+    long opened; // when the session was opened, for the journal
+    unsigned long token;
+    char name[BUF_NAME_SIZE];
+    int played[GAME_QUESTIONS]; // indices in the bank of the questions of the game so far, it has each question once
+} __attribute__((aligned(64))) Session;
+
+_Static_assert(sizeof(Session) == SESSION_SIZE, "a session no longer fits in SESSION_SIZE bytes");
+
+
+Bank bank = { NULL, 0, -1, NULL, 0 };
+Metrics metrics; // reported through the stats socket
+Admission admission;
+Trace trace;
+HistogramDump *dumps = NULL; // histogram dumps still being sent
+Leaderboard leaderboard;
+Room *rooms = NULL; // rooms with at least one member
+Tournament tournament;
+Selector selector;
+ReviewStore reviews;
+Snapshots snapshots;
+Journal journal = { NULL, -1, 0, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+Session *sessions; // the slab, MAX_SESSIONS sessions indexed by descriptor, its pages are only touched as descriptors are used
+int socket_buffer = 0; // bytes asked for the send and receive buffers of every client socket, 0 for the defaults of the kernel
+int log_clients = 0; // QUIZIA_LOG=debug, a line per connection and request: otherwise the event loop never writes to stdout for a client
+
 
 void sigint_handler() { quit = 1; }
 
@@ -48,6 +445,18 @@ void sigpipe_handler() { signal(SIGPIPE, sigpipe_handler); }
 
 
 
+/// @brief prints a line about a client, with QUIZIA_LOG=debug only: the stats socket counts what they would tell
+/// @param format format of the line, as printf()
+void client_log(const char *format, ...) {
+    va_list args;
+
+    if (!log_clients) { return; }
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+
 /// @brief frees all the memory allocated
 /// @param head head of linked list
 void clear(QuestionNode **head) {
@@ -56,104 +465,153 @@ void clear(QuestionNode **head) {
     while (*head != NULL) {
         node = *head;
         *head = (**head).next;
-        free((*(*node).question).question);
-        free((*(*node).question).answer);
-        free((*(*node).question).clue);
+        free((*(*node).question).answer_time);
         free((*node).question);
         free(node);
     }
+    free(selector.order);
+    selector.order = NULL;
+    free(bank.nodes);
+    bank.nodes = NULL;
+    if (bank.fd != -1) {
+        munmap(bank.frames, bank.size);
+        close(bank.fd);
+    }
+    else { free(bank.frames); }
+    bank.frames = NULL;
+    bank.fd = -1;
 }
 
 
-/// @brief duplicates a string
-/// @param src string to be duplicated
-/// @return pointer to a null-terminated string, which is a duplicate of the src string
-char *duplicate(char *src) {
-    char *str, *p;
-    int len = 0;
+/// @brief parses the next line of the bank and turns it, in place, into the frame sent to the clients:
+///        its type byte, then the string and its null terminator. a frame is never longer than its line, so it never overwrites lines still to parse
+/// @param line next line of the bank, moved past it
+/// @param end end of the bank
+/// @param frame where the frame is written, moved past it
+/// @param type QUESTION, ANSWER or CLUE
+/// @param len length of the frame
+/// @return 0 and frame length if parsed successfully, 1 at EOF, -1 if the line is not formatted
+int parse_line(char **line, char *end, char **frame, char type, int *len) {
+    char *c = *line, *next;
+    int count = 0, bytes = 0;
+
+    for (; c < end && *c >= '0' && *c <= '9'; c++, count++) { bytes = (bytes * 10) + TO_INT(*c); }
+    if (c == end) { return 1; } /* EOF */
+    if (!count) {
+        printf("database is not formatted: line needs to start with its size\n");
+        return -1;
+    }
+    if (bytes >= BUF_PRS_SIZE) { /* the clients could not take the frame */
+        printf("database is not formatted: lines can not be longer than %d\n", BUF_PRS_SIZE - 1);
+        return -1;
+    }
+    if (end - c < bytes) {
+        printf("database is not formatted: line is shorter than its size\n");
+        return -1;
+    }
+    next = c + bytes;
+    if (next < end && *next == '\n') { next++; } /* checked before the null terminator is written over it */
 
-    while (src[len]) { len++; }
-    str = malloc(len + 1);
-    p = str;
-    while (*src) { *(p++) = *(src++); }
-    *p = '\0';
+    (*frame)[0] = type;
+    memmove(*frame + 1, c, bytes);
+    (*frame)[bytes + 1] = '\0';
 
-    return str;
+    *len = bytes + 2;
+    *frame += bytes + 2;
+    *line = next;
+    return 0;
 }
 
 
-/// @brief parses the next line from the database
-/// @param fd file descriptor of database
-/// @param buf buffer to store the information of the line
-/// @param len length of line
-/// @return 0 and line length if parsed successfully, 1 otherwise
-int parse_line(int fd, char *buf, int *len) {
-    char c;
-    int n, count = 0, bytes = 0;
+/// @brief allocates the memory the database is read into: the heap, or a memfd mapped into the server so sendfile() can send frames straight from it
+/// @param size size of the database
+/// @param zero_copy 1 to back the bank with a memfd
+/// @return 0 on success, 1 otherwise
+int bank_alloc(long size, int zero_copy) {
+    bank.size = size + 1; // never 0, mmap() would refuse it
 
-    while ((n = read(fd, &c, 1)) == 1 && c >= '0' && c <= '9') { 
-        bytes = (bytes * 10) + TO_INT(c);
-        count++;
-    }
-    if (n != 1) { /* EOF */
-        close(fd);
-        return 1;
-    }
-    if (!count) {
-        printf("database is not formatted: line needs to start with its size\n");
-        close(fd);
+    if (!zero_copy) { return (bank.frames = malloc(bank.size)) == NULL; }
+
+    if ((bank.fd = memfd_create("quizia-bank", 0)) == -1) { return 1; }
+    if (ftruncate(bank.fd, bank.size) == -1 || (bank.frames = mmap(NULL, bank.size, PROT_READ | PROT_WRITE, MAP_SHARED, bank.fd, 0)) == MAP_FAILED) {
+        close(bank.fd);
+        bank.frames = NULL;
+        bank.fd = -1;
         return 1;
     }
-    buf[0] = c;
-    read(fd, buf + 1, bytes); /* newline included */
-    buf[bytes] = '\0';
-
-    *len = bytes;
-
     return 0;
 }
 
 
-/// @brief parses the database into a linked list
+/// @brief reads the whole database at once and parses it into a linked list, the frames of every question end up back to back in the bank
 /// @param head head of linked list to store the questions
+/// @param database_path path of the database
+/// @param zero_copy 1 to read it into a memfd, its frames are then sent with sendfile()
 /// @return 0 if parsed successfully, 1 otherwise
-int parser(QuestionNode **head) {
-    int fd, len;
-    char buf[BUF_PRS_SIZE];
+int parser(QuestionNode **head, char *database_path, int zero_copy) {
+    int fd, status, len[3];
+    long size = 0, n = 0;
+    char *line, *end, *frame, *frames[3];
+    struct stat st;
 
-    if ((fd = open(DATABASE_PATH, O_RDONLY)) == -1) {
+    if ((fd = open(database_path, O_RDONLY)) == -1) {
         printf("failed to open database\n");
         return 1;
     }
+    if (fstat(fd, &st) == -1 || bank_alloc(st.st_size, zero_copy)) {
+        printf("memory error\n");
+        close(fd);
+        return 1;
+    }
+    while (size < st.st_size && (n = read(fd, bank.frames + size, st.st_size - size)) > 0) { size += n; }
+    close(fd);
+    if (n == -1) {
+        printf("failed to read database\n");
+        clear(head);
+        return 1;
+    }
+
+    line = frame = bank.frames;
+    end = bank.frames + size;
     while (1) {  /* we will parse 3 lines in each iteration, until we reach EOF */
         Question *q = malloc(sizeof(Question));
         QuestionNode *node = malloc(sizeof(QuestionNode));
 
         if (q == NULL || node == NULL) {
             printf("memory error\n");
+            free(q);
+            free(node);
             clear(head);
-            close(fd);
             return 1;
         }
-        
+
         /* parse line (Question) - will return 1 if EOF is reached */
-        if (parse_line(fd, buf, &len)) {
+        frames[0] = frame;
+        if ((status = parse_line(&line, end, &frame, QUESTION, &len[0])) == 1) {
             free(q);
             free(node);
             break;
         }
-        (*q).question = duplicate(buf);
-        (*q).question_length = len;
-        
-        /* parse line (Answer) */
-        parse_line(fd, buf, &len);
-        (*q).answer = duplicate(buf);
-        (*q).answer_length = len;
 
-        /* parse line (Clue) */
-        parse_line(fd, buf, &len);
-        (*q).clue = duplicate(buf);
-        (*q).clue_length = len;
+        /* parse lines (Answer) and (Clue), a question cut short is not formatted either */
+        frames[1] = frame;
+        if (status == 0) { status = parse_line(&line, end, &frame, ANSWER, &len[1]); }
+        frames[2] = frame;
+        if (status == 0) { status = parse_line(&line, end, &frame, CLUE, &len[2]); }
+        if (status != 0) {
+            if (status == 1) { printf("database is not formatted: every question needs an answer and a clue\n"); }
+            free(q);
+            free(node);
+            clear(head);
+            return 1;
+        }
+        (*q).question = frames[0];
+        (*q).question_length = len[0];
+        (*q).answer = frames[1];
+        (*q).answer_length = len[1];
+        (*q).clue = frames[2];
+        (*q).clue_length = len[2];
+        (*q).answer_time = NULL;
 
         (*node).question = q;
 
@@ -165,130 +623,2448 @@ int parser(QuestionNode **head) {
 }
 
 
-/// @brief handles the client
-/// @param client_socket_fd descriptor of the client socket
+/// @brief numbers the questions in the order of the list and indexes them by number
 /// @param head head of linked list
-void handle_client(int client_socket_fd, QuestionNode **head) {
-    int n, i = 0;
-    QuestionNode *node = *head;
-
-    printf("client log:\n");
-
-    while (node != NULL) {
-        char c;
-        int next_question = 0;
-
-        // 1. the server starts by writing the status of the question to the client, i.e,
-        //      if we not in the last question, the server sends PROCEED
-        //      if we are in the last question, the server sends LAST_QUESTION
-        //      if the server has to terminate the connection, the server sends DISCARD
-        if ((*node).next == NULL) { c = LAST_QUESTION; }
-        else if (quit) { c = DISCARD; }
-        else { c = PROCEED; }
-
-        send(client_socket_fd, &c, 1, 0);
-
-        while ((n = read(client_socket_fd, &c, 1)) == 1) {
-            switch (c) {
-                case QUESTION:
-                    send(client_socket_fd, (*(*node).question).question, (*(*node).question).question_length + 1, 0);
-                    printf("question %d\n", i++);
-                    break;
-                case ANSWER:
-                    send(client_socket_fd, (*(*node).question).answer, (*(*node).question).answer_length + 1, 0);
-                    printf("answered\n");
-                    break;
-                case CLUE:
-                    send(client_socket_fd, (*(*node).question).clue, (*(*node).question).clue_length + 1, 0);
-                    printf("clue\n");
-                    break;
-                case NEXT_QUESTION:
-                    next_question = 1;
-                    break;
-                case EXIT:
-                    printf("client disconnected: /exit command\n");
-                    return;
-            }
-            if (next_question) { break; }
-        }
-        if (n == 0) {
-            printf("client disconnected\n");
-            return;
-        }
-        node = (*node).next;
+/// @param count questions of the bank
+/// @return 0 on success, 1 otherwise
+int bank_index(QuestionNode *head, int count) {
+    int i;
+
+    if ((bank.nodes = malloc((count + 1) * sizeof(QuestionNode *))) == NULL) { return 1; }
+    for (i = 0; head != NULL; head = (*head).next, i++) {
+        (*(*head).question).index = i;
+        bank.nodes[i] = head;
     }
+    bank.count = count;
+    return 0;
 }
 
 
+/// @brief memory resident in the process, reported once the database is loaded and on the stats socket
+/// @return resident memory in KiB, 0 if unknown
+long resident_kib() {
+    long pages = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
 
+    if (file == NULL) { return 0; }
+    if (fscanf(file, "%*s %ld", &pages) != 1) { pages = 0; }
+    fclose(file);
 
-int main() {
-    int server_socket_fd, client_socket_fd;
-    struct sockaddr_in address; // struct that holds the address of the server
-    int socket_options = 1; /* to enable the sockets options */
-    int addrlen = sizeof(address);
-    QuestionNode *linked_list_questions_head = NULL;
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
 
-    if (parser(&linked_list_questions_head)) {
-        printf("failed to parse the database\n");
-        return 1;
+
+/// @brief memory of the slab of sessions the kernel backs, the pages of the descriptors used so far
+/// @return resident memory in KiB, 0 if unknown
+long slab_kib() {
+    static unsigned char pages[MAX_SESSIONS * sizeof(Session) / 4096 + 1];
+    long page = sysconf(_SC_PAGESIZE), len = MAX_SESSIONS * sizeof(Session), i, resident = 0;
+
+    if (len / page + 1 > (long)sizeof(pages) || mincore(sessions, len, pages) == -1) { return 0; }
+    for (i = 0; i < (len + page - 1) / page; i++) { resident += pages[i] & 1; }
+    return resident * (page / 1024);
+}
+
+
+/// @brief initializes an empty timer wheel
+/// @param wheel wheel to initialize
+/// @param now current tick
+void wheel_init(TimerWheel *wheel, unsigned long now) {
+    int level, slot;
+
+    (*wheel).now = now;
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+            (*wheel).slots[level][slot].next = &(*wheel).slots[level][slot];
+            (*wheel).slots[level][slot].prev = &(*wheel).slots[level][slot];
+        }
     }
-    printf("database parsed successfully\n");
+}
 
-    // creates the server socket of type SOCK_STREAM, domain AF_INET (IPv4), protocol 0 (default)
-    if ((server_socket_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        clear(&linked_list_questions_head);
-        perror("failed to create socket");
-        exit(EXIT_FAILURE);
+
+/// @brief links a timer into the slot matching its expiry
+/// @param wheel timer wheel
+/// @param timer timer with expires already set
+void wheel_place(TimerWheel *wheel, Timer *timer) {
+    int level = 0;
+    unsigned long delta = (*timer).expires - (*wheel).now;
+    Timer *head;
+
+    if ((*timer).expires < (*wheel).now) { delta = 0; }
+    if (delta >= 1UL << (WHEEL_BITS * WHEEL_LEVELS)) { // beyond the range of the wheel, it fires at the end of the range
+        delta = (1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+        (*timer).expires = (*wheel).now + delta;
     }
+    while (level < WHEEL_LEVELS - 1 && delta >= 1UL << (WHEEL_BITS * (level + 1))) { level++; }
 
-    // set socket options to reuse the address and port number immediately after the server terminates
-    // this is useful when the server crashes and you want to restart it without waiting for the port to be released
-    if (setsockopt(server_socket_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &socket_options, sizeof(socket_options))) {
-        clear(&linked_list_questions_head);
-        perror("setsockopt");
-        exit(EXIT_FAILURE);
+    head = &(*wheel).slots[level][((*timer).expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    (*timer).next = head;
+    (*timer).prev = (*head).prev;
+    (*(*head).prev).next = timer;
+    (*head).prev = timer;
+}
+
+
+/// @brief arms a timer, a timer that is already armed is moved
+/// @param wheel timer wheel
+/// @param timer timer to arm
+/// @param ms milliseconds until it fires
+void timer_arm(TimerWheel *wheel, Timer *timer, int ms) {
+    unsigned long ticks = (ms + TICK_MS - 1) / TICK_MS;
+
+    if ((*timer).next != NULL) {
+        (*(*timer).prev).next = (*timer).next;
+        (*(*timer).next).prev = (*timer).prev;
     }
+    (*timer).expires = (*wheel).now + (ticks ? ticks : 1); // the slot of the current tick was already processed
+    wheel_place(wheel, timer);
+}
 
-    // address family is AF_INET, IP address is INADDR_ANY, and port number is PORT
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY; // INADDR_ANY means the server will bind to all network interfaces on the host machine
-    address.sin_port = htons(PORT);
 
-    // bind the server socket to the address and port number
-    if (bind(server_socket_fd, (struct sockaddr *)&address, sizeof(address))<0) {
-        clear(&linked_list_questions_head);
-        perror("bind failed");
-        exit(EXIT_FAILURE);
+/// @brief cancels a timer
+/// @param timer timer to cancel
+/// @return 1 if the timer was armed, 0 if it had already fired or was never armed
+int timer_cancel(Timer *timer) {
+    if ((*timer).next == NULL) { return 0; }
+
+    (*(*timer).prev).next = (*timer).next;
+    (*(*timer).next).prev = (*timer).prev;
+    (*timer).next = NULL;
+    (*timer).prev = NULL;
+    return 1;
+}
+
+
+/// @brief moves the wheel forward up to the given tick, collecting every timer that fires on the way
+/// @param wheel timer wheel
+/// @param now tick to advance to
+/// @param expired head of the list that receives the expired timers, they are unlinked from the wheel
+void wheel_advance(TimerWheel *wheel, unsigned long now, Timer *expired) {
+    int level;
+    Timer *head, *timer;
+
+    while ((*wheel).now < now) {
+        (*wheel).now++;
+
+        // when a level wraps around, the next slot of the level above is spread over the finer levels
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            if (((*wheel).now & ((1UL << (WHEEL_BITS * level)) - 1)) != 0) { break; }
+
+            head = &(*wheel).slots[level][((*wheel).now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+            while ((timer = (*head).next) != head) {
+                (*head).next = (*timer).next;
+                (*(*timer).next).prev = head;
+                wheel_place(wheel, timer);
+            }
+        }
+
+        head = &(*wheel).slots[0][(*wheel).now & WHEEL_MASK];
+        while ((timer = (*head).next) != head) {
+            (*head).next = (*timer).next;
+            (*(*timer).next).prev = head;
+            (*timer).next = expired;
+            (*timer).prev = (*expired).prev;
+            (*(*expired).prev).next = timer;
+            (*expired).prev = timer;
+        }
     }
+}
 
-    // listen for incoming connections
-    if (listen(server_socket_fd, 3) < 0) {
-        clear(&linked_list_questions_head);
-        perror("listen");
-        exit(EXIT_FAILURE);
+
+/// @brief current time of the monotonic clock in ticks of the timer wheel
+unsigned long current_tick() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000UL + ts.tv_nsec / 1000000) / TICK_MS;
+}
+
+
+/// @brief current time of the monotonic clock
+/// @return time in nanoseconds
+long now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+/// @brief CPU time the server has used so far
+/// @return user and system time, in microseconds
+long cpu_us() {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+
+/// @brief writes the journal: takes every record appended since its last commit, writes them and calls fdatasync() once for all of them,
+///        so the records of the games that end while the disk is busy are made durable together
+void *run_journal() {
+    char *buf;
+    long len, done, n;
+    unsigned long records;
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL); // the event loop has to get SIGINT
+
+    pthread_mutex_lock(&journal.mtx);
+    while (1) {
+        while (journal.pending_len == 0 && !journal.stop) { pthread_cond_wait(&journal.cond, &journal.mtx); }
+        if (journal.pending_len == 0) { break; } // stopped, and every record is written
+
+        buf = journal.pending;
+        len = journal.pending_len;
+        records = journal.pending_records;
+        journal.pending = journal.committing;
+        journal.committing = buf;
+        n = journal.pending_size;
+        journal.pending_size = journal.committing_size;
+        journal.committing_size = n;
+        journal.pending_len = 0;
+        journal.pending_records = 0;
+        pthread_mutex_unlock(&journal.mtx);
+
+        for (done = 0; done < len; done += n) {
+            if ((n = write(journal.fd, buf + done, len - done)) == -1 && errno == EINTR) { n = 0; }
+            else if (n == -1) { break; }
+        }
+        n = done < len || fdatasync(journal.fd) == -1;
+
+        pthread_mutex_lock(&journal.mtx);
+        if (n) { journal.failed += records; }
+        else { journal.records += records; }
+        journal.commits++;
     }
+    pthread_mutex_unlock(&journal.mtx);
+    return NULL;
+}
 
-    // accept incoming connection from client and create a new socket for the client
-    if ((client_socket_fd = accept(server_socket_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen))<0) {
-        clear(&linked_list_questions_head);
-        perror("accept");
-        exit(EXIT_FAILURE);
+
+/// @brief opens the journal, the file named by QUIZIA_JOURNAL or JOURNAL_PATH, and starts its writer
+/// @return 0 on success, 1 otherwise
+int journal_start() {
+    if ((journal.path = getenv("QUIZIA_JOURNAL")) == NULL) { journal.path = JOURNAL_PATH; }
+    if ((journal.fd = open(journal.path, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1) { return 1; }
+
+    journal.pending = malloc(BUF_JOURNAL_SIZE);
+    journal.committing = malloc(BUF_JOURNAL_SIZE);
+    journal.pending_size = journal.committing_size = BUF_JOURNAL_SIZE;
+    if (journal.pending == NULL || journal.committing == NULL) { return 1; }
+
+    return pthread_create(&journal.writer, NULL, run_journal, NULL) != 0;
+}
+
+
+/// @brief appends the record of a game to the journal, one line: end time in milliseconds since the epoch, player, score,
+///        questions answered and duration in milliseconds. it never waits for the disk, only for the writer to swap buffers
+/// @param session session of the game
+void journal_append(Session *session) {
+    char record[BUF_RECORD_SIZE], *buf;
+    int len;
+    struct timespec ts;
+
+    if (journal.fd == -1) { return; }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    len = snprintf(record, BUF_RECORD_SIZE, "%ld %s %d %d %ld\n", ts.tv_sec * 1000L + ts.tv_nsec / 1000000, (*session).name,
+                   (*session).points, (*session).answered, (now_ns() - (*session).opened) / 1000000);
+
+    pthread_mutex_lock(&journal.mtx);
+    if (journal.pending_len + len > journal.pending_size) {
+        if ((buf = realloc(journal.pending, 2 * journal.pending_size)) == NULL) {
+            journal.failed++;
+            pthread_mutex_unlock(&journal.mtx);
+            return;
+        }
+        journal.pending = buf;
+        journal.pending_size *= 2;
     }
-    printf("connection established with client.\n");
+    memcpy(journal.pending + journal.pending_len, record, len);
+    journal.pending_len += len;
+    journal.pending_records++;
+    pthread_cond_signal(&journal.cond);
+    pthread_mutex_unlock(&journal.mtx);
+}
 
-    signal(SIGINT, sigint_handler);
-    signal(SIGPIPE, sigpipe_handler);
 
-    handle_client(client_socket_fd, &linked_list_questions_head);
+/// @brief stops the writer once every record appended is written, and closes the journal
+void journal_stop() {
+    if (journal.fd == -1) { return; }
+
+    pthread_mutex_lock(&journal.mtx);
+    journal.stop = 1;
+    pthread_cond_signal(&journal.cond);
+    pthread_mutex_unlock(&journal.mtx);
+    pthread_join(journal.writer, NULL);
+
+    printf("%lu games written to the journal %s in %lu commits, %lu lost\n", journal.records, journal.path, journal.commits, journal.failed);
+    close(journal.fd);
+    free(journal.pending);
+    free(journal.committing);
+}
+
+
+/// @brief records how long a request took to serve in the latency histogram
+/// @param ns time in nanoseconds
+void record_latency(long ns) {
+    unsigned long us = ns / 1000, bits;
+    int bucket = 0;
+
+    metrics.latency_sum_us += us;
+    for (bits = us ? us - 1 : 0; bits && bucket < LATENCY_BUCKETS - 1; bits >>= 1) { bucket++; } // smallest i such that us <= 2^i
+    metrics.latency[bucket]++;
+}
+
+
+/// @brief bucket of a value
+/// @param us value in microseconds
+/// @return index of the bucket
+int hdr_bucket(unsigned long us) {
+    int shift = 0, bucket;
+    unsigned long top;
+
+    if (us < HDR_SUB) { return us; }
+    for (top = us >> HDR_SUB_BITS; top; top >>= 1) { shift++; } // the bucket is 2^shift wide
+    bucket = HDR_SUB + (shift - 1) * (HDR_SUB / 2) + (int)(us >> shift) - HDR_SUB / 2;
+    return bucket < HDR_BUCKETS ? bucket : HDR_BUCKETS - 1;
+}
+
+
+/// @brief highest value counted in a bucket
+/// @param bucket index of the bucket
+/// @return value in microseconds
+unsigned long hdr_highest(int bucket) {
+    int shift;
+
+    if (bucket < HDR_SUB) { return bucket; }
+    shift = (bucket - HDR_SUB) / (HDR_SUB / 2) + 1;
+    return ((unsigned long)((bucket - HDR_SUB) % (HDR_SUB / 2) + HDR_SUB / 2 + 1) << shift) - 1;
+}
+
+
+/// @brief records a time in a histogram
+/// @param histogram histogram
+/// @param ns time in nanoseconds
+void hdr_record(Histogram *histogram, long ns) {
+    unsigned long us = ns / 1000;
+
+    (*histogram).counts[hdr_bucket(us)]++;
+    (*histogram).count++;
+    (*histogram).sum_us += us;
+}
+
+
+/// @brief adds the counts of a histogram to another one
+/// @param to histogram that receives the counts
+/// @param from histogram to merge
+void hdr_merge(Histogram *to, Histogram *from) {
+    int i;
+
+    for (i = 0; i < HDR_BUCKETS; i++) { (*to).counts[i] += (*from).counts[i]; }
+    (*to).count += (*from).count;
+    (*to).sum_us += (*from).sum_us;
+}
+
+
+/// @brief value below which a ratio of the recorded values falls
+/// @param histogram histogram, not empty
+/// @param ratio e.g. 0.99 for the 99th percentile
+/// @return highest value of the bucket of the percentile, in microseconds
+unsigned long hdr_percentile(Histogram *histogram, double ratio) {
+    unsigned long rank = (unsigned long)(ratio * (*histogram).count + 0.999999), seen = 0;
+    int i;
+
+    if (rank == 0) { rank = 1; }
+    for (i = 0; i < HDR_BUCKETS - 1; i++) {
+        if ((seen += (*histogram).counts[i]) >= rank) { break; }
+    }
+    return hdr_highest(i);
+}
+
+
+/// @brief formats one line of a histogram dump, nothing if the histogram is empty
+/// @param buf stores the line
+/// @param size size of buf
+/// @param name name of the line
+/// @param histogram histogram
+/// @param unit 1 to report microseconds, 1000 to report milliseconds
+/// @return length of the line
+int hdr_format(char *buf, int size, char *name, Histogram *histogram, int unit) {
+    if ((*histogram).count == 0) { return 0; }
+
+    return snprintf(buf, size, "%s count=%lu mean=%.1f p50=%lu p90=%lu p99=%lu p999=%lu max=%lu\n", name, (*histogram).count,
+                    (double)(*histogram).sum_us / (*histogram).count / unit, hdr_percentile(histogram, 0.5) / unit,
+                    hdr_percentile(histogram, 0.9) / unit, hdr_percentile(histogram, 0.99) / unit,
+                    hdr_percentile(histogram, 0.999) / unit, hdr_percentile(histogram, 1) / unit);
+}
+
+
+/// @brief records the time a player took to answer a question, from the question being sent to the answer being requested
+/// @param q question
+/// @param ns time in nanoseconds
+void record_answer(Question *q, long ns) {
+    if ((*q).answer_time == NULL && ((*q).answer_time = calloc(1, sizeof(Histogram))) == NULL) { return; }
+    hdr_record((*q).answer_time, ns);
+}
+
+
+/// @brief xorshift64*, the random numbers of the draws
+/// @param state random state, never 0
+/// @return next random number
+unsigned long next_random(unsigned long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717UL;
+}
+
 
-    if (quit) { printf("server terminated successfully by SIGINT\n"); }
-    else { printf("client disconnected\n"); }
+/// @brief difficulty of a question, from how many answered it right, asked for its clue and how long they took.
+///        before any answer it is half right and half the time
+/// @param stats what the players did with the question
+/// @return difficulty, from 0 to 1
+double difficulty(QuestionStats *stats) {
+    double wrong = 1 - ((*stats).correct + 1.0) / ((*stats).answered + 2.0);
+    double clues = (*stats).served ? (double)(*stats).clues / (*stats).served : 0;
+    double slow = ((*stats).latency_ms + QUESTION_TIMEOUT_MS / 2.0) / (((*stats).answered + 1.0) * QUESTION_TIMEOUT_MS);
+
+    if (clues > 1) { clues = 1; }
+    if (slow > 1) { slow = 1; }
+    return 0.6 * wrong + 0.2 * clues + 0.2 * slow;
+}
+
+
+/// @brief bucket of a difficulty
+int difficulty_bucket(double d) {
+    int b = (int)(d * DIFFICULTY_BUCKETS);
+
+    return b < 0 ? 0 : (b >= DIFFICULTY_BUCKETS ? DIFFICULTY_BUCKETS - 1 : b);
+}
+
+
+/// @brief builds the alias table of every level (Vose): a bucket weighs its questions times how close its difficulty is to the level
+void selector_build() {
+    double weight[DIFFICULTY_BUCKETS], total, center, distance, target;
+    int small[DIFFICULTY_BUCKETS], large[DIFFICULTY_BUCKETS], l, b, s, g, ns, nl;
+
+    for (l = 0; l < LEVELS; l++) {
+        target = (l + 0.5) / LEVELS;
+        total = 0;
+        for (b = 0; b < DIFFICULTY_BUCKETS; b++) {
+            center = (b + 0.5) / DIFFICULTY_BUCKETS;
+            distance = (center - target) * LEVELS;
+            weight[b] = (selector.start[b + 1] - selector.start[b]) * (EXPLORE + 1 / (1 + distance * distance));
+            total += weight[b];
+        }
+
+        // scaled so the average is 1, the buckets below 1 are topped up by the ones above
+        ns = nl = 0;
+        for (b = 0; b < DIFFICULTY_BUCKETS; b++) {
+            weight[b] = weight[b] * DIFFICULTY_BUCKETS / total;
+            if (weight[b] < 1) { small[ns++] = b; }
+            else { large[nl++] = b; }
+        }
+        while (ns > 0 && nl > 0) {
+            s = small[--ns];
+            g = large[nl - 1];
+            selector.prob[l][s] = weight[s];
+            selector.alias[l][s] = g;
+            weight[g] -= 1 - weight[s];
+            if (weight[g] < 1) {
+                nl--;
+                small[ns++] = g;
+            }
+        }
+        while (nl > 0) { selector.prob[l][large[--nl]] = 1; }
+        while (ns > 0) { selector.prob[l][small[--ns]] = 1; } // only left by rounding
+    }
+    selector.dirty = 0;
+    selector.rebuilds++;
+}
+
+
+/// @brief sorts the questions of the bank into the buckets of their difficulty, which makes questions drawn by difficulty
+/// @param head head of linked list
+/// @param count questions of the bank
+/// @return 0 on success, 1 otherwise
+int selector_init(QuestionNode *head, int count) {
+    int b, next[DIFFICULTY_BUCKETS];
+    QuestionNode *node;
+    Question *q;
+
+    if ((selector.order = malloc(count * sizeof(QuestionNode *))) == NULL) { return 1; }
+    selector.count = count;
+    selector.head = head;
+
+    memset(selector.start, 0, sizeof(selector.start));
+    for (node = head; node != NULL; node = (*node).next) {
+        q = (*node).question;
+        (*q).difficulty = difficulty(&(*q).stats);
+        (*q).bucket = difficulty_bucket((*q).difficulty);
+        selector.start[(*q).bucket + 1]++;
+    }
+    for (b = 0; b < DIFFICULTY_BUCKETS; b++) {
+        selector.start[b + 1] += selector.start[b];
+        next[b] = selector.start[b];
+    }
+    for (node = head; node != NULL; node = (*node).next) {
+        q = (*node).question;
+        (*q).slot = next[(*q).bucket]++;
+        selector.order[(*q).slot] = node;
+    }
+    selector_build();
+    return 0;
+}
+
+
+/// @brief swaps two places of the questions of the selector
+void selector_swap(int i, int j) {
+    QuestionNode *node = selector.order[i];
+
+    selector.order[i] = selector.order[j];
+    selector.order[j] = node;
+    (*(*selector.order[i]).question).slot = i;
+    (*(*selector.order[j]).question).slot = j;
+}
+
+
+/// @brief updates the difficulty of a question after an answer, a timeout or a clue, moving it to the bucket of its new difficulty:
+///        it is swapped with the last question of its bucket, which then ends one place earlier, and so on up to its new bucket (or down)
+/// @param q the question
+void selector_update(Question *q) {
+    int b;
+
+    (*q).difficulty = difficulty(&(*q).stats);
+    if (selector.order == NULL || (b = difficulty_bucket((*q).difficulty)) == (*q).bucket) { return; }
+
+    for (; (*q).bucket < b; (*q).bucket++) {
+        selector_swap((*q).slot, selector.start[(*q).bucket + 1] - 1);
+        selector.start[(*q).bucket + 1]--;
+    }
+    for (; (*q).bucket > b; (*q).bucket--) {
+        selector_swap((*q).slot, selector.start[(*q).bucket]);
+        selector.start[(*q).bucket]++;
+    }
+    selector.dirty = 1;
+    selector.moves++;
+}
+
+
+/// @brief draws a question for a level
+/// @param level level of the player
+/// @param seed random state of the player
+/// @return node of the question
+QuestionNode *selector_draw(int level, unsigned long *seed) {
+    unsigned long r = next_random(seed);
+    int b = r % DIFFICULTY_BUCKETS;
+
+    if (selector.dirty) { selector_build(); }
+    if ((double)(r >> 11) / (1UL << 53) >= selector.prob[level][b]) { b = selector.alias[level][b]; }
+    return selector.order[selector.start[b] + next_random(seed) % (selector.start[b + 1] - selector.start[b])];
+}
+
+
+/// @brief questions of a game drawn by difficulty, the whole bank when it is smaller
+int game_questions() { return selector.count > GAME_QUESTIONS ? GAME_QUESTIONS : selector.count; }
+
+
+/// @brief hash of a string (FNV-1a), of the name of a player or the text of a question
+unsigned long text_hash(char *text) {
+    unsigned long hash = 14695981039346656037UL;
+
+    for (; *text; text++) { hash = (hash ^ (unsigned char)*text) * 1099511628211UL; }
+    return hash;
+}
+
+
+/// @brief key of the items of a question in the review store, the hash of its text
+unsigned long question_key(Question *q) { return text_hash((*q).question + 1); }
+
+
+/// @brief finds the entry of a question in the index of a player
+/// @return the entry of the question, or the free entry where it goes
+ReviewPlace *review_place(ReviewPlayer *player, int question) {
+    int mask = 2 * (*player).size - 1, i = (question * 2654435761U) & mask;
+
+    while ((*player).index[i].question != -1 && (*player).index[i].question != question) { i = (i + 1) & mask; }
+    return &(*player).index[i];
+}
+
+
+/// @brief swaps two items of the heap of a player, and their places in the index
+void review_swap(ReviewPlayer *player, int i, int j) {
+    Review item = (*player).heap[i];
+
+    (*player).heap[i] = (*player).heap[j];
+    (*player).heap[j] = item;
+    (*review_place(player, (*player).heap[i].question)).place = i;
+    (*review_place(player, (*player).heap[j].question)).place = j;
+}
+
+
+/// @brief moves an item of the heap of a player up or down to the place of its due time
+/// @param i place of the item
+void review_sift(ReviewPlayer *player, int i) {
+    int child;
+
+    while (i > 0 && (*player).heap[i].due < (*player).heap[(i - 1) / 2].due) {
+        review_swap(player, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while ((child = 2 * i + 1) < (*player).count) {
+        if (child + 1 < (*player).count && (*player).heap[child + 1].due < (*player).heap[child].due) { child++; }
+        if ((*player).heap[i].due <= (*player).heap[child].due) { break; }
+        review_swap(player, i, child);
+        i = child;
+    }
+}
+
+
+/// @brief doubles the heap of a player and rebuilds its index
+/// @return 0 on success, 1 on memory error
+int review_grow(ReviewPlayer *player) {
+    int i, size = (*player).size ? 2 * (*player).size : REVIEW_ITEMS;
+    Review *heap = realloc((*player).heap, size * sizeof(Review));
+    ReviewPlace *index = malloc(2 * size * sizeof(ReviewPlace));
+
+    if (heap != NULL) { (*player).heap = heap; }
+    if (heap == NULL || index == NULL) {
+        free(index);
+        return 1;
+    }
+    free((*player).index);
+    (*player).index = index;
+    (*player).size = size;
+    for (i = 0; i < 2 * size; i++) { index[i].question = -1; }
+    for (i = 0; i < (*player).count; i++) {
+        ReviewPlace *place = review_place(player, (*player).heap[i].question);
+
+        (*place).question = (*player).heap[i].question;
+        (*place).place = i;
+    }
+    return 0;
+}
+
+
+/// @brief sets the state of an item of a player, adding it if the player has none for its question, in O(log n)
+/// @param item the new state
+/// @return 0 on success, 1 on memory error
+int review_set(ReviewPlayer *player, Review *item) {
+    ReviewPlace *place = (*player).size ? review_place(player, (*item).question) : NULL;
+
+    if (place == NULL || (*place).question == -1) {
+        if ((*player).count == (*player).size && review_grow(player)) { return 1; }
+        place = review_place(player, (*item).question);
+        (*place).question = (*item).question;
+        (*place).place = (*player).count++;
+        reviews.items++;
+    }
+    (*player).heap[(*place).place] = *item;
+    review_sift(player, (*place).place);
+    return 0;
+}
+
+
+/// @brief finds the review state of a player by name
+/// @param name name of the player
+/// @param create adds the player if it has none
+/// @return the review state, NULL if it has none or on memory error
+ReviewPlayer *review_player(char *name, int create) {
+    ReviewPlayer *player, *next, *moved, **buckets;
+    unsigned long hash = text_hash(name);
+    int i;
+
+    for (player = reviews.buckets[hash & (reviews.buckets_count - 1)]; player != NULL; player = (*player).next) {
+        if (strcmp((*player).name, name) == 0) { return player; }
+    }
+    if (!create || (player = calloc(1, sizeof(ReviewPlayer))) == NULL) { return NULL; }
+    snprintf((*player).name, BUF_NAME_SIZE, "%s", name);
+
+    // the table doubles once it has as many players as buckets, so chains stay short
+    if (reviews.players == reviews.buckets_count && (buckets = calloc(2 * reviews.buckets_count, sizeof(ReviewPlayer *))) != NULL) {
+        for (i = 0; i < reviews.buckets_count; i++) {
+            for (moved = reviews.buckets[i]; moved != NULL; moved = next) {
+                next = (*moved).next;
+                (*moved).next = buckets[text_hash((*moved).name) & (2 * reviews.buckets_count - 1)];
+                buckets[text_hash((*moved).name) & (2 * reviews.buckets_count - 1)] = moved;
+            }
+        }
+        free(reviews.buckets);
+        reviews.buckets = buckets;
+        reviews.buckets_count *= 2;
+    }
+    (*player).next = reviews.buckets[hash & (reviews.buckets_count - 1)];
+    reviews.buckets[hash & (reviews.buckets_count - 1)] = player;
+    reviews.players++;
+    return player;
+}
+
+
+/// @brief appends the state of an item of a player to the review store
+void review_append(ReviewPlayer *player, Review *item, FILE *file) {
+    ReviewRecord record;
+
+    memset(&record, 0, sizeof(ReviewRecord));
+    memcpy(record.name, (*player).name, BUF_NAME_SIZE);
+    record.key = question_key((*bank.nodes[(*item).question]).question);
+    record.due = (*item).due;
+    record.interval = (*item).interval;
+    record.ease = (*item).ease;
+    record.streak = (*item).streak;
+    fwrite(&record, sizeof(ReviewRecord), 1, file);
+}
+
+
+/// @brief reschedules a question for the player who answered or failed it (SM-2), and appends its new state to the store
+/// @param player review state of the player
+/// @param q the question
+/// @param correct 1 if the answer was right
+void review_grade(ReviewPlayer *player, Question *q, int correct) {
+    Review item = { (*q).index, 0, 0, EASE_START, 0 };
+    ReviewPlace *place = (*player).size ? review_place(player, (*q).index) : NULL;
+
+    if (place != NULL && (*place).question != -1) { item = (*player).heap[(*place).place]; }
+    if (correct) {
+        item.streak++;
+        if (item.streak == 1) { item.interval = REVIEW_FIRST_S; }
+        else if (item.streak == 2) { item.interval = REVIEW_SECOND_S; }
+        else { item.interval = (unsigned long)item.interval * item.ease / 100 > REVIEW_MAX_S ? REVIEW_MAX_S : (unsigned long)item.interval * item.ease / 100; }
+        item.ease = item.ease + EASE_RIGHT > EASE_MAX ? EASE_MAX : item.ease + EASE_RIGHT;
+    }
+    else {
+        item.streak = 0;
+        item.interval = REVIEW_RETRY_S;
+        item.ease = item.ease - EASE_WRONG < EASE_MIN ? EASE_MIN : item.ease - EASE_WRONG;
+    }
+    item.due = time(NULL) + item.interval;
+    if (review_set(player, &item)) { return; }
+    if (reviews.file != NULL) {
+        review_append(player, &item, reviews.file);
+        reviews.appended++;
+    }
+}
+
+
+/// @brief the first question the player has due, in O(1)
+/// @return node of the question, NULL if none is due
+QuestionNode *review_due(ReviewPlayer *player) {
+    if (player == NULL || (*player).count == 0 || (*player).heap[0].due > time(NULL)) { return NULL; }
+    return bank.nodes[(*player).heap[0].question];
+}
+
+
+/// @brief opens the review store, the file named by QUIZIA_REVIEWS or REVIEWS_PATH, and replays its records.
+///        records of questions that are no longer in the bank are dropped
+/// @param head head of linked list
+/// @param count questions of the bank
+/// @return 0 on success, 1 otherwise
+int reviews_start(QuestionNode *head, int count) {
+    char magic[sizeof(REVIEWS_MAGIC) - 1];
+    int i, j, mask, loaded = 0, dropped = 0;
+    struct { unsigned long key; int question; } *keys; // index of the questions by key, only while the records are replayed
+    ReviewRecord record;
+    ReviewPlayer *player;
+    QuestionNode *node;
+    Review item;
+    FILE *file;
+
+    if ((reviews.path = getenv("QUIZIA_REVIEWS")) == NULL) { reviews.path = REVIEWS_PATH; }
+    for (mask = 1; mask < 2 * count; mask *= 2);
+    reviews.buckets = calloc(REVIEW_PLAYERS, sizeof(ReviewPlayer *));
+    keys = malloc(mask * sizeof(*keys));
+    if (reviews.buckets == NULL || keys == NULL) {
+        free(keys);
+        return 1;
+    }
+    reviews.buckets_count = REVIEW_PLAYERS;
+    mask--;
+
+    for (i = 0; i <= mask; i++) { keys[i].question = -1; }
+    for (node = head, i = 0; node != NULL; node = (*node).next, i++) {
+        unsigned long key = question_key((*node).question);
+
+        for (j = key & mask; keys[j].question != -1 && keys[j].key != key; j = (j + 1) & mask);
+        keys[j].key = key; // a question repeated in the bank is kept under its last index
+        keys[j].question = i;
+    }
+
+    if ((file = fopen(reviews.path, "r")) != NULL) {
+        if (fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, REVIEWS_MAGIC, sizeof(magic)) == 0) {
+            while (fread(&record, sizeof(ReviewRecord), 1, file) == 1) {
+                record.name[BUF_NAME_SIZE - 1] = '\0';
+                for (j = record.key & mask; keys[j].question != -1 && keys[j].key != record.key; j = (j + 1) & mask);
+                if (keys[j].question == -1 || (player = review_player(record.name, 1)) == NULL) {
+                    dropped++;
+                    continue;
+                }
+                item.question = keys[j].question;
+                item.due = record.due;
+                item.interval = record.interval;
+                item.ease = record.ease;
+                item.streak = record.streak;
+                if (review_set(player, &item) == 0) { loaded++; }
+                reviews.appended++;
+            }
+        }
+        else { printf("%s is not a review store, it will be overwritten\n", reviews.path); }
+        fclose(file);
+    }
+    free(keys);
+    printf("%d players with %lu questions to review loaded from %s (%d records, %d dropped)\n", reviews.players, reviews.items, reviews.path, loaded, dropped);
+
+    // the records of the games to come are appended, to a new store if it was not one
+    if ((reviews.file = fopen(reviews.path, reviews.appended > 0 ? "a" : "w")) == NULL) { return 1; }
+    if (reviews.appended == 0) { fwrite(REVIEWS_MAGIC, sizeof(magic), 1, reviews.file); }
+    return 0;
+}
+
+
+/// @brief writes the records appended so far to the store, when a session closes
+void reviews_flush() {
+    if (reviews.file != NULL) { fflush(reviews.file); }
+}
+
+
+/// @brief rewrites the review store with one record per item, so it does not grow with every answer, and frees it
+void reviews_stop() {
+    char *path;
+    int i, j;
+    unsigned long written = 0;
+    ReviewPlayer *player, *next;
+    FILE *file = NULL;
+
+    if (reviews.buckets == NULL) { return; }
+    if (reviews.file != NULL) { fclose(reviews.file); }
+
+    // written next to the store and renamed over it, a crash in the middle leaves the old one
+    if ((path = malloc(strlen(reviews.path) + 5)) != NULL) {
+        sprintf(path, "%s.tmp", reviews.path);
+        file = fopen(path, "w");
+    }
+    if (file != NULL) { fwrite(REVIEWS_MAGIC, sizeof(REVIEWS_MAGIC) - 1, 1, file); }
+    for (i = 0; i < reviews.buckets_count; i++) {
+        for (player = reviews.buckets[i]; player != NULL; player = next) {
+            next = (*player).next;
+            for (j = 0; file != NULL && j < (*player).count; j++) { review_append(player, &(*player).heap[j], file); }
+            written += (*player).count;
+            free((*player).heap);
+            free((*player).index);
+            free(player);
+        }
+    }
+    if (file != NULL && fclose(file) == 0 && rename(path, reviews.path) == 0) {
+        printf("%lu questions to review of %d players written to %s, %lu reviews served\n", written, reviews.players, reviews.path, reviews.served);
+    }
+    else { printf("failed to write the review store %s\n", reviews.path); }
+    free(path);
+    free(reviews.buckets);
+    reviews.buckets = NULL;
+}
+
+
+/// @brief maps the table of snapshots, from the file given with -s so the games put aside by a previous run can be resumed
+/// @param path path of the file, NULL to keep the snapshots in memory only
+/// @return 0 on success, 1 otherwise
+int snapshots_start(char *path) {
+    int fd, i;
+    unsigned long hash = 0;
+
+    for (i = 0; i < bank.count; i++) { hash = hash * 31 + question_key((*bank.nodes[i]).question); }
+    snapshots.path = path;
+    snapshots.size = sizeof(SnapshotHeader) + SNAPSHOT_SLOTS * sizeof(Snapshot);
+    if (path == NULL) { snapshots.header = mmap(NULL, snapshots.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); }
+    else {
+        if ((fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) { return 1; }
+        if (ftruncate(fd, snapshots.size) == -1) {
+            close(fd);
+            return 1;
+        }
+        snapshots.header = mmap(NULL, snapshots.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    if (snapshots.header == MAP_FAILED) {
+        snapshots.header = NULL;
+        return 1;
+    }
+    snapshots.slots = (Snapshot *)(snapshots.header + 1);
+
+    if (memcmp((*snapshots.header).magic, SNAPSHOTS_MAGIC, sizeof((*snapshots.header).magic)) != 0 || (*snapshots.header).slots != SNAPSHOT_SLOTS ||
+        (*snapshots.header).questions != bank.count || (*snapshots.header).bank != hash) {
+        if (path != NULL && (*snapshots.header).magic[0]) { printf("%s holds the games of another bank, they are dropped\n", path); }
+        if (path != NULL) { memset(snapshots.header, 0, snapshots.size); }
+        memcpy((*snapshots.header).magic, SNAPSHOTS_MAGIC, sizeof((*snapshots.header).magic));
+        (*snapshots.header).slots = SNAPSHOT_SLOTS;
+        (*snapshots.header).questions = bank.count;
+        (*snapshots.header).bank = hash;
+    }
+    for (i = 0; i < SNAPSHOT_SLOTS; i++) { snapshots.count += snapshots.slots[i].token != 0; }
+    if (path != NULL) { printf("%d games to resume loaded from %s\n", snapshots.count, path); }
+    return 0;
+}
+
+
+/// @brief writes the snapshots back to their file, if they have one, and unmaps them
+void snapshots_stop() {
+    if (snapshots.header == NULL) { return; }
+    if (snapshots.path != NULL) {
+        if (msync(snapshots.header, snapshots.size, MS_SYNC) == 0) { printf("%d games to resume written to %s\n", snapshots.count, snapshots.path); }
+        else { printf("failed to write the snapshots %s\n", snapshots.path); }
+    }
+    munmap(snapshots.header, snapshots.size);
+    snapshots.header = NULL;
+}
+
+
+/// @brief slot of a token in the table of snapshots
+/// @param token resume token, not 0
+/// @return index of the slot, -1 if the token has none
+int snapshot_find(unsigned long token) {
+    int i, slot;
+
+    for (i = 0; i < SNAPSHOT_PROBES; i++) {
+        slot = (token + i) & (SNAPSHOT_SLOTS - 1);
+        if (snapshots.slots[slot].token == token) { return slot; }
+    }
+    return -1;
+}
+
+
+/// @brief finds a slot for a new token: a free one or one whose game expired, otherwise the game saved the longest ago gives its slot away
+/// @param token resume token, not 0
+/// @return index of the slot
+int snapshot_claim(unsigned long token) {
+    int i, slot, oldest = -1;
+    long now = time(NULL);
+
+    for (i = 0; i < SNAPSHOT_PROBES; i++) {
+        slot = (token + i) & (SNAPSHOT_SLOTS - 1);
+        if (snapshots.slots[slot].token == 0) {
+            snapshots.count++;
+            return slot;
+        }
+        if (now - snapshots.slots[slot].saved > SNAPSHOT_TTL_S) { return slot; }
+        if (oldest == -1 || snapshots.slots[slot].saved < snapshots.slots[oldest].saved) { oldest = slot; }
+    }
+    return oldest;
+}
+
+
+/// @brief draws the next question of a game by difficulty, one the game did not have yet, unless the player has a question due
+/// @param session session of the player
+void session_draw(Session *session) {
+    QuestionNode *node = NULL;
+    int i, j, tries;
+
+    // a question the player has to review comes first, once per game
+    if ((node = review_due((*session).reviews)) != NULL) {
+        for (i = 0; i < (*session).position && (*session).played[i] != (*(*node).question).index; i++);
+        if (i < (*session).position) { node = NULL; }
+        else { reviews.served++; }
+    }
+    for (tries = 0; tries < DRAW_TRIES && node == NULL; tries++) {
+        node = selector_draw((*session).level, &(*session).seed);
+        for (i = 0; i < (*session).position && (*session).played[i] != (*(*node).question).index; i++);
+        if (i < (*session).position) { node = NULL; }
+    }
+    // a small bank runs out of new questions at the level, the first new one of the bank is taken
+    for (j = 0; node == NULL; j++) {
+        node = selector.order[j];
+        for (i = 0; i < (*session).position && (*session).played[i] != (*(*node).question).index; i++);
+        if (i < (*session).position) { node = NULL; }
+    }
+    (*session).played[(*session).position] = (*(*node).question).index;
+    (*session).node = node;
+}
+
+
+/// @brief plays the rest of the game in the order of the bank, as members of a room and players of the tournament do: they all have the same questions.
+///        only before the first question
+/// @param session session of the player
+void session_bank_order(Session *session) {
+    if (!(*session).adaptive) { return; }
+    (*session).adaptive = 0;
+    (*session).node = selector.head;
+}
+
+
+/// @brief the player answered or failed the current question: its statistics are updated and the player goes a level up or down
+/// @param session session of the player
+/// @param correct 1 if the answer was right
+/// @param ms time taken to answer
+void session_graded(Session *session, int correct, long ms) {
+    Question *q = (*(*session).node).question;
+
+    (*q).stats.answered++;
+    (*q).stats.correct += correct;
+    (*q).stats.latency_ms += ms;
+    selector_update(q);
+    if ((*session).reviews != NULL) { review_grade((*session).reviews, q, correct); }
+
+    if (correct && (*session).level < LEVELS - 1) { (*session).level++; }
+    if (!correct && (*session).level > 0) { (*session).level--; }
+}
+
+
+/// @brief the session still saves its game into its snapshot: the slot was not given to another game and no other connection resumed it
+/// @param session session of the player
+/// @return 1 if it does
+int session_owns(Session *session) {
+    Snapshot *snapshot;
+
+    if ((*session).snapshot == -1) { return 0; }
+    snapshot = &snapshots.slots[(*session).snapshot];
+    if ((*snapshot).token == (*session).token && (*snapshot).owner == (unsigned long)session) { return 1; }
+    (*session).snapshot = -1;
+    return 0;
+}
+
+
+/// @brief saves the game into its snapshot, after every change a resumed game has to see
+/// @param session session of the player
+void session_save(Session *session) {
+    Snapshot *snapshot;
+    int i;
+
+    if (!session_owns(session)) { return; }
+    snapshot = &snapshots.slots[(*session).snapshot];
+    (*snapshot).game = (*session).game;
+    (*snapshot).saved = time(NULL);
+    memcpy((*snapshot).name, (*session).name, BUF_NAME_SIZE);
+    (*snapshot).question = (*(*(*session).node).question).index;
+    (*snapshot).graded = (*session).graded;
+    (*snapshot).position = (*session).position;
+    (*snapshot).points = (*session).points;
+    (*snapshot).best = (*session).best;
+    (*snapshot).answered = (*session).answered;
+    (*snapshot).clues = (*session).clues;
+    (*snapshot).adaptive = (*session).adaptive;
+    (*snapshot).level = (*session).level;
+    (*snapshot).seed = (*session).seed;
+    for (i = 0; (*session).adaptive && i <= (*session).position; i++) { (*snapshot).played[i] = (*session).played[i]; }
+}
+
+
+/// @brief drops the snapshot of the game, whose token no longer resumes it
+/// @param session session of the player
+void session_forget(Session *session) {
+    if (session_owns(session)) {
+        snapshots.slots[(*session).snapshot].token = 0;
+        snapshots.count--;
+    }
+    (*session).snapshot = -1;
+}
+
+
+/// @brief gives the game a resume token and a snapshot, once
+/// @param session session of the player
+void session_token(Session *session) {
+    unsigned long token = 0;
+    Snapshot *snapshot;
+
+    if (session_owns(session)) { return; }
+    while (token == 0 || snapshot_find(token) != -1) {
+        if (getrandom(&token, sizeof(token), 0) != sizeof(token)) { token = (unsigned long)now_ns() * 0x9E3779B97F4A7C15UL; }
+    }
+    (*session).snapshot = snapshot_claim(token);
+    (*session).token = token;
+    snapshot = &snapshots.slots[(*session).snapshot];
+    memset(snapshot, 0, sizeof(Snapshot));
+    (*snapshot).token = token;
+    (*snapshot).owner = (unsigned long)session;
+    snapshots.issued++;
+    session_save(session);
+}
+
+
+/// @brief takes up the game of a token on this session, which has not been sent a question yet
+/// @param session session of the player
+/// @param token resume token
+/// @return 0 on success, 1 if the token has no game to go on with
+int session_restore(Session *session, unsigned long token) {
+    int i, slot = snapshot_find(token);
+    Snapshot *snapshot;
+
+    if (slot == -1) { return 1; }
+    snapshot = &snapshots.slots[slot];
+    if (time(NULL) - (*snapshot).saved > SNAPSHOT_TTL_S || (*snapshot).question < 0 || (*snapshot).question >= bank.count) { return 1; }
+    if ((*snapshot).adaptive && (selector.order == NULL || (*snapshot).position < 0 || (*snapshot).position >= game_questions())) { return 1; } // the server no longer draws by difficulty
+    for (i = 0; (*snapshot).adaptive && i <= (*snapshot).position; i++) {
+        if ((*snapshot).played[i] < 0 || (*snapshot).played[i] >= bank.count) { return 1; }
+    }
+    // the last question was graded, the game was over
+    if ((*snapshot).graded && ((*snapshot).adaptive ? (*snapshot).position == game_questions() - 1 : (*snapshot).question == bank.count - 1)) { return 1; }
+
+    memcpy((*session).name, (*snapshot).name, BUF_NAME_SIZE);
+    (*session).name[BUF_NAME_SIZE - 1] = '\0';
+    (*session).game = (*snapshot).game;
+    (*session).position = (*snapshot).position;
+    (*session).points = (*snapshot).points;
+    (*session).best = (*snapshot).best;
+    (*session).answered = (*snapshot).answered;
+    (*session).clues = (*snapshot).clues;
+    (*session).adaptive = (*snapshot).adaptive;
+    (*session).level = (*snapshot).level;
+    (*session).seed = (*snapshot).seed;
+    for (i = 0; (*session).adaptive && i <= (*session).position; i++) { (*session).played[i] = (*snapshot).played[i]; }
+    (*session).node = bank.nodes[(*snapshot).question];
+    (*session).reviews = (*session).adaptive && reviews.buckets != NULL ? review_player((*session).name, 1) : NULL;
+    if ((*snapshot).graded) { // goes on as after NEXT_QUESTION
+        (*session).position++;
+        if ((*session).adaptive) { session_draw(session); }
+        else { (*session).node = (*(*session).node).next; }
+    }
+
+    (*snapshot).owner = (unsigned long)session; // the connection that had the game no longer saves it
+    (*session).snapshot = slot;
+    (*session).token = token;
+    snapshots.resumed++;
+    return 0;
+}
+
+
+/// @brief kind of a request, selects its service time histogram
+/// @param c request
+/// @return index in REQUEST_KINDS order, -1 if the request is unknown
+int request_kind(char c) {
+    switch (c) {
+        case QUESTION: return 0;
+        case ANSWER: return 1;
+        case CLUE: return 2;
+        case NEXT_QUESTION: return 3;
+        case EXIT: return 4;
+        case PLAYER_NAME: return 5;
+        case LEADERBOARD: return 6;
+        case JOIN: return 7;
+        case TOURNAMENT: return 8;
+        case RESUME: return 9;
+    }
+    return -1;
+}
+
+
+/// @brief starts a span
+/// @return start of the span, 0 when tracing is off
+long trace_begin() { return trace.events != NULL ? now_ns() : 0; }
+
+
+/// @brief records a span that ends now
+/// @param name name of the span, a string literal
+/// @param start start of the span, from trace_begin() or now_ns()
+/// @param fd descriptor of the client
+void trace_end(char *name, long start, int fd) {
+    TraceEvent *event;
+
+    if (trace.events == NULL || start == 0) { return; }
+    if (trace.count == TRACE_EVENTS) {
+        trace.dropped++;
+        return;
+    }
+    event = &trace.events[trace.count++];
+    (*event).name = name;
+    (*event).start = start;
+    (*event).end = now_ns();
+    (*event).fd = fd;
+}
+
+
+/// @brief turns tracing on if the environment variable QUIZIA_TRACE names the file the trace is written to
+/// @return 0 on success, 1 on memory error
+int trace_start() {
+    if ((trace.path = getenv("QUIZIA_TRACE")) == NULL) { return 0; }
+    return (trace.events = malloc(TRACE_EVENTS * sizeof(TraceEvent))) == NULL; // pages are only touched as spans are recorded
+}
+
+
+/// @brief writes the spans as Chrome trace-event JSON, to be opened in chrome://tracing or ui.perfetto.dev:
+///        one row per client descriptor, so a row is the timeline of the clients that got that descriptor
+void trace_dump() {
+    FILE *file;
+    long i;
+    TraceEvent *event;
+
+    if (trace.events == NULL) { return; }
+    if ((file = fopen(trace.path, "w")) == NULL) {
+        printf("failed to write the trace to %s\n", trace.path);
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (i = 0; i < trace.count; i++) {
+        event = &trace.events[i];
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"quizia\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                i ? ",\n" : "", (*event).name, (*event).fd, ((*event).start - trace.events[0].start) / 1000.0,
+                ((*event).end - (*event).start) / 1000.0);
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) { printf("failed to write the trace to %s\n", trace.path); }
+    else { printf("trace of %ld spans written to %s, %ld dropped\n", trace.count, trace.path, trace.dropped); }
+    free(trace.events);
+}
+
+
+/// @brief name of a request, in spans and histogram dumps
+char *request_name(char c) {
+    static char *names[REQUEST_KINDS] = { "question", "answer", "clue", "next", "exit", "name", "top", "join", "tournament", "resume" };
+    int kind = request_kind(c);
+
+    return kind == -1 ? "unknown" : names[kind];
+}
+
+
+/// @brief writes the metrics of the server in plain text, one "name value" per line, to a client of the stats socket
+/// @param fd descriptor of the connection
+void write_stats(int fd) {
+    char buf[BUF_STATS_SIZE];
+    int i, len;
+    unsigned long count = 0, records, commits, failed;
+
+    pthread_mutex_lock(&journal.mtx);
+    records = journal.records;
+    commits = journal.commits;
+    failed = journal.failed;
+    pthread_mutex_unlock(&journal.mtx);
+
+    len = snprintf(buf, BUF_STATS_SIZE,
+                   "questions_served %lu\nanswers_sent %lu\nclue_requests %lu\ntimeouts %lu\n"
+                   "sessions_active %lu\nsessions_total %lu\nbytes_in %lu\nbytes_out %lu\ncpu_us %ld\n"
+                   "journal_records %lu\njournal_commits %lu\njournal_lost %lu\n"
+                   "tournament_players %d\ntournament_round %d\ntournament_resolve_us %ld\n"
+                   "difficulty_moves %lu\ndifficulty_rebuilds %lu\nreview_players %d\nreview_items %lu\nreviews_served %lu\n"
+                   "snapshots_kept %d\nsnapshots_issued %lu\nsnapshots_resumed %lu\n"
+                   "resident_kib %ld\nsession_bytes %d\nsession_slab_kib %ld\n"
+                   "admission_lag_us %ld\nadmission_overloaded %d\nsessions_shed_full %lu\nsessions_shed_lag %lu\n",
+                   metrics.questions, metrics.answers, metrics.clues, metrics.timeouts,
+                   metrics.sessions_active, metrics.sessions_total, metrics.bytes_in, metrics.bytes_out, cpu_us(),
+                   records, commits, failed, tournament.count, tournament.released, tournament.resolve_ns / 1000,
+                   selector.moves, selector.rebuilds, reviews.players, reviews.items, reviews.served,
+                   snapshots.count, snapshots.issued, snapshots.resumed, resident_kib(), (int)sizeof(Session), slab_kib(),
+                   admission.lag / 1000, admission.overloaded, admission.shed_full, admission.shed_lag);
+
+    // cumulative buckets, as they are usually exposed
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        count += metrics.latency[i];
+        if (i < LATENCY_BUCKETS - 1) { len += snprintf(buf + len, BUF_STATS_SIZE - len, "request_latency_us_bucket{le=\"%lu\"} %lu\n", 1UL << i, count); }
+        else { len += snprintf(buf + len, BUF_STATS_SIZE - len, "request_latency_us_bucket{le=\"+Inf\"} %lu\n", count); }
+    }
+    len += snprintf(buf + len, BUF_STATS_SIZE - len, "request_latency_us_sum %lu\nrequest_latency_us_count %lu\n", metrics.latency_sum_us, count);
+
+    send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+
+/// @brief formats the next lines of a histogram dump into its buffer, going through at most DUMP_QUESTIONS questions: the histograms,
+///        one line each, are the service time of each kind of request, then the time players took to answer, over every question
+///        and per question, numbered as the questions are served. the event loop goes on between two buffers, so a dump is not
+///        a snapshot of a single instant
+/// @param dump dump whose buffer was sent
+/// @return 1 once the dump is complete, 0 otherwise
+int dump_fill(HistogramDump *dump) {
+    char name[64];
+    char requests[REQUEST_KINDS] = { QUESTION, ANSWER, CLUE, NEXT_QUESTION, EXIT, PLAYER_NAME, LEADERBOARD, JOIN, TOURNAMENT, RESUME };
+    int i, end = (*dump).question + DUMP_QUESTIONS < bank.count ? (*dump).question + DUMP_QUESTIONS : bank.count;
+    Question *q;
+
+    (*dump).len = 0;
+    (*dump).sent = 0;
+    switch ((*dump).part) {
+        case DUMP_SERVICE:
+            for (i = 0; i < REQUEST_KINDS; i++) {
+                sprintf(name, "service_time_us{request=\"%s\"}", request_name(requests[i]));
+                (*dump).len += hdr_format((*dump).buf + (*dump).len, BUF_DUMP_SIZE - (*dump).len, name, &metrics.service[i], 1);
+            }
+            (*dump).part = DUMP_MERGE;
+            return 0;
+
+        case DUMP_MERGE: // the histogram of the server is the merge of the histograms of its questions
+            for (; (*dump).question < end; (*dump).question++) {
+                q = (*bank.nodes[(*dump).question]).question;
+                if ((*q).answer_time != NULL) { hdr_merge(&(*dump).all, (*q).answer_time); }
+            }
+            if ((*dump).question < bank.count) { return 0; }
+            (*dump).len = hdr_format((*dump).buf, BUF_DUMP_SIZE, "answer_time_ms", &(*dump).all, 1000);
+            (*dump).part = DUMP_ANSWER_TIME;
+            (*dump).question = 0;
+            return 0;
+
+        case DUMP_ANSWER_TIME:
+            for (; (*dump).question < end && (*dump).len <= BUF_DUMP_SIZE - 256; (*dump).question++) {
+                q = (*bank.nodes[(*dump).question]).question;
+                if ((*q).answer_time == NULL) { continue; }
+                sprintf(name, "answer_time_ms{question=\"%d\"}", (*dump).question);
+                (*dump).len += hdr_format((*dump).buf + (*dump).len, BUF_DUMP_SIZE - (*dump).len, name, (*q).answer_time, 1000);
+            }
+            if ((*dump).question == bank.count) {
+                (*dump).part = DUMP_QUESTION_STATS;
+                (*dump).question = 0;
+            }
+            return 0;
+
+        case DUMP_QUESTION_STATS: // what the players did with each question they were sent, and the difficulty it gives
+            for (; (*dump).question < end && (*dump).len <= BUF_DUMP_SIZE - 256; (*dump).question++) {
+                QuestionStats *stats = &(*(*bank.nodes[(*dump).question]).question).stats;
+
+                if ((*stats).served == 0) { continue; }
+                (*dump).len += snprintf((*dump).buf + (*dump).len, BUF_DUMP_SIZE - (*dump).len,
+                                        "question_stats{question=\"%d\"} served=%u answered=%u correct_rate=%.2f clue_rate=%.2f mean_ms=%lu difficulty=%.2f\n",
+                                        (*dump).question, (*stats).served, (*stats).answered,
+                                        (*stats).answered ? (double)(*stats).correct / (*stats).answered : 0,
+                                        (double)(*stats).clues / (*stats).served, (*stats).answered ? (*stats).latency_ms / (*stats).answered : 0,
+                                        difficulty(stats));
+            }
+            if ((*dump).question == bank.count) { (*dump).part = DUMP_DONE; }
+            return 0;
+    }
+    return 1;
+}
+
+
+/// @brief writes the whole histogram dump at once, when the server terminates
+/// @param fd descriptor to write to, blocking
+void write_histograms(int fd) {
+    HistogramDump *dump = calloc(1, sizeof(HistogramDump));
+    int n;
+
+    if (dump == NULL) { return; }
+    while (!dump_fill(dump)) {
+        while ((*dump).sent < (*dump).len) {
+            if ((n = write(fd, (*dump).buf + (*dump).sent, (*dump).len - (*dump).sent)) == -1 && errno != EINTR) {
+                free(dump);
+                return;
+            }
+            if (n > 0) { (*dump).sent += n; }
+        }
+    }
+    free(dump);
+}
+
+
+/// @brief sends what a single send() takes of a histogram dump, formatting its next buffer once the last one was sent:
+///        called each time the connection is writable, so the event loop does a bounded part of the dump per turn
+/// @param dump dump
+/// @return 1 once the dump was sent or the connection failed, 0 while there is more to send
+int dump_send(HistogramDump *dump) {
+    int n;
+
+    if ((*dump).sent == (*dump).len && dump_fill(dump)) { return 1; }
+    if ((*dump).len == 0) { return 0; } // nothing to send from this part yet
+    if ((n = send((*dump).fd, (*dump).buf + (*dump).sent, (*dump).len - (*dump).sent, MSG_DONTWAIT | MSG_NOSIGNAL)) == -1) {
+        return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+    }
+    (*dump).sent += n;
+    return 0;
+}
+
+
+/// @brief finds the histogram dump of a connection of the stats socket
+/// @param fd descriptor of the connection, a SLOT_DUMP
+/// @return its dump
+HistogramDump *dump_find(int fd) {
+    HistogramDump *dump;
+
+    for (dump = dumps; (*dump).fd != fd; dump = (*dump).next);
+    return dump;
+}
+
+
+/// @brief drops a histogram dump and closes its connection
+/// @param dump dump
+void dump_close(HistogramDump *dump) {
+    HistogramDump **link;
+
+    for (link = &dumps; *link != dump; link = &(**link).next);
+    *link = (*dump).next;
+    sessions[(*dump).fd].kind = SLOT_FREE;
+    close((*dump).fd);
+    free(dump);
+}
+
+
+/// @brief answers a connection to the stats socket once it is readable: the command "histograms" receives the histograms,
+///        sent as the connection is writable, see dump_send(); anything else, or nothing at all, receives the counters
+/// @param fd descriptor of the connection, closed on return unless it is sent the histograms
+/// @param epoll_fd epoll instance, the connection is watched for writing while it is sent the histograms
+void handle_stats(int fd, int epoll_fd) {
+    char command[BUF_REQ_SIZE];
+    int n = read(fd, command, BUF_REQ_SIZE);
+    struct epoll_event event;
+    HistogramDump *dump;
+
+    if (n < 10 || strncmp(command, "histograms", 10) != 0) { write_stats(fd); }
+    else if ((dump = calloc(1, sizeof(HistogramDump))) != NULL) {
+        (*dump).fd = fd;
+        (*dump).next = dumps;
+        dumps = dump;
+        sessions[fd].kind = SLOT_DUMP;
+        event.events = EPOLLOUT;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+        return;
+    }
+    sessions[fd].kind = SLOT_FREE;
+    close(fd);
+}
+
+
+/// @brief sends a message to the client without ever blocking the server
+/// @param session session of the client
+/// @param buf message
+/// @param len length of the message
+/// @return 0 if the whole message was sent, 1 otherwise
+int send_message(Session *session, char *buf, int len) {
+    long span = trace_begin();
+    int n = send((*session).fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    trace_end("send", span, (*session).fd);
+    // a client that cannot take a message of a few bytes is not reading anymore, it is disconnected instead of waited for
+    if (n != len) { return 1; }
+    metrics.bytes_out += len;
+    return 0;
+}
+
+
+/// @brief sends BUSY to a client just accepted if the server is full or its event loop lags, the client is then closed instead of served
+/// @param fd descriptor of the client
+/// @return 1 if the client was shed, 0 if it is admitted
+int admission_shed(int fd) {
+    char frame[16];
+    int len, full = admission.max_clients > 0 && metrics.sessions_active >= (unsigned long)admission.max_clients;
+
+    if (!full && !admission.overloaded) { return 0; }
+    if (full) { admission.shed_full++; }
+    else { admission.shed_lag++; }
+
+    len = sprintf(frame, "%c%d", BUSY, ADMISSION_RETRY_MS + (int)(next_random(&admission.seed) % ADMISSION_RETRY_MS)) + 1;
+    send(fd, frame, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    return 1;
+}
+
+
+/// @brief records the lag of a batch of events, and decides at the end of every interval whether the next one sheds new clients
+/// @param lag time from epoll_wait() returning to the last event of the batch being handled, in nanoseconds
+void admission_update(long lag) {
+    long now = now_ns();
+
+    if (admission.target_ns == 0) { return; }
+    if (lag < admission.lag_min) { admission.lag_min = lag; }
+    if (now - admission.interval_start < ADMISSION_INTERVAL_MS * 1000000L) { return; }
+
+    if ((admission.lag_min > admission.target_ns) != admission.overloaded) {
+        printf(admission.overloaded ? "lag back to %ld us, admitting new clients\n" : "lag of %ld us, shedding new clients\n", admission.lag_min / 1000);
+    }
+    admission.overloaded = admission.lag_min > admission.target_ns;
+    admission.lag = admission.lag_min;
+    admission.lag_min = LONG_MAX;
+    admission.interval_start = now;
+}
+
+
+/// @brief sends a frame of the bank to the client, with sendfile() when the bank is a memfd so the frame never goes through a buffer of the server
+/// @param session session of the client
+/// @param frame frame of the bank
+/// @param len length of the frame
+/// @return 0 if the whole frame was sent, 1 otherwise
+int send_frame(Session *session, char *frame, int len) {
+    off_t offset = frame - bank.frames;
+    long span;
+    int n;
+
+    if (bank.fd == -1) { return send_message(session, frame, len); }
+
+    span = trace_begin();
+    n = sendfile((*session).fd, bank.fd, &offset, len); // the socket is non-blocking, so this never blocks either
+    trace_end("sendfile", span, (*session).fd);
+    if (n != len) { return 1; }
+    metrics.bytes_out += len;
+    return 0;
+}
+
+
+/// @brief sends the status of the current question to the client, i.e.,
+///        if we not in the last question, the server sends PROCEED
+///        if we are in the last question, the server sends LAST_QUESTION
+/// @param session session of the client
+/// @return 0 on success, 1 otherwise
+int send_status(Session *session) {
+    int last = (*session).adaptive ? (*session).position == game_questions() - 1 : (*(*session).node).next == NULL;
+    char c = last ? LAST_QUESTION : PROCEED;
+
+    (*session).timed_out = 0;
+    (*session).question_sent = 0;
+    (*session).graded = 0;
+    session_save(session);
+    return send_message(session, &c, 1);
+}
+
+
+/// @brief converts a letter to lowercase if it is an uppercase letter
+/// @param c integer representing a characther
+/// @return letter in lowercase
+int lower(char c) {
+    if (c >= 'A' && c <= 'Z') { return c + ('a' - 'A'); }
+    return c;
+}
+
+
+/// @brief compares the user's answer with the correct answer with the addition of letting a single error pass if there is one,
+///        the same comparison the client makes, so both agree on the verdict
+/// @param correct_answer correct answer
+/// @param answer user's answer
+/// @return 0 if the answers are the same, 1 otherwise
+int compare(char *correct_answer, char *answer) {
+    int diff, mistakes = 0;
+
+    /* while pointers are different than '\0' */
+    while (*correct_answer && *answer) {
+        diff = lower(*correct_answer) - lower(*answer);
+
+        if (diff != 0) {
+            mistakes++;
+            if (mistakes > 1) { return diff; }
+        }
+
+        correct_answer++;
+        answer++;
+    }
+    return lower(*correct_answer) - lower(*answer);
+}
+
+
+/// @brief offers the best score of a game to the leaderboard, called on every graded answer
+/// @param session session of the game
+void leaderboard_update(Session *session) {
+    int i;
+    Score score;
+
+    // the game is either in the leaderboard already, or takes the place of the last score if it beats it
+    for (i = 0; i < leaderboard.count && leaderboard.scores[i].game != (*session).game; i++);
+    if (i == leaderboard.count) {
+        if (i == TOP_K && (*session).best <= leaderboard.scores[TOP_K - 1].score) { return; }
+        if (i == TOP_K) { i--; }
+        else { leaderboard.count++; }
+    }
+    else if ((*session).best <= leaderboard.scores[i].score) { return; }
+
+    memcpy(score.name, (*session).name, BUF_NAME_SIZE);
+    score.score = (*session).best;
+    score.game = (*session).game;
+    for (; i > 0 && leaderboard.scores[i - 1].score < score.score; i--) { leaderboard.scores[i] = leaderboard.scores[i - 1]; } // ties keep the earlier game first
+    leaderboard.scores[i] = score;
+}
+
+
+/// @brief sends the leaderboard, one frame per score and an empty frame after the last one
+/// @param session session of the client
+/// @return 0 on success, 1 otherwise
+int send_leaderboard(Session *session) {
+    char frame[BUF_NAME_SIZE + 32];
+    int i, len;
+
+    for (i = 0; i < leaderboard.count; i++) {
+        len = sprintf(frame, "%c%d. %s %d", LEADERBOARD, i + 1, leaderboard.scores[i].name, leaderboard.scores[i].score);
+        if (send_message(session, frame, len + 1)) { return 1; }
+    }
+    frame[0] = LEADERBOARD;
+    frame[1] = '\0';
+    return send_message(session, frame, 2);
+}
+
+
+/// @brief creates the session of a new client in the slot of its descriptor, reset in one go
+/// @param fd descriptor of the client socket
+/// @param wheel timer wheel
+/// @param head head of linked list
+/// @return pointer to the session, NULL on failure
+Session *session_open(int fd, TimerWheel *wheel, QuestionNode **head) {
+    Session *session = &sessions[fd];
+
+    memset(session, 0, sizeof(Session));
+    (*session).fd = fd;
+    (*session).node = *head; // or drawn by difficulty, below
+    (*session).points = (*session).best = START_POINTS;
+    (*session).game = metrics.sessions_total + 1;
+    (*session).opened = now_ns();
+    (*session).seat = -1;
+    (*session).snapshot = -1;
+    strcpy((*session).name, "anonymous"); // until the client sends the name of the player
+    if (selector.order != NULL) {
+        (*session).adaptive = 1;
+        (*session).level = START_LEVEL;
+        (*session).seed = ((*session).game * 0x9E3779B97F4A7C15UL) ^ (*session).opened;
+        if ((*session).seed == 0) { (*session).seed = 1; }
+        session_draw(session);
+    }
+
+    timer_arm(wheel, &(*session).idle, IDLE_TIMEOUT_MS);
+
+    if ((*session).node == NULL || send_status(session)) {
+        timer_cancel(&(*session).idle);
+        return NULL;
+    }
+    (*session).kind = SLOT_CLIENT;
+    metrics.sessions_active++;
+    metrics.sessions_total++;
+    return session;
+}
+
+
+/// @brief copies the name of a player or a room, it is sent to other players so it is kept to printable characters
+/// @param to stores the name
+/// @param from name sent by the client
+void copy_name(char *to, char *from) {
+    int i;
+
+    for (i = 0; from[i] && i < BUF_NAME_SIZE - 1; i++) { to[i] = (from[i] > ' ' && from[i] <= '~') ? from[i] : '_'; }
+    if (i > 0) { to[i] = '\0'; }
+}
+
+
+/// @brief sends the current question to the client and starts its deadline
+/// @param session session of the client
+/// @param wheel timer wheel
+/// @return 0 on success, 1 otherwise
+int send_question(Session *session, TimerWheel *wheel) {
+    Question *q = (*(*session).node).question;
+
+    // the deadline of a question of the tournament is the same for every player, see tournament_resolve()
+    if ((*session).deadline.next == NULL && (*session).seat == -1) { timer_arm(wheel, &(*session).deadline, QUESTION_TIMEOUT_MS); }
+    if ((*session).question_sent == 0) {
+        (*session).question_sent = now_ns();
+        (*q).stats.served++;
+    }
+    client_log("client %d: question %d\n", (*session).fd, (*session).question_number);
+    (*session).question_number++;
+    metrics.questions++;
+    return send_frame(session, (*q).question, (*q).question_length);
+}
+
+
+/// @brief sends the current question to every member of the room waiting for it, once all of them are.
+///        a member that cannot take it is shut down, the event loop closes it when it reads the end of its connection
+/// @param room the room
+/// @param wheel timer wheel
+void room_release(Room *room, TimerWheel *wheel) {
+    int i;
+
+    if ((*room).ready < (*room).count || (*room).count == 0) { return; }
+    if ((*room).round == 0 && (*room).count < ROOM_SIZE && now_ns() - (*room).created < ROOM_WAIT_MS * 1000000L) { return; }
+
+    (*room).round++;
+    (*room).ready = 0;
+    (*room).winner = NULL;
+    for (i = 0; i < (*room).count; i++) {
+        if ((*(*room).members[i]).room_state != ROOM_WAITING) { continue; }
+        (*(*room).members[i]).room_state = ROOM_PLAYING;
+        if (send_question((*room).members[i], wheel)) { shutdown((*(*room).members[i]).fd, SHUT_RDWR); }
+    }
+}
+
+
+/// @brief starts the rooms whose players waited long enough for the room to be full, called every tick
+/// @param wheel timer wheel
+void rooms_tick(TimerWheel *wheel) {
+    Room *room;
+
+    for (room = rooms; room != NULL; room = (*room).next) {
+        if ((*room).round == 0) { room_release(room, wheel); }
+    }
+}
+
+
+/// @brief puts the player in the room of that name that has not started yet, a new one if there is none
+/// @param session session of the player
+/// @param name name of the room
+void room_join(Session *session, char *name) {
+    Room *room;
+
+    for (room = rooms; room != NULL && ((*room).round > 0 || (*room).count == ROOM_SIZE || strcmp((*room).name, name) != 0); room = (*room).next);
+    if (room == NULL) {
+        if ((room = calloc(1, sizeof(Room))) == NULL) { return; } // the player plays alone
+        strcpy((*room).name, name);
+        (*room).created = now_ns();
+        (*room).next = rooms;
+        rooms = room;
+    }
+
+    (*room).members[(*room).count++] = session;
+    (*session).room = room;
+    client_log("client %d: joined room %s (%d/%d)\n", (*session).fd, name, (*room).count, ROOM_SIZE);
+}
+
+
+/// @brief takes the player out of their room, which goes on without them, and frees the room once it is empty
+/// @param session session of the player
+/// @param wheel timer wheel
+void room_leave(Session *session, TimerWheel *wheel) {
+    Room *room = (*session).room, **link;
+    int i;
+
+    if (room == NULL) { return; }
+
+    for (i = 0; (*room).members[i] != session; i++);
+    (*room).members[i] = (*room).members[--(*room).count];
+    if ((*session).room_state == ROOM_WAITING) { (*room).ready--; }
+    if ((*room).winner == session) { (*room).winner = NULL; }
+
+    if ((*room).count > 0) {
+        room_release(room, wheel); // the others may have been waiting only for them
+        return;
+    }
+    for (link = &rooms; *link != room; link = &(**link).next);
+    *link = (*room).next;
+    free(room);
+}
+
+
+/// @brief announces the first right answer of the question to every member of the room: the WINNER frame is formatted once and the same
+///        bytes are sent to all of them in this iteration of the event loop, so it needs no copy per member nor any reference to outlive it
+/// @param room the room
+/// @param winner session of the player who answered first
+void room_announce(Room *room, Session *winner) {
+    char frame[BUF_NAME_SIZE + 1];
+    int i, len;
+
+    (*room).winner = winner;
+    len = sprintf(frame, "%c%s", WINNER, (*winner).name) + 1;
+    for (i = 0; i < (*room).count; i++) {
+        if (send_message((*room).members[i], frame, len)) { shutdown((*(*room).members[i]).fd, SHUT_RDWR); }
+    }
+}
+
+
+/// @brief fails the current question of the client, whose time is up, and tells them
+/// @param session session of the client
+/// @return 0 on success, 1 otherwise
+int session_timeout(Session *session) {
+    char c = TIMEOUT;
+
+    if ((*session).question_sent) { session_graded(session, 0, QUESTION_TIMEOUT_MS); } // it was sent, the player failed it
+    (*session).timed_out = 1;
+    (*session).points--;
+    (*session).question_sent = 0; // the question counts as failed, a late answer is not graded
+    (*session).graded = 1;
+    session_save(session);
+    client_log("client %d: time is up\n", (*session).fd);
+    metrics.timeouts++;
+    return send_message(session, &c, 1);
+}
+
+
+/// @brief when a question of the tournament is sent, every round lasts the answer window and the pause after it
+/// @param round index of the question
+/// @return monotonic time in nanoseconds
+long round_release(int round) { return tournament.start + round * (tournament.window + TOURNAMENT_PAUSE_MS * 1000000L); }
+
+
+/// @brief schedules the tournament
+/// @param delay_s seconds until the first question
+/// @param window_ms milliseconds the players have to answer each question
+/// @param rounds questions of the tournament, every question of the bank
+void tournament_schedule(int delay_s, int window_ms, int rounds) {
+    tournament.start = now_ns() + delay_s * 1000000000L;
+    tournament.window = window_ms * 1000000L;
+    tournament.rounds = rounds;
+    printf("tournament of %d questions starts in %d s, %d ms to answer each\n", rounds, delay_s, window_ms);
+}
+
+
+/// @brief registers the player for the tournament, only before its first question and before the player got any question
+/// @param session session of the player
+/// @return 0 on success, 1 otherwise
+int tournament_register(Session *session) {
+    char frame[BUF_STANDING_SIZE];
+    int len;
+    Session **players;
+
+    if (tournament.start == 0 || tournament.released > 0 || (*session).seat != -1 || (*session).room != NULL || (*session).question_number > 0) {
+        len = sprintf(frame, "%cno tournament is open", STANDING) + 1;
+        return send_message(session, frame, len);
+    }
+    if (tournament.count == tournament.size) {
+        tournament.size = tournament.size ? 2 * tournament.size : 1024;
+        if ((players = realloc(tournament.players, tournament.size * sizeof(Session *))) == NULL) { return 1; }
+        tournament.players = players;
+    }
+    (*session).seat = tournament.count;
+    tournament.players[tournament.count++] = session;
+    timer_cancel(&(*session).idle); // the tournament paces the player, who has nothing to send until its first round, however far away
+    session_bank_order(session);
+    session_forget(session);
+
+    len = sprintf(frame, "%cregistered, the tournament starts in %ld s", STANDING, (tournament.start - now_ns()) / 1000000000L + 1) + 1;
+    return send_message(session, frame, len);
+}
+
+
+/// @brief takes the player out of the tournament, the last player takes their seat
+/// @param session session of the player
+void tournament_leave(Session *session) {
+    if ((*session).seat == -1) { return; }
+
+    tournament.players[(*session).seat] = tournament.players[--tournament.count];
+    (*tournament.players[(*session).seat]).seat = (*session).seat;
+    (*session).seat = -1;
+}
+
+
+/// @brief sends the next question of the tournament to every player waiting for it, at the same instant.
+///        a player who cannot take it is shut down, the event loop closes it when it reads the end of its connection
+/// @param wheel timer wheel
+void tournament_release(TimerWheel *wheel) {
+    int i, round = tournament.released, sent = 0;
+    long start = now_ns();
+    Session *player;
+
+    tournament.released++;
+    tournament.open = 1;
+    tournament.answered = tournament.right = 0;
+    for (i = 0; i < tournament.count; i++) {
+        player = tournament.players[i];
+        if ((*player).room_state != ROOM_WAITING || (*player).position != round) { continue; } // late players get it when they ask
+        (*player).room_state = ROOM_PLAYING;
+        if (send_question(player, wheel)) { shutdown((*player).fd, SHUT_RDWR); }
+        sent++;
+    }
+    printf("tournament: question %d sent to %d of %d players in %ld us\n", round + 1, sent, tournament.count, (now_ns() - start) / 1000);
+}
+
+
+/// @brief resolves the open round of the tournament at its deadline: the players who did not answer time out,
+///        then every player is sent the result of the round and their rank, which is 1 + the players with more points
+/// @param wheel timer wheel
+void tournament_resolve(TimerWheel *wheel) {
+    char frame[BUF_STANDING_SIZE];
+    int i, len, round = tournament.released - 1, low = 0, high = 0, *above;
+    long start = now_ns();
+    Session *player;
+
+    tournament.open = 0;
+    for (i = 0; i < tournament.count; i++) {
+        player = tournament.players[i];
+        // graded: the question was sent and answered, late players behind this round time out when they ask for theirs
+        if ((*player).position == round && !(*player).timed_out && ((*player).room_state != ROOM_PLAYING || (*player).question_sent)) {
+            if (session_timeout(player)) { shutdown((*player).fd, SHUT_RDWR); }
+        }
+        if (i == 0 || (*player).points < low) { low = (*player).points; }
+        if (i == 0 || (*player).points > high) { high = (*player).points; }
+    }
+
+    // players per score, then summed from the best score down into the players above each score
+    if ((above = calloc(high - low + 2, sizeof(int))) == NULL) { return; }
+    for (i = 0; i < tournament.count; i++) { above[(*tournament.players[i]).points - low]++; }
+    for (i = high - low; i >= 0; i--) { above[i] += above[i + 1]; }
+
+    for (i = 0; i < tournament.count; i++) {
+        player = tournament.players[i];
+        if (round == tournament.rounds - 1) {
+            len = sprintf(frame, "%cfinal: %d points, rank %d/%d", STANDING, (*player).points,
+                          above[(*player).points - low + 1] + 1, tournament.count) + 1;
+        }
+        else {
+            len = sprintf(frame, "%cround %d/%d: %d/%d right, %d points, rank %d/%d", STANDING, round + 1, tournament.rounds,
+                          tournament.right, tournament.count, (*player).points, above[(*player).points - low + 1] + 1, tournament.count) + 1;
+        }
+        if (send_message(player, frame, len)) { shutdown((*player).fd, SHUT_RDWR); }
+    }
+    free(above);
+
+    tournament.resolve_ns = now_ns() - start;
+    printf("tournament: question %d resolved for %d players in %ld us, %d answers, %d right\n", round + 1, tournament.count,
+           tournament.resolve_ns / 1000, tournament.answered, tournament.right);
+
+    if (round == tournament.rounds - 1) { // over, its players play on alone
+        for (i = 0; i < tournament.count; i++) {
+            (*tournament.players[i]).seat = -1;
+            timer_arm(wheel, &(*tournament.players[i]).idle, IDLE_TIMEOUT_MS);
+        }
+        free(tournament.players);
+        tournament.players = NULL;
+        tournament.count = tournament.size = 0;
+        tournament.start = 0;
+    }
+}
+
+
+/// @brief sends the next question of the tournament or resolves its round when their time has come, called every iteration of the event loop
+/// @param wheel timer wheel
+void tournament_tick(TimerWheel *wheel) {
+    long now = now_ns();
+
+    if (tournament.start == 0) { return; }
+    if (tournament.open && now >= round_release(tournament.released - 1) + tournament.window) { tournament_resolve(wheel); }
+    if (tournament.start && !tournament.open && tournament.released < tournament.rounds && now >= round_release(tournament.released)) {
+        tournament_release(wheel);
+    }
+}
+
+
+/// @brief how long the event loop can wait for events, so the tournament keeps its schedule to the millisecond
+/// @return milliseconds, at most TICK_MS
+int tournament_timeout() {
+    long next;
+
+    if (tournament.start == 0) { return TICK_MS; }
+    next = tournament.open ? round_release(tournament.released - 1) + tournament.window : round_release(tournament.released);
+    next = (next - now_ns() + 999999) / 1000000;
+    if (next < 0) { return 0; }
+    return next < TICK_MS ? next : TICK_MS;
+}
+
+
+/// @brief answers RESUME: an empty string gives the game a resume token, a token takes up its game on this connection,
+///        before the first question only. games in a room or the tournament follow the other players, they are not put aside
+/// @param session session of the player
+/// @return 0 on success, 1 otherwise
+int session_resume(Session *session) {
+    char frame[BUF_TOKEN_SIZE];
+    unsigned long token;
+    int len, resumed = 0;
+
+    if ((*session).room == NULL && (*session).seat == -1) {
+        if ((*session).text[0] == '\0') { session_token(session); }
+        else if ((*session).question_number == 0 && sscanf((*session).text, "%lx", &token) == 1 && token != 0) {
+            resumed = session_restore(session, token) == 0;
+        }
+    }
+    if (!session_owns(session) || ((*session).text[0] && !resumed)) { len = sprintf(frame, "%c", RESUME) + 1; }
+    else { len = sprintf(frame, "%c%016lx %d", RESUME, (*session).token, (*session).points) + 1; }
+    if (send_message(session, frame, len)) { return 1; }
+    if (!resumed) { return 0; }
+    client_log("client %d: resumed game %lu at question %d\n", (*session).fd, (*session).game, (*session).position + 1);
+    return send_status(session);
+}
+
+
+/// @brief closes the connection of a client, records the game in the journal and frees its slot.
+///        a game put aside keeps its snapshot and is recorded once it ends, on the connection that resumed it
+/// @param session session to close
+/// @param wheel timer wheel
+void session_close(Session *session, TimerWheel *wheel) {
+    room_leave(session, wheel);
+    tournament_leave(session);
+    if ((*session).finished) { session_forget(session); }
+    // without -s the snapshots go with the server, the games it closes when it terminates are recorded
+    if ((*session).token == 0 || (*session).finished || (snapshots.path == NULL && quit)) { journal_append(session); }
+    if ((*session).reviews != NULL) { reviews_flush(); }
+    timer_cancel(&(*session).deadline);
+    timer_cancel(&(*session).idle);
+    close((*session).fd);
+    (*session).kind = SLOT_FREE;
+    metrics.sessions_active--;
+}
+
+
+/// @brief handles one request of the client
+/// @param session session of the client
+/// @param c request
+/// @param wheel timer wheel
+/// @return 0 if the session goes on, 1 if it has to be closed
+int handle_request(Session *session, char c, TimerWheel *wheel) {
+    Question *q = (*(*session).node).question;
+    int correct = 0;
+
+    if ((*session).seat == -1) { timer_arm(wheel, &(*session).idle, IDLE_TIMEOUT_MS); } // a player of the tournament is never idle
+
+    switch (c) {
+        case QUESTION:
+            if ((*session).timed_out) { break; } // the client already got the TIMEOUT verdict for this question
+            if ((*session).seat != -1 && (*session).room_state != ROOM_PLAYING) { // sent to every player when the round starts
+                if ((*session).position >= tournament.released) {
+                    (*session).room_state = ROOM_WAITING;
+                    break;
+                }
+                if ((*session).position < tournament.released - 1 || !tournament.open) { return session_timeout(session); } // its round is over
+                (*session).room_state = ROOM_PLAYING; // late, but the round still takes answers
+            }
+            if ((*session).room != NULL && (*session).room_state != ROOM_PLAYING) { // sent once every member asked for it
+                if ((*session).room_state == ROOM_IDLE) {
+                    (*session).room_state = ROOM_WAITING;
+                    (*(*session).room).ready++;
+                    room_release((*session).room, wheel);
+                }
+                break;
+            }
+            return send_question(session, wheel);
+        case ANSWER:
+            if ((*session).timed_out) { break; }
+            timer_cancel(&(*session).deadline);
+            if ((*session).question_sent) { // only the first answer to a question is timed and graded
+                long elapsed = now_ns() - (*session).question_sent;
+
+                record_answer(q, elapsed);
+                correct = compare((*q).answer + 1, (*session).text) == 0;
+                session_graded(session, correct, elapsed / 1000000);
+                if (correct) { (*session).points++; }
+                else { (*session).points--; }
+                (*session).answered++;
+                if ((*session).points > (*session).best) { (*session).best = (*session).points; }
+                (*session).graded = 1;
+                session_save(session);
+                leaderboard_update(session);
+                if ((*session).seat != -1 && tournament.open && (*session).position == tournament.released - 1) {
+                    tournament.answered++;
+                    tournament.right += correct;
+                }
+            }
+            (*session).question_sent = 0;
+            client_log("client %d: answered\n", (*session).fd);
+            metrics.answers++;
+            if (send_frame(session, (*q).answer, (*q).answer_length)) { return 1; }
+            // the first right answer of a room wins the question, announced after the verdict of the winner
+            if (correct && (*session).room != NULL && (*(*session).room).winner == NULL) { room_announce((*session).room, session); }
+            break;
+        case CLUE:
+            if ((*session).timed_out) { break; }
+            client_log("client %d: clue\n", (*session).fd);
+            metrics.clues++;
+            (*q).stats.clues++;
+            selector_update(q);
+            (*session).clues++;
+            session_save(session);
+            return send_frame(session, (*q).clue, (*q).clue_length);
+        case NEXT_QUESTION:
+            timer_cancel(&(*session).deadline);
+            (*session).room_state = ROOM_IDLE;
+            if ((*session).adaptive) {
+                if ((*session).position == game_questions() - 1) { return (*session).finished = 1; }
+                (*session).position++;
+                session_draw(session);
+                return send_status(session);
+            }
+            (*session).position++;
+            if ((*(*session).node).next == NULL) { return (*session).finished = 1; }
+            (*session).node = (*(*session).node).next;
+            return send_status(session);
+        case EXIT:
+            client_log("client %d disconnected: /exit command\n", (*session).fd);
+            return (*session).finished = 1;
+        case PLAYER_NAME:
+            copy_name((*session).name, (*session).text);
+            // a returning player gets the questions it has due first, even the first one if it was not sent yet
+            if ((*session).adaptive && reviews.buckets != NULL && (*session).reviews == NULL) {
+                (*session).reviews = review_player((*session).name, 1);
+                if ((*session).question_number == 0 && review_due((*session).reviews) != NULL) { session_draw(session); }
+            }
+            session_save(session);
+            break;
+        case JOIN:
+            // only before the first question, the members of a room have to be at the same question
+            if ((*session).room == NULL && (*session).seat == -1 && (*session).question_number == 0 && (*session).text[0]) {
+                char name[BUF_NAME_SIZE];
+
+                copy_name(name, (*session).text);
+                room_join(session, name);
+                if ((*session).room != NULL) {
+                    session_bank_order(session);
+                    session_forget(session); // it follows the other members, its game cannot be put aside
+                }
+            }
+            break;
+        case LEADERBOARD:
+            return send_leaderboard(session);
+        case TOURNAMENT:
+            return tournament_register(session);
+        case RESUME:
+            return session_resume(session);
+    }
+    return 0;
+}
+
+
+/// @brief reads every request the client has sent so far
+/// @param session session of the client
+/// @param wheel timer wheel
+/// @return 0 if the session goes on, 1 if it has to be closed
+int handle_client(Session *session, TimerWheel *wheel) {
+    char buf[BUF_REQ_SIZE], c;
+    int i, n, done, kind;
+    long start = trace_begin(), elapsed;
+
+    while ((n = read((*session).fd, buf, BUF_REQ_SIZE)) > 0) {
+        trace_end("read", start, (*session).fd);
+        metrics.bytes_in += n;
+        for (i = 0; i < n; i++) {
+            c = buf[i];
+            if ((*session).pending) { // the string of a request, which is handled once its null terminator arrives
+                if (c != '\0') {
+                    if ((*session).text_len < BUF_ANS_SIZE - 1) { (*session).text[(*session).text_len++] = c; }
+                    continue;
+                }
+                (*session).text[(*session).text_len] = '\0';
+                c = (*session).pending;
+                (*session).pending = 0;
+            }
+            else if (c == ANSWER || c == PLAYER_NAME || c == JOIN || c == RESUME) {
+                (*session).pending = c;
+                (*session).text_len = 0;
+                continue;
+            }
+
+            start = now_ns();
+            done = handle_request(session, c, wheel);
+            elapsed = now_ns() - start;
+            record_latency(elapsed);
+            if ((kind = request_kind(c)) != -1) { hdr_record(&metrics.service[kind], elapsed); }
+            trace_end(request_name(c), start, (*session).fd);
+            if (done) { return 1; }
+        }
+        start = trace_begin();
+    }
+    trace_end("read", start, (*session).fd);
+    if (n == 0) {
+        client_log("client %d disconnected\n", (*session).fd);
+        return 1;
+    }
+    return errno != EAGAIN && errno != EINTR;
+}
+
+
+/// @brief finds the session a timer is embedded in, the slot of the slab its address falls in
+/// @param timer timer of the session
+/// @return pointer to the session
+Session *timer_session(Timer *timer) {
+    return &sessions[((char *)timer - (char *)sessions) / sizeof(Session)];
+}
+
+
+/// @brief handles a timer of a session that fired
+/// @param timer timer that fired
+/// @return 0 if the session goes on, 1 if it has to be closed
+int handle_timer(Timer *timer) {
+    Session *session = timer_session(timer);
+    long span = trace_begin();
+    char c;
+    int done;
+
+    if (timer == &(*session).deadline) {
+        done = session_timeout(session);
+        trace_end("timeout", span, (*session).fd);
+        return done;
+    }
+
+    client_log("client %d: idle for too long, disconnecting\n", (*session).fd);
+    c = DISCARD;
+    send_message(session, &c, 1);
+    trace_end("discard", span, (*session).fd);
+    return 1;
+}
+
+
+/// @brief accepts every pending connection of a listener
+/// @param listen_fd descriptor of the listener
+/// @param epoll_fd descriptor of the epoll instance
+/// @param wheel timer wheel
+/// @param head head of linked list
+void accept_clients(int listen_fd, int epoll_fd, TimerWheel *wheel, QuestionNode **head) {
+    int fd;
+    long span = trace_begin();
+    struct epoll_event event;
+
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK)) != -1) {
+        // smaller buffers bound what a client that stops reading holds in the kernel, an idle socket holds none of it
+        if (socket_buffer > 0) {
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &socket_buffer, sizeof(socket_buffer));
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &socket_buffer, sizeof(socket_buffer));
+        }
+        if (fd >= MAX_SESSIONS || admission_shed(fd) || session_open(fd, wheel, head) == NULL) {
+            close(fd);
+            span = trace_begin();
+            continue;
+        }
+        trace_end("connect", span, fd); // accept and the first status
+        span = trace_begin();
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        client_log("client %d connected\n", fd);
+    }
+}
+
+
+/// @brief creates a local listener: an AF_UNIX socket, of type SOCK_SEQPACKET for clients so every send() reaches them as one message
+/// @param path filesystem path of the socket
+/// @param type SOCK_SEQPACKET for clients, SOCK_STREAM for the stats socket so any tool can read it
+/// @param backlog connections the kernel queues until they are accepted
+/// @return descriptor of the listening socket, -1 on failure
+int unix_listener(char *path, int type, int backlog) {
+    int fd;
+    struct sockaddr_un address;
+
+    if ((fd = socket(AF_UNIX, type | SOCK_NONBLOCK, 0)) == -1) { return -1; }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    unlink(path); // a previous run that crashed leaves the socket file behind and bind() would fail with EADDRINUSE
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, backlog) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+int main(int argc, char **argv) {
+    int i, n, zero_copy = 0, adaptive = 0, wrong = 0, tournament_delay = -1, window_ms = QUESTION_TIMEOUT_MS, questions = 0, server_socket_fd, unix_socket_fd, stats_socket_fd, epoll_fd;
+    struct sockaddr_in address; // struct that holds the address of the server
+    struct epoll_event event, events[MAX_EVENTS];
+    struct rlimit limit;
+    struct sigaction sa;
+    int socket_options = 1; /* to enable the sockets options */
+    QuestionNode *linked_list_questions_head = NULL;
+    TimerWheel wheel;
+    Timer expired, *timer;
+    QuestionNode *node;
+    char *snapshots_path = NULL;
+    int backlog = SOMAXCONN, lag_ms = 0;
+    long batch;
+
+    // -z sends the questions with sendfile() from a memfd instead of send() from the heap,
+    // -a draws the questions of every game by difficulty instead of sending them in the order of the bank,
+    // -T schedules a tournament that starts that many seconds after the server, -W sets how long its players have to answer,
+    // -s keeps the snapshots of the games in a file, so they can be resumed after a restart,
+    // -b sets the send and receive buffers of the client sockets, in bytes,
+    // -C admits at most that many clients at once, -L sheds new clients while the event loop lags more than that many milliseconds,
+    // -Q sets how many connections the kernel queues until they are accepted
+    while ((n = getopt(argc, argv, "zaT:W:s:b:C:L:Q:")) != -1) {
+        switch (n) {
+            case 'z': zero_copy = 1; break;
+            case 'a': adaptive = 1; break;
+            case 'T': tournament_delay = atoi(optarg); break;
+            case 'W': window_ms = atoi(optarg); break;
+            case 's': snapshots_path = optarg; break;
+            case 'b': socket_buffer = atoi(optarg); break;
+            case 'C': admission.max_clients = atoi(optarg); break;
+            case 'L': lag_ms = atoi(optarg); break;
+            case 'Q': backlog = atoi(optarg); break;
+            default: wrong = 1; break;
+        }
+    }
+    if (wrong || argc - optind > 1 || window_ms < 1 || socket_buffer < 0 || admission.max_clients < 0 || lag_ms < 0 || backlog < 1) {
+        printf("usage: %s [-z] [-a] [-T tournament-delay-s] [-W answer-window-ms] [-s snapshots-path] [-b socket-buffer-bytes] "
+               "[-C max-clients] [-L max-lag-ms] [-Q backlog] [database-path]\n", argv[0]);
+        return 1;
+    }
+    admission.target_ns = lag_ms * 1000000L;
+    admission.lag_min = LONG_MAX;
+    admission.interval_start = now_ns();
+    if (getrandom(&admission.seed, sizeof(admission.seed), 0) != sizeof(admission.seed)) { admission.seed = (unsigned long)now_ns() * 0x9E3779B97F4A7C15UL; }
+    if (admission.seed == 0) { admission.seed = 1; }
+    log_clients = getenv("QUIZIA_LOG") != NULL && strcmp(getenv("QUIZIA_LOG"), "debug") == 0;
+
+    // another database, e.g. a large one written by the generator, can be given instead of the default
+    if (parser(&linked_list_questions_head, optind < argc ? argv[optind] : DATABASE_PATH, zero_copy)) {
+        printf("failed to parse the database\n");
+        return 1;
+    }
+    for (node = linked_list_questions_head; node != NULL; node = (*node).next) { questions++; }
+    printf("database parsed successfully: %d questions, %ld KiB resident, sent with %s\n", questions, resident_kib(), zero_copy ? "sendfile()" : "send()");
+    if (bank_index(linked_list_questions_head, questions)) {
+        clear(&linked_list_questions_head);
+        printf("memory error\n");
+        return 1;
+    }
+    if (adaptive && questions > 0) {
+        if (selector_init(linked_list_questions_head, questions)) {
+            clear(&linked_list_questions_head);
+            printf("memory error\n");
+            return 1;
+        }
+        printf("games of %d questions drawn by difficulty\n", game_questions());
+        if (reviews_start(linked_list_questions_head, questions)) {
+            clear(&linked_list_questions_head);
+            printf("failed to open the review store\n");
+            return 1;
+        }
+    }
+
+    // every session needs a descriptor, the soft limit (usually 1024) is raised as far as allowed
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    // creates the server socket of type SOCK_STREAM, domain AF_INET (IPv4), protocol 0 (default)
+    if ((server_socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1) {
+        clear(&linked_list_questions_head);
+        perror("failed to create socket");
+        exit(EXIT_FAILURE);
+    }
+
+    // set socket options to reuse the address and port number immediately after the server terminates
+    // this is useful when the server crashes and you want to restart it without waiting for the port to be released
+    if (setsockopt(server_socket_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &socket_options, sizeof(socket_options))) {
+        clear(&linked_list_questions_head);
+        perror("setsockopt");
+        exit(EXIT_FAILURE);
+    }
+
+    // address family is AF_INET, IP address is INADDR_ANY, and port number is PORT
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY; // INADDR_ANY means the server will bind to all network interfaces on the host machine
+    address.sin_port = htons(PORT);
+
+    // bind the server socket to the address and port number
+    if (bind(server_socket_fd, (struct sockaddr *)&address, sizeof(address))<0) {
+        clear(&linked_list_questions_head);
+        perror("bind failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // listen for incoming connections
+    if (listen(server_socket_fd, backlog) < 0) {
+        clear(&linked_list_questions_head);
+        perror("listen");
+        exit(EXIT_FAILURE);
+    }
+
+    // local clients connect through the unix socket instead
+    if ((unix_socket_fd = unix_listener(UNIX_SOCKET_PATH, SOCK_SEQPACKET, backlog)) == -1) {
+        clear(&linked_list_questions_head);
+        perror("unix socket");
+        exit(EXIT_FAILURE);
+    }
+
+    // e.g. socat - UNIX-CONNECT:/tmp/quizia.stats.sock
+    if ((stats_socket_fd = unix_listener(STATS_SOCKET_PATH, SOCK_STREAM, SOMAXCONN)) == -1) {
+        clear(&linked_list_questions_head);
+        perror("stats socket");
+        exit(EXIT_FAILURE);
+    }
+
+    // reserved but not backed: a page of the slab is only touched once a descriptor of its sessions is used
+    sessions = mmap(NULL, MAX_SESSIONS * sizeof(Session), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ((epoll_fd = epoll_create1(0)) == -1 || sessions == MAP_FAILED) {
+        clear(&linked_list_questions_head);
+        perror("epoll");
+        exit(EXIT_FAILURE);
+    }
+    event.events = EPOLLIN;
+    event.data.fd = server_socket_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket_fd, &event);
+    event.data.fd = unix_socket_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, unix_socket_fd, &event);
+    event.data.fd = stats_socket_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stats_socket_fd, &event);
+
+    // no SA_RESTART, a SIGINT has to interrupt epoll_wait()
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigint_handler;
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, sigpipe_handler);
+
+    if (trace_start()) {
+        clear(&linked_list_questions_head);
+        perror("trace");
+        exit(EXIT_FAILURE);
+    }
+
+    if (journal_start()) {
+        clear(&linked_list_questions_head);
+        perror("journal");
+        exit(EXIT_FAILURE);
+    }
+
+    if (snapshots_start(snapshots_path)) {
+        clear(&linked_list_questions_head);
+        perror("snapshots");
+        exit(EXIT_FAILURE);
+    }
+
+    wheel_init(&wheel, current_tick());
+    if (tournament_delay >= 0) { tournament_schedule(tournament_delay, window_ms, questions); }
+
+    while (!quit) {
+        n = epoll_wait(epoll_fd, events, MAX_EVENTS, tournament_timeout());
+        batch = now_ns();
+
+        for (i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == server_socket_fd || fd == unix_socket_fd) {
+                accept_clients(fd, epoll_fd, &wheel, &linked_list_questions_head);
+            }
+            else if (fd == stats_socket_fd) {
+                int stats_fd;
+
+                // the connection is answered once its command can be read, see handle_stats()
+                while ((stats_fd = accept4(stats_socket_fd, NULL, NULL, SOCK_NONBLOCK)) != -1) {
+                    if (stats_fd >= MAX_SESSIONS) {
+                        close(stats_fd);
+                        continue;
+                    }
+                    sessions[stats_fd].kind = SLOT_STATS;
+                    event.events = EPOLLIN;
+                    event.data.fd = stats_fd;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stats_fd, &event);
+                }
+            }
+            else if (sessions[fd].kind == SLOT_STATS) {
+                handle_stats(fd, epoll_fd);
+            }
+            else if (sessions[fd].kind == SLOT_DUMP) {
+                HistogramDump *dump = dump_find(fd);
+
+                if (dump_send(dump)) { dump_close(dump); }
+            }
+            else if (sessions[fd].kind == SLOT_CLIENT && handle_client(&sessions[fd], &wheel)) {
+                session_close(&sessions[fd], &wheel);
+            }
+        }
+        admission_update(n > 0 ? now_ns() - batch : 0);
+
+        // fire the question deadlines and idle timeouts that are due
+        expired.next = &expired;
+        expired.prev = &expired;
+        wheel_advance(&wheel, current_tick(), &expired);
+
+        while ((timer = expired.next) != &expired) {
+            expired.next = (*timer).next;
+            (*(*timer).next).prev = &expired;
+            (*timer).next = NULL;
+            (*timer).prev = NULL;
+
+            if (handle_timer(timer)) { session_close(timer_session(timer), &wheel); }
+        }
+        rooms_tick(&wheel);
+        tournament_tick(&wheel);
+    }
+
+    // the server has to terminate, every client is told so
+    for (i = 0; i < MAX_SESSIONS; i++) {
+        if (sessions[i].kind == SLOT_STATS) { close(i); }
+        else if (sessions[i].kind == SLOT_DUMP) { dump_close(dump_find(i)); }
+        else if (sessions[i].kind == SLOT_CLIENT) {
+            char c = DISCARD;
+
+            send_message(&sessions[i], &c, 1);
+            session_close(&sessions[i], &wheel);
+        }
+    }
+    printf("server terminated successfully by SIGINT\n");
+    journal_stop();
+    reviews_stop();
+    snapshots_stop();
+    if (metrics.questions) { printf("%.2f us of CPU per question served\n", (double)cpu_us() / metrics.questions); }
+    fflush(stdout);
+    write_histograms(STDOUT_FILENO);
+    trace_dump();
 
+    munmap(sessions, MAX_SESSIONS * sizeof(Session));
     clear(&linked_list_questions_head);
 
+    close(epoll_fd);
     close(server_socket_fd);
-    close(client_socket_fd);
+    close(unix_socket_fd);
+    close(stats_socket_fd);
+    unlink(UNIX_SOCKET_PATH);
+    unlink(STATS_SOCKET_PATH);
 
     return 0;
 }